@@ -17,6 +17,10 @@
 //   * allow_all() – convenience to accept all standard and extended IDs
 //   * parse()     – interpret text filter definitions (decimal or hex, single IDs or ranges)
 //   * debug_*()   – inspect the internal state
+//   * get_ranges() – decode the finished filter into the ID ranges it accepts
+//   * get_stats()  – used/free filter resources of the finished filter
+//   * get_hw_config_compact() – hardware image holding only the filters in use
+//   * get_hw_config_delta() – changes since the previous image, for live updates
 //
 // All operations are compute-only; no assumptions are made about the platform
 // or execution environment.
@@ -35,6 +39,9 @@ typedef enum {
     CANFILTER_DEV_FDCAN_H7, /* bosch m_can, 128 standard, 64 extended filters */
 } canfilter_hardware_t;
 
+/* Image format flags, byte 3 of the hardware image - MUST MATCH CANDLELIGHT_FW */
+#define CANFILTER_IMAGE_COMPACT 0x01 /* only banks or elements in use */
+
 /* Error codes */
 typedef enum {
     CANFILTER_SUCCESS = 0,
@@ -43,11 +50,57 @@ typedef enum {
     CANFILTER_ERROR_PLATFORM,
 } canfilter_error_t;
 
+/* ID range accepted by a filter */
+struct canfilter_range {
+    uint32_t begin;
+    uint32_t end;
+    bool ext; // extended (29-bit) range
+};
+
+/* Filter resource usage */
+struct canfilter_stats {
+    canfilter_hardware_t dev = CANFILTER_DEV_NONE;
+
+    // bxCAN: filter banks, shared by standard and extended IDs
+    uint32_t banks_used = 0;
+    uint32_t banks_total = 0;
+
+    // FDCAN: standard and extended filter elements
+    uint32_t std_used = 0;
+    uint32_t std_total = 0;
+    uint32_t ext_used = 0;
+    uint32_t ext_total = 0;
+
+    // Banks (bxCAN) or elements (FDCAN) by type.
+    // list is a bxCAN list bank or FDCAN dual ID element,
+    // mask is a bxCAN mask bank or FDCAN range element.
+    uint32_t std_list = 0;
+    uint32_t std_mask = 0;
+    uint32_t ext_list = 0;
+    uint32_t ext_mask = 0;
+
+    // Slots holding a duplicate, used to pad a partially filled bank or element
+    uint32_t padding = 0;
+
+    // Distinct IDs accepted
+    uint32_t std_ids = 0;
+    uint32_t ext_ids = 0;
+};
+
 class canfilter {
   protected:
   public:
     uint8_t verbose = 0; // Verbosity level (0 = no output, 1 = verbose)
 
+    canfilter_error_t error = CANFILTER_SUCCESS; // Why parse() failed
+
+    uint32_t blocks = 0; // Filter entries (IDs, masks, ranges) added since begin()
+
+    // The last get_hw_config_delta() moved banks or elements away from the position
+    // a fresh compile gives them. The image, and its hash, then differ from a fresh
+    // compile of the same filter, so the next full programming cannot be skipped.
+    bool reordered = false;
+
     // Maximum IDs
     static constexpr uint32_t max_std_id = 0x7FFU;      // Standard CAN
     static constexpr uint32_t max_ext_id = 0x1FFFFFFFU; // Extended CAN
@@ -76,10 +129,40 @@ class canfilter {
     virtual void *get_hw_config() = 0;
     virtual size_t get_hw_size() = 0;
 
+    // Compact hardware image: header plus only the banks or elements in use.
+    // Byte 3 holds CANFILTER_IMAGE_COMPACT. The default is the full image.
+    virtual void get_hw_config_compact(std::vector<uint8_t> &image);
+
+    // Load a compact image into the hardware config; false if malformed
+    virtual bool set_hw_config_compact(const uint8_t *image, size_t size);
+
+    // Delta programming. Renumbers banks or elements so those unchanged since the previous
+    // call keep their position, writes only the changed ones into delta and remembers this
+    // image for the next call. Returns false, without delta, on the first call (program the
+    // full image) or if the builder has no delta support.
+    virtual bool get_hw_config_delta(std::vector<uint8_t> &delta);
+
+    // Forget the previous image, e.g. after a failed upload or a new adapter
+    virtual void reset_delta();
+
+    // Apply a delta to the hardware config, as firmware would; false if malformed
+    virtual bool apply_hw_config_delta(const uint8_t *delta, size_t size);
+
     // Print debug information
     virtual void debug_print_reg() const = 0;
     virtual void debug_print() const = 0;
-    virtual void print_usage() const = 0;
+
+    // Print one line filter usage summary
+    void print_usage() const;
+
+    // Decode hardware config into accepted ID ranges
+    virtual void get_ranges(std::vector<canfilter_range> &ranges) const = 0;
+
+    // True if the finished filter accepts this ID
+    bool accepts(uint32_t id, bool ext) const;
+
+    // Filter resource usage
+    virtual void get_stats(canfilter_stats &stats) const = 0;
 
     // Allow all traffic (standard + extended IDs)
     canfilter_error_t allow_all() {
@@ -89,9 +172,13 @@ class canfilter {
         return add_ext_range(0, max_ext_id);
     }
 
-    // Parse list of ID's and ranges
+    // Parse list of ID's and ranges. On failure, error tells why.
     bool parse(const std::string &arg);
     bool parse(const std::vector<std::string> &args);
+
+  protected:
+    // Count distinct accepted IDs into stats
+    void count_ids(canfilter_stats &stats) const;
 };
 
 #endif
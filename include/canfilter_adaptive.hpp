@@ -0,0 +1,88 @@
+#ifndef CANFILTER_ADAPTIVE_H
+#define CANFILTER_ADAPTIVE_H
+
+// canfilter_adaptive
+//
+// Long-running mode that keeps host load bounded when the traffic mix on
+// the bus changes, e.g. an ECU starting a flash session. It applies when
+// the filter does not fit the controller and a superset is programmed
+// (canfilter_hybrid): unwanted IDs in the merged gaps reach the host.
+//
+// Key features:
+//   • observe() – count one frame received from the SocketCAN interface
+//   • rolling per-ID rate over the last window_s seconds, in 1 s buckets
+//   • tick() – once per second; an unwanted ID at chatty_rate or above that
+//     was not chatty before triggers a new split, with gaps weighed by the
+//     observed rates, so the gap holding the chatty ID stays open
+//   • hysteresis: at most one reprogram per hold_s seconds, an ID is only
+//     chatty again after falling below half of chatty_rate, and the new
+//     filter is only programmed if it drops at least min_gain of the
+//     unwanted traffic the current filter lets through
+//   • run() – read frames from a CAN_RAW socket until stop() (Linux)
+
+#include "canfilter_classifier.hpp"
+#include "canfilter_device.hpp"
+#include "canfilter_hybrid.hpp"
+#include "canfilter_ranges.hpp"
+#include "canfilter_usb.hpp"
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+class canfilter_adaptive {
+  public:
+    canfilter_adaptive(const canfilter_ranges &spec, canfilter_hardware_t dev, canfilter_usb &usb);
+
+    int verbose = 0;
+    uint32_t window_s = 10;   // rate window
+    double chatty_rate = 100; // frames per second of an unwanted ID that triggers a new split
+    uint32_t hold_s = 30;     // minimum time between reprograms
+    double min_gain = 0.2;    // fraction of unwanted traffic a new filter must drop
+
+    // Split without rates and program the adapter
+    bool start();
+
+    // Count one received frame; can_id as in struct can_frame
+    void observe(uint32_t can_id);
+
+    // Advance one second; reprogram if needed. false if programming failed.
+    bool tick();
+
+    // Receive loop on a CAN_RAW socket, returns after stop() or on socket failure
+    bool run(const std::string &ifname);
+    void stop();
+
+    // Rolling rate of one can_id (CAN_EFF_FLAG and ID bits), frames per second
+    double rate(uint32_t can_id) const;
+
+    // Rolling rate of frames the host filter drops
+    double unwanted_rate() const;
+
+    // Current split
+    canfilter_hybrid split;
+
+    // Counters
+    uint32_t reprogrammed = 0;
+    uint32_t kept = 0; // new split computed but not better enough
+
+  private:
+    const canfilter_ranges &spec_;
+    canfilter_hardware_t dev_;
+    canfilter_usb &usb_;
+    canfilter_classifier wanted_;   // the specification
+    canfilter_classifier hardware_; // split.hardware
+
+    std::map<uint32_t, std::vector<uint32_t>> counts_; // can_id to frames per bucket
+    uint32_t bucket_ = 0;
+    uint32_t seconds_ = 0;
+    uint32_t last_program_ = 0;
+    std::map<uint32_t, double> chatty_; // unwanted IDs at chatty_rate, and their peak rate
+    std::atomic<bool> running_;
+
+    bool program(const canfilter_hybrid &next);
+    // Unwanted frames per second hardware would let through, chatty IDs at their peak rate
+    double unwanted_rate(const canfilter_classifier &hardware) const;
+};
+
+#endif
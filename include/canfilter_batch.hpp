@@ -0,0 +1,82 @@
+#ifndef CANFILTER_BATCH_H
+#define CANFILTER_BATCH_H
+
+// canfilter_batch
+//
+// Command mode for scripted test benches that change the filter thousands
+// of times. One process keeps the libusb context, the claimed handle, the
+// controller type and the compiled filter between commands, so a change
+// only costs the recompile and the upload.
+//
+// Key features:
+//   • start() – query the adapter once: filter support, features and
+//     controller type
+//   • command() – one command line, answered with exactly one line starting
+//     with "ok" or "error:", flushed, so a caller can wait for each answer
+//   • set / add / remove / clear – edit the specification; remove subtracts
+//     IDs and ranges, splitting ranges where needed
+//   • program – nothing to do if the adapter holds the specification; else
+//     compile, only if it changed since the last compile, and send a delta
+//     if the adapter supports it, or the (compact) image unless the adapter
+//     already holds it
+//   • stats – filter usage of the specification as JSON
+//   • dry_run – compile without an adapter; dev must be set
+//
+// Commands, one per line; lines starting with '#' are ignored:
+//
+//   set 0x100-0x1ff 0x700    replace the specification
+//   add 0x7e8-0x7ef          add IDs and ranges
+//   remove 0x180-0x18f       remove IDs and ranges
+//   clear                    empty specification
+//   show                     the specification in command line syntax
+//   program                  program the adapter
+//   stats                    filter usage as JSON
+//   quit                     end, as end of input does
+
+#include "canfilter_device.hpp"
+#include "canfilter_ranges.hpp"
+#include "canfilter_usb.hpp"
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class canfilter_batch {
+  public:
+    explicit canfilter_batch(canfilter_usb &usb);
+
+    int verbose = 0;
+    canfilter_hardware_t dev = CANFILTER_DEV_NONE; // controller type, or ask the adapter
+    bool dry_run = false;                          // compile only, no adapter
+
+    // Query the adapter and set the initial specification (normalized)
+    bool start(const canfilter_ranges &spec);
+
+    // Execute one command line and write its answer; false if the answer is an error
+    bool command(const std::string &line, std::ostream &out);
+
+    // Execute commands from in until quit or end of input
+    bool run(std::istream &in, std::ostream &out);
+
+    // Counters
+    uint32_t commands = 0;
+    uint32_t failed = 0;
+    uint32_t programmed = 0; // uploads, full image or delta
+
+  private:
+    canfilter_usb &usb_;
+    std::unique_ptr<canfilter> filter_; // compiled for dev, holds the delta base
+    canfilter_ranges spec_;             // normalized
+    bool compiled_ = false;             // filter_ holds spec_
+    bool programmed_ = false;           // the adapter holds programmed_ranges_
+    std::vector<canfilter_range> programmed_ranges_;
+    bool quit_ = false;
+
+    // Replace spec_ by next; keeps the compiled filter if nothing changed
+    void update(canfilter_ranges &next);
+    canfilter_error_t compile();
+    bool program(std::ostream &out);
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef CANFILTER_BENCH_H
+#define CANFILTER_BENCH_H
+
+// canfilter_bench
+//
+// USB programming latency benchmark. Opens an adapter, queries its
+// capabilities and uploads a filter image, a given number of rounds, and
+// reports latency percentiles of each stage. Gives numbers to compare
+// firmware and libusb versions.
+//
+// Key features:
+//   • run() – repeat open, capability and filter type query, and upload
+//   • collects open, query and transfer stages as a canfilter_trace
+//   • p50, p99 and max latency per stage, as text or JSON
+//   • works on USB adapters and on simulated transports
+//
+// The specification must be normalized (canfilter_ranges::end()) before use.
+
+#include "canfilter_device.hpp"
+#include "canfilter_ranges.hpp"
+#include "canfilter_trace.hpp"
+#include "canfilter_usb.hpp"
+#include <functional>
+#include <map>
+#include <ostream>
+#include <vector>
+
+class canfilter_bench : public canfilter_trace {
+  public:
+    // Opens the adapter for one round, e.g. usb.open(vid, pid) or usb.set_transport(sim)
+    typedef std::function<bool(canfilter_usb &usb)> open_fn;
+
+    unsigned int timeout_ms = 1000; // per USB request
+    unsigned int retries = 0;       // resend a failed request this many times
+    bool keep_kernel_driver = true; // see usb_device::keep_kernel_driver
+
+    uint32_t rounds = 0;        // rounds run
+    uint32_t failed_rounds = 0; // rounds with a failed stage
+
+    // Run n rounds. dev is the controller type, or CANFILTER_DEV_NONE to use the type the adapter reports.
+    // True if all rounds succeeded.
+    bool run(uint32_t n, const open_fn &open, const canfilter_ranges &spec,
+             canfilter_hardware_t dev = CANFILTER_DEV_NONE);
+
+    void stage_done(const canfilter_trace_event &event) override;
+
+    // Latency of a stage in microseconds at percentile p (0-100), nearest rank; 0 if no samples
+    uint64_t percentile(canfilter_stage_t stage, double p) const;
+
+    void print(std::ostream &out) const;
+    void print_json(std::ostream &out) const;
+
+  private:
+    struct samples {
+        std::vector<uint64_t> duration_us; // sorted after run()
+        uint32_t failed = 0;
+    };
+    samples stages_[CANFILTER_STAGE_COUNT];
+    std::map<int, canfilter_image> images_;
+
+    bool round(const open_fn &open, const canfilter_ranges &spec, canfilter_hardware_t dev);
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef CANFILTER_BPF_H
+#define CANFILTER_BPF_H
+
+// canfilter_bpf
+//
+// Compiles a filter specification into a classic BPF program for CAN_RAW
+// sockets (SO_ATTACH_FILTER). A list of CAN_RAW_FILTER id/mask pairs is
+// scanned for every frame; the BPF program is a binary search over the
+// accepted ranges and takes O(log n) comparisons per frame, which matters
+// for specifications with hundreds of disjoint IDs.
+//
+// Key features:
+//   • program – the BPF instructions, in the kernel's struct sock_filter layout
+//   • error frames are accepted; remote frames are accepted like data frames
+//   • standard and extended frames (CAN_EFF_FLAG) each get their own search tree
+//   • run() / match() – interpreter for the instructions the compiler emits,
+//     to check a program without a kernel
+//   • attach_socket_filter() – SO_ATTACH_FILTER on Linux
+//   • canfilter_socket_bench() – CPU per frame on a (virtual) CAN interface,
+//     without filter, with CAN_RAW_FILTER and with the BPF program
+//
+// The program reads can_id in the byte order of the host that compiled it.
+
+#include "canfilter.hpp"
+#include "canfilter_ranges.hpp"
+#include "canfilter_socketcan.hpp"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* Classic BPF opcodes - MUST MATCH <linux/filter.h> */
+#define CANFILTER_BPF_LD 0x00
+#define CANFILTER_BPF_ALU 0x04
+#define CANFILTER_BPF_JMP 0x05
+#define CANFILTER_BPF_RET 0x06
+#define CANFILTER_BPF_MISC 0x07
+#define CANFILTER_BPF_W 0x00
+#define CANFILTER_BPF_B 0x10
+#define CANFILTER_BPF_ABS 0x20
+#define CANFILTER_BPF_OR 0x40
+#define CANFILTER_BPF_AND 0x50
+#define CANFILTER_BPF_LSH 0x60
+#define CANFILTER_BPF_JA 0x00
+#define CANFILTER_BPF_JEQ 0x10
+#define CANFILTER_BPF_JGT 0x20
+#define CANFILTER_BPF_JGE 0x30
+#define CANFILTER_BPF_JSET 0x40
+#define CANFILTER_BPF_K 0x00
+#define CANFILTER_BPF_X 0x08
+#define CANFILTER_BPF_TAX 0x00
+
+/* One instruction, same layout as struct sock_filter */
+struct canfilter_bpf_insn {
+    uint16_t code;
+    uint8_t jt;
+    uint8_t jf;
+    uint32_t k;
+};
+
+class canfilter_bpf : public canfilter {
+  public:
+    static constexpr uint32_t max_insns = 4096; // BPF_MAXINSNS
+
+    // Program, valid after end()
+    std::vector<canfilter_bpf_insn> program;
+
+    canfilter_error_t begin() override;
+    canfilter_error_t add_std_id(uint32_t id) override;
+    canfilter_error_t add_ext_id(uint32_t id) override;
+    canfilter_error_t add_std_range(uint32_t begin, uint32_t end) override;
+    canfilter_error_t add_ext_range(uint32_t begin, uint32_t end) override;
+    canfilter_error_t end() override;
+
+    // The program
+    void *get_hw_config() override;
+    size_t get_hw_size() override;
+
+    void debug_print_reg() const override;
+    void debug_print() const override;
+
+    void get_ranges(std::vector<canfilter_range> &ranges) const override;
+    void get_stats(canfilter_stats &stats) const override;
+
+    // Run the program on a frame; returns the bytes to keep, 0 to drop. steps counts instructions executed.
+    uint32_t run(const uint8_t *frame, size_t size, uint32_t *steps = nullptr) const;
+
+    // Run the program on a frame with can_id
+    bool match(uint32_t can_id, uint32_t *steps = nullptr) const;
+
+    // True if the program accepts exactly the ranges, checked at and next to every range boundary
+    bool verify() const;
+
+    // Most instructions executed for one frame
+    uint32_t max_steps() const;
+
+    // Program as "count" followed by "code jt jf k" lines, as tcpdump -ddd and bpf_asm print
+    void print_program(std::ostream &out) const;
+
+    // SO_ATTACH_FILTER on a CAN_RAW socket; false on failure or other platforms
+    bool attach_socket_filter(int fd) const;
+
+  private:
+    canfilter_ranges ranges_; // added since begin(), normalized by end()
+
+    void emit(uint16_t code, uint32_t k, uint8_t jt = 0, uint8_t jf = 0);
+};
+
+/* Socket filter benchmark result */
+struct canfilter_socket_bench_result {
+    std::string filter;     // none, can_filter or bpf
+    uint32_t entries = 0;   // filters or instructions
+    uint32_t sent = 0;      // frames sent
+    uint32_t received = 0;  // frames accepted by the filter
+    double cpu_ns = 0;      // process CPU time per frame sent
+};
+
+// Send frames with pseudo-random IDs on ifname, received by a CAN_RAW socket without filter, with the
+// CAN_RAW_FILTER list and with the BPF program. Measures process CPU time, which includes the softirq
+// that filters the frames on a virtual interface. false if the interface cannot be used.
+bool canfilter_socket_bench(const std::string &ifname, uint32_t frames, const canfilter_socketcan &list,
+                            const canfilter_bpf &bpf, std::vector<canfilter_socket_bench_result> &results);
+
+#endif
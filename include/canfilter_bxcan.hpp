@@ -16,12 +16,15 @@
 //   • ext_list tracks extended IDs for 32-bit banks
 //   • Largest-prefix helpers compute minimal mask representations for ranges
 //   • emit_*() methods write the computed values into hw_config for all banks
+//   • get_hw_config_compact() sends the mode registers and the banks in use only
+//   • get_hw_config_delta() keeps unchanged banks in place and sends changed banks only
 //
 // This class is fully compute-only. It does not access registers or MCU headers;
 // it produces a complete hardware-ready filter image that can be transferred
 // to any bxCAN-compatible device.
 
 #include "canfilter.hpp"
+#include "canfilter_delta.hpp"
 #include <cstdint>
 #include <cstring>
 
@@ -61,14 +64,30 @@ template <uint8_t max_banks_t, uint8_t dev_val> class canfilter_bxcan : public c
 
     void *get_hw_config() override;
     size_t get_hw_size() override;
+    void get_hw_config_compact(std::vector<uint8_t> &image) override;
+    bool set_hw_config_compact(const uint8_t *image, size_t size) override;
+    bool get_hw_config_delta(std::vector<uint8_t> &delta) override;
+    void reset_delta() override;
+    bool apply_hw_config_delta(const uint8_t *delta, size_t size) override;
 
     void debug_print_reg() const override;
     void debug_print() const override;
-    void print_usage() const override;
+
+    void get_ranges(std::vector<canfilter_range> &ranges) const override;
+    void get_stats(canfilter_stats &stats) const override;
 
   private:
     uint32_t bank = 0; /* current register bank */
 
+    // Image of the previous get_hw_config_delta()
+    hw_t previous_config;
+    uint32_t previous_banks = 0;
+    bool has_previous = false;
+
+    // Banks 0 .. n-1 as slots, and back into hw_config
+    static void get_slots(const hw_t &config, uint32_t n, std::vector<canfilter_slot> &slots);
+    void set_slots(const std::vector<canfilter_slot> &slots);
+
     // Extended IDs
     uint32_t ext_list[2];
     uint32_t ext_list_count = 0;
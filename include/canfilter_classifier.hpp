@@ -0,0 +1,208 @@
+#ifndef CANFILTER_CLASSIFIER_H
+#define CANFILTER_CLASSIFIER_H
+
+// canfilter_classifier
+//
+// Header-only software filter for receive loops. Compiled from the same
+// specification as the hardware filters (canfilter_ranges::compile()), it
+// classifies a frame with two or three table lookups, whatever the number
+// of IDs and ranges.
+//
+// Key features:
+//   • standard IDs: 2048-bit bitmap
+//   • extended IDs: two-level table; the upper 16 bits of the ID select an
+//     8192-bit leaf. Empty and full leaves are shared, so a wide range costs
+//     no memory and scattered IDs cost one 1 KiB leaf each.
+//   • match() – one frame, can_id as in struct can_frame: CAN_EFF_FLAG
+//     selects the format, CAN_RTR_FLAG and CAN_ERR_FLAG are ignored
+//   • classify() – array of can_ids; uses AVX2 gathers, 8 frames at a time,
+//     when compiled with -mavx2, else a scalar loop
+//
+// There is no hardware image: get_hw_config() returns nullptr.
+
+#include "canfilter.hpp"
+#include "canfilter_ranges.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+class canfilter_classifier : public canfilter {
+  public:
+    static constexpr uint32_t leaf_bits = 13; // extended ID bits per leaf
+    static constexpr uint32_t leaf_words = (1U << leaf_bits) / 32; // 32-bit words per leaf
+    static constexpr uint32_t top_size = 1U << (29 - leaf_bits); // leaves for all extended IDs
+    static constexpr uint32_t eff_flag = 0x80000000U; // CAN_EFF_FLAG
+
+    canfilter_classifier() {
+        begin();
+    }
+
+    canfilter_error_t begin() override {
+        blocks = 0;
+        std::fill(std_bits_, std_bits_ + max_std_id / 32 + 1, 0);
+        top_.assign(top_size, empty_leaf);
+        leaves_.assign(2 * leaf_words, 0);
+        std::fill(leaves_.begin() + full_leaf * leaf_words, leaves_.end(), 0xFFFFFFFFU);
+        return ranges_.begin();
+    }
+
+    canfilter_error_t add_std_id(uint32_t id) override {
+        return ranges_.add_std_id(id);
+    }
+
+    canfilter_error_t add_ext_id(uint32_t id) override {
+        return ranges_.add_ext_id(id);
+    }
+
+    canfilter_error_t add_std_range(uint32_t begin, uint32_t end) override {
+        return ranges_.add_std_range(begin, end);
+    }
+
+    canfilter_error_t add_ext_range(uint32_t begin, uint32_t end) override {
+        return ranges_.add_ext_range(begin, end);
+    }
+
+    canfilter_error_t end() override {
+        ranges_.normalize(true);
+        blocks = ranges_.ranges.size();
+        for (const auto &r : ranges_.ranges) {
+            if (!r.ext) {
+                set_bits(std_bits_, r.begin, r.end);
+                continue;
+            }
+            for (uint32_t leaf = r.begin >> leaf_bits; leaf <= r.end >> leaf_bits; leaf++) {
+                uint32_t first = std::max(r.begin, leaf << leaf_bits);
+                uint32_t last = std::min(r.end, ((leaf + 1) << leaf_bits) - 1);
+                uint32_t mask = (1U << leaf_bits) - 1;
+                if ((first & mask) == 0 && (last & mask) == mask) {
+                    top_[leaf] = full_leaf;
+                    continue;
+                }
+                if (top_[leaf] == empty_leaf) {
+                    top_[leaf] = leaves_.size() / leaf_words;
+                    leaves_.resize(leaves_.size() + leaf_words, 0);
+                }
+                set_bits(&leaves_[top_[leaf] * leaf_words], first & mask, last & mask);
+            }
+        }
+
+        if (verbose)
+            std::cout << "classifier " << ranges_.ranges.size() << " ranges, " << leaves() << " extended leaves"
+                      << std::endl;
+        return CANFILTER_SUCCESS;
+    }
+
+    // No hardware image
+    void *get_hw_config() override {
+        return nullptr;
+    }
+
+    size_t get_hw_size() override {
+        return 0;
+    }
+
+    void debug_print_reg() const override {
+        for (uint32_t leaf = 0; leaf < top_size; leaf++)
+            if (top_[leaf] != empty_leaf)
+                std::cout << "leaf " << std::hex << (leaf << leaf_bits) << std::dec
+                          << (top_[leaf] == full_leaf ? " full" : " partial") << std::endl;
+    }
+
+    void debug_print() const override {
+        ranges_.debug_print();
+    }
+
+    void get_ranges(std::vector<canfilter_range> &ranges) const override {
+        ranges = ranges_.ranges;
+    }
+
+    // banks: extended leaves allocated, out of one per 8192 extended IDs
+    void get_stats(canfilter_stats &stats) const override {
+        stats = canfilter_stats();
+        stats.banks_used = leaves();
+        stats.banks_total = top_size;
+        for (const auto &r : ranges_.ranges) {
+            if (r.ext)
+                (r.begin == r.end ? stats.ext_list : stats.ext_mask)++;
+            else
+                (r.begin == r.end ? stats.std_list : stats.std_mask)++;
+        }
+        count_ids(stats);
+    }
+
+    // True if the frame with this can_id passes the filter
+    bool match(uint32_t can_id) const {
+        return (word(can_id) >> (can_id & 31)) & 1;
+    }
+
+    // Classify n frames: accept[i] is 1 if can_ids[i] passes, else 0. Returns the number accepted.
+    size_t classify(const uint32_t *can_ids, size_t n, uint8_t *accept) const {
+        size_t accepted = 0;
+        size_t i = 0;
+#ifdef __AVX2__
+        const __m256i eff = _mm256_set1_epi32((int)eff_flag);
+        const __m256i std_mask = _mm256_set1_epi32(max_std_id);
+        const __m256i ext_mask = _mm256_set1_epi32(max_ext_id);
+        const __m256i word_mask = _mm256_set1_epi32(leaf_words - 1);
+        const __m256i bit_mask = _mm256_set1_epi32(31);
+        for (; i + 8 <= n; i += 8) {
+            __m256i can_id = _mm256_loadu_si256((const __m256i *)(can_ids + i));
+            __m256i is_ext = _mm256_cmpeq_epi32(_mm256_and_si256(can_id, eff), eff);
+
+            __m256i std_index = _mm256_srli_epi32(_mm256_and_si256(can_id, std_mask), 5);
+            __m256i std_word = _mm256_i32gather_epi32((const int *)std_bits_, std_index, 4);
+
+            __m256i id = _mm256_and_si256(can_id, ext_mask);
+            __m256i leaf = _mm256_i32gather_epi32((const int *)top_.data(), _mm256_srli_epi32(id, leaf_bits), 4);
+            __m256i ext_index = _mm256_add_epi32(_mm256_slli_epi32(leaf, leaf_bits - 5),
+                                                 _mm256_and_si256(_mm256_srli_epi32(id, 5), word_mask));
+            __m256i ext_word = _mm256_i32gather_epi32((const int *)leaves_.data(), ext_index, 4);
+
+            __m256i w = _mm256_blendv_epi8(std_word, ext_word, is_ext);
+            __m256i bit = _mm256_srlv_epi32(w, _mm256_and_si256(can_id, bit_mask));
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_slli_epi32(bit, 31)));
+            for (int j = 0; j < 8; j++)
+                accept[i + j] = (mask >> j) & 1;
+            accepted += __builtin_popcount(mask);
+        }
+#endif
+        for (; i < n; i++) {
+            accept[i] = match(can_ids[i]);
+            accepted += accept[i];
+        }
+        return accepted;
+    }
+
+    // Extended leaves allocated
+    uint32_t leaves() const {
+        return leaves_.size() / leaf_words - 2;
+    }
+
+  private:
+    enum : uint32_t { empty_leaf = 0, full_leaf = 1 };
+
+    canfilter_ranges ranges_; // added since begin(), normalized by end()
+    uint32_t std_bits_[max_std_id / 32 + 1]; // one bit per standard ID
+    std::vector<uint32_t> top_; // leaf per upper 16 bits of an extended ID
+    std::vector<uint32_t> leaves_; // leaf_words per leaf; leaf 0 empty, leaf 1 full
+
+    // 32-bit word holding the bit of can_id
+    uint32_t word(uint32_t can_id) const {
+        if (!(can_id & eff_flag))
+            return std_bits_[(can_id & max_std_id) >> 5];
+        uint32_t id = can_id & max_ext_id;
+        return leaves_[top_[id >> leaf_bits] * leaf_words + ((id >> 5) & (leaf_words - 1))];
+    }
+
+    static void set_bits(uint32_t *bits, uint32_t first, uint32_t last) {
+        for (uint32_t id = first; id <= last; id++)
+            bits[id >> 5] |= 1U << (id & 31);
+    }
+};
+
+#endif
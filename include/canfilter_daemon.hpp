@@ -0,0 +1,94 @@
+#ifndef CANFILTER_DAEMON_H
+#define CANFILTER_DAEMON_H
+
+// canfilter_daemon
+//
+// Long-running mode that programs adapters the moment they are plugged in.
+// Filter profiles are compiled for every controller type at startup, so an
+// attach only costs the capability query and the filter upload.
+//
+// Key features:
+//   • add_profile() / load_profiles() – filter per adapter serial number,
+//     "*" for adapters without a profile of their own
+//   • run() – libusb hotplug loop; polls the bus where libusb has no hotplug
+//     support (Windows). Adapters present at startup are programmed too.
+//   • attach() – program one adapter from its precompiled image; also used
+//     with simulated adapters
+//   • stop() – end run(), safe to call from a signal handler
+//   • switch_profile() / run_switch() – switch one open adapter between
+//     named profiles on command, e.g. driving, diagnostics and flash modes;
+//     only the upload of the precompiled image is on the critical path
+//
+// Profile file: one profile per line, serial number followed by IDs and
+// ranges in command line syntax. Lines starting with '#' are comments.
+//
+//   # serial          filter
+//   004A00323433510E  0x100-0x1ff 0x700
+//   *                 0x7df 0x7e8-0x7ef
+//
+// For switching, the first word is the profile name instead.
+
+#include "canfilter_device.hpp"
+#include "canfilter_ranges.hpp"
+#include "canfilter_usb.hpp"
+#include <atomic>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+class canfilter_daemon {
+  public:
+    canfilter_daemon();
+    ~canfilter_daemon();
+
+    int verbose = 0;
+    canfilter_hardware_t dev = CANFILTER_DEV_NONE; // controller type of all adapters, or ask each adapter
+    uint32_t poll_ms = 500;                        // bus poll interval without hotplug support
+    unsigned int timeout_ms = 1000;                // per USB request
+    unsigned int retries = 0;                      // resend a failed request this many times
+    bool skip_unchanged = true;                    // do not upload an image the adapter already holds
+
+    // Profiles, compiled for every controller type when added
+    bool add_profile(const std::string &serial, const canfilter_ranges &spec);
+    bool load_profiles(const std::string &filename);
+    size_t profile_count() const;
+
+    // Program a newly attached adapter; name is used in messages
+    bool attach(canfilter_usb &usb, const std::string &name, const std::string &serial);
+
+    // Program usb with the profile called name, from the image precompiled for dev
+    bool switch_profile(canfilter_usb &usb, const std::string &name);
+
+    // Query the controller type and filter state of usb once, then switch to the profile
+    // named on each line of in, until end of input
+    bool run_switch(canfilter_usb &usb, std::istream &in);
+
+    // Hotplug loop, returns after stop() or on libusb failure
+    bool run();
+    void stop();
+
+    // Counters
+    uint32_t programmed = 0;
+    uint32_t failed = 0;
+
+  private:
+    struct profile {
+        canfilter_ranges spec;
+        std::map<int, canfilter_image> images; // key is canfilter_hardware_t
+    };
+    std::map<std::string, profile> profiles_;
+
+    std::atomic<bool> running_;
+    std::vector<usb_device_info> pending_; // attached, not yet programmed
+    std::map<std::string, uint16_t> seen_; // polling: path to bus << 8 | address
+
+    const profile *find_profile(const std::string &serial) const;
+    void attach_pending();
+    void poll();
+
+    static int hotplug_callback(libusb_context *ctx, libusb_device *device, libusb_hotplug_event event,
+                                void *user_data);
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef CANFILTER_DELTA_H
+#define CANFILTER_DELTA_H
+
+// canfilter_delta
+//
+// Helpers for delta programming, shared by the filter builders. A filter is
+// seen as a list of slots: a bxCAN bank (mode bits and FR1/FR2) or an FDCAN
+// filter element (one or two words). Slot order does not change which IDs
+// are accepted, so the builders are free to renumber them. A renumbered
+// image has another hash than a fresh compile of the same filter, so the
+// adapter no longer matches it and the next full programming is not skipped
+// (canfilter::reordered).
+//
+//   • canfilter_stable_order() – renumber new slots so slots that did not
+//     change keep the position they had in the previous image
+//   • canfilter_delta_add() – append the slots that differ to a delta
+//   • canfilter_delta_header() / canfilter_delta_entries() – delta format
+//
+// Delta format, little endian:
+//   dev, count 0, count 1, CANFILTER_IMAGE_DELTA
+//   bxCAN only: FS1R, FM1R, FFA1R, FA1R
+//   entries of 12 bytes: index, kind, 0, 0, word 0, word 1
+// Counts are the banks in use (bxCAN, count 1 is zero) or the standard and
+// extended elements in use (FDCAN). Kind is 0 for a bank or standard element,
+// 1 for an extended element. Slots beyond the counts are cleared.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Delta image flag, byte 3 of the image - MUST MATCH CANDLELIGHT_FW */
+#define CANFILTER_IMAGE_DELTA 0x02
+
+#define CANFILTER_DELTA_HEADER_SIZE 4
+#define CANFILTER_DELTA_ENTRY_SIZE 12
+
+// One bank or filter element
+struct canfilter_slot {
+    uint32_t mode = 0; // bxCAN: bit 0 32-bit scale, bit 1 list mode, bit 2 FIFO 1
+    uint32_t word[2] = {0, 0};
+
+    bool operator==(const canfilter_slot &other) const {
+        return mode == other.mode && word[0] == other.word[0] && word[1] == other.word[1];
+    }
+    bool operator!=(const canfilter_slot &other) const {
+        return !(*this == other);
+    }
+};
+
+// One changed slot in a delta
+struct canfilter_delta_entry {
+    uint8_t index;
+    uint8_t kind;
+    uint32_t word[2];
+};
+
+// Reorder next so a slot equal to one in prev keeps that position, if it is in range
+void canfilter_stable_order(const std::vector<canfilter_slot> &prev, std::vector<canfilter_slot> &next);
+
+// Append header; delta is cleared first
+void canfilter_delta_header(uint8_t dev, uint8_t count0, uint8_t count1, std::vector<uint8_t> &delta);
+
+// Append an entry for every position where next differs from prev
+void canfilter_delta_add(uint8_t kind, const std::vector<canfilter_slot> &prev, const std::vector<canfilter_slot> &next,
+                         std::vector<uint8_t> &delta);
+
+// Decode entries starting at offset; false if the size does not match
+bool canfilter_delta_entries(const uint8_t *delta, size_t size, size_t offset,
+                             std::vector<canfilter_delta_entry> &entries);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef CANFILTER_DEVICE_H
+#define CANFILTER_DEVICE_H
+
+// canfilter_device
+//
+// Maps controller types to their names and filter builders, so that callers
+// can construct the right canfilter_* class without repeating the per-device
+// switch statement.
+//
+// Key features:
+//   • canfilter_create() – allocate the builder for a controller type
+//   • canfilter_device_name() / canfilter_device_from_name() – convert to and
+//     from the names used on the command line (bxcan_f0, fdcan_h7, ...)
+//   • canfilter_device_list – all controller types with a hardware filter
+//   • canfilter_print_stats_json() – filter usage as JSON, for tooling
+//   • canfilter_compile() – compile a specification into a hardware image
+//   • canfilter_program_status() – one-word outcome of programming an adapter
+//   • canfilter_image_hash() – CRC-32 of a full image, as reported by the adapter
+
+#include "canfilter.hpp"
+#include "canfilter_ranges.hpp"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Compiled hardware image for one controller type
+struct canfilter_image {
+    canfilter_hardware_t dev = CANFILTER_DEV_NONE;
+    canfilter_error_t error = CANFILTER_SUCCESS;
+    canfilter_stats stats;
+    std::vector<uint8_t> data;    // full image, any firmware
+    std::vector<uint8_t> compact; // filters in use only, GS_CAN_FEATURE_FILTER_COMPACT
+    uint32_t hash = 0;            // canfilter_image_hash() of data
+};
+
+// All controller types with a hardware filter
+extern const canfilter_hardware_t canfilter_device_list[4];
+
+// Allocate filter builder for controller type, nullptr if none
+canfilter *canfilter_create(canfilter_hardware_t dev);
+
+// Command line name of controller type
+const char *canfilter_device_name(canfilter_hardware_t dev);
+
+// One line description of controller type
+const char *canfilter_device_description(canfilter_hardware_t dev);
+
+// Controller type from command line name, CANFILTER_DEV_NONE if unknown
+canfilter_hardware_t canfilter_device_from_name(const std::string &name);
+
+// Print filter usage statistics as one JSON object
+void canfilter_print_stats_json(std::ostream &out, const canfilter_stats &stats);
+
+// Compile specification for controller type; image.error tells why it failed
+canfilter_error_t canfilter_compile(canfilter_hardware_t dev, const canfilter_ranges &spec, canfilter_image &image,
+                                    canfilter_trace *trace = nullptr);
+
+// Outcome of programming an adapter: "programmed", "unchanged", "reordered", "does not fit", ...
+// dev is the controller type reported by the adapter, CANFILTER_DEV_NONE if unknown.
+// reordered: programmed by a delta that left canfilter::reordered set
+const char *canfilter_program_status(canfilter_error_t err, canfilter_hardware_t dev, bool unchanged = false,
+                                     bool reordered = false);
+
+// CRC-32 (IEEE 802.3) of a full hardware image
+uint32_t canfilter_image_hash(const uint8_t *data, size_t size);
+
+#endif
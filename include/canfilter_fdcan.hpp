@@ -15,12 +15,15 @@
 //   • std_id / ext_id arrays hold IDs until they can be serialized into table entries
 //   • emit_*() methods create raw filter descriptors in hw_config
 //   • end() finalizes the table for hardware consumption
+//   • get_hw_config_compact() sends the filter elements in use only
+//   • get_hw_config_delta() keeps unchanged elements in place and sends changed elements only
 //
 // This class is fully compute-only and platform-independent. It produces the
 // hardware-ready table format expected by firmware or USB loaders, without
 // accessing any MCU registers or relying on platform-specific headers.
 
 #include "canfilter.hpp"
+#include "canfilter_delta.hpp"
 #include <cstring> // for std::memset
 
 // Base class: canfilter_fdcan
@@ -57,12 +60,28 @@ template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val> cl
 
     void *get_hw_config() override;
     size_t get_hw_size() override;
+    void get_hw_config_compact(std::vector<uint8_t> &image) override;
+    bool set_hw_config_compact(const uint8_t *image, size_t size) override;
+    bool get_hw_config_delta(std::vector<uint8_t> &delta) override;
+    void reset_delta() override;
+    bool apply_hw_config_delta(const uint8_t *delta, size_t size) override;
 
     void debug_print_reg() const override;
     void debug_print() const override;
-    void print_usage() const override;
+
+    void get_ranges(std::vector<canfilter_range> &ranges) const override;
+    void get_stats(canfilter_stats &stats) const override;
 
   private:
+    // Image of the previous get_hw_config_delta()
+    hw_t previous_config;
+    bool has_previous = false;
+
+    // Standard and extended elements in use as slots, and back into hw_config
+    static void get_slots(const hw_t &config, std::vector<canfilter_slot> &std_slots,
+                          std::vector<canfilter_slot> &ext_slots);
+    void set_slots(const std::vector<canfilter_slot> &std_slots, const std::vector<canfilter_slot> &ext_slots);
+
     // Extended IDs
     uint32_t ext_id[2];
     uint8_t ext_id_count = 0;
@@ -0,0 +1,107 @@
+#ifndef CANFILTER_FIRMWARE_H
+#define CANFILTER_FIRMWARE_H
+
+// canfilter_firmware
+//
+// Compiles a filter specification into lookup tables and a C source file
+// for the adapter firmware. When the hardware banks are exhausted, the
+// controller gets a superset (canfilter_hybrid) and candleLight drops the
+// rest in its receive interrupt, before the frame costs USB bandwidth.
+//
+// Key features:
+//   • standard IDs: 2048-bit bitmap, one table read
+//   • single extended IDs: perfect hash with a 16-bit pilot per bucket of
+//     about four IDs; two hashes, two table reads and one compare
+//   • extended ranges: sorted table padded to a power of two, searched in a
+//     fixed number of unrolled steps
+//   • no divisions (Cortex-M0 has no divide instruction), two multiplies
+//     per hash; all tables are const and stay in flash, no RAM
+//   • flash_budget – end() fails with CANFILTER_ERROR_FULL if the tables
+//     do not fit
+//   • print_source() – the tables and canfilter_fw_match() as C99
+//   • match() – the same lookup on the host, on the same tables
+//   • canfilter_firmware_bench() – host lookup time, checked against
+//     canfilter_classifier
+//
+// There is no hardware image: get_hw_config() returns nullptr.
+
+#include "canfilter.hpp"
+#include "canfilter_ranges.hpp"
+#include "canfilter_socketcan.hpp"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class canfilter_firmware : public canfilter {
+  public:
+    uint32_t flash_budget = 4096;        // bytes of tables
+    std::string prefix = "canfilter_fw"; // of the names in the C source
+
+    canfilter_error_t begin() override;
+    canfilter_error_t add_std_id(uint32_t id) override;
+    canfilter_error_t add_ext_id(uint32_t id) override;
+    canfilter_error_t add_std_range(uint32_t begin, uint32_t end) override;
+    canfilter_error_t add_ext_range(uint32_t begin, uint32_t end) override;
+    canfilter_error_t end() override;
+
+    // No hardware image
+    void *get_hw_config() override;
+    size_t get_hw_size() override;
+
+    void debug_print_reg() const override;
+    void debug_print() const override;
+
+    void get_ranges(std::vector<canfilter_range> &ranges) const override;
+
+    // banks: table bytes, out of flash_budget
+    void get_stats(canfilter_stats &stats) const override;
+
+    // True if the frame with this can_id passes; can_id as in struct can_frame
+    bool match(uint32_t can_id) const;
+
+    // True if match() accepts exactly the ranges, checked at and next to every range boundary
+    bool verify() const;
+
+    // Bytes of flash used by the tables
+    uint32_t table_bytes() const;
+
+    // Unrolled steps of the extended range search
+    uint32_t range_steps() const;
+
+    // C source with the tables and bool <prefix>_match(uint32_t can_id)
+    void print_source(std::ostream &out) const;
+
+  private:
+    canfilter_ranges ranges_; // added since begin(), normalized by end()
+
+    bool has_std_ = false;
+    uint32_t std_bits_[max_std_id / 32 + 1]; // one bit per standard ID
+
+    // perfect hash of single extended IDs
+    uint32_t bucket_bits_ = 0;
+    uint32_t slot_bits_ = 0;
+    std::vector<uint16_t> pilots_; // per bucket
+    std::vector<uint32_t> keys_;   // per slot; empty_key if free
+
+    // extended ranges, padded with empty ranges to a power of two
+    std::vector<uint32_t> range_begin_;
+    std::vector<uint32_t> range_end_;
+
+    bool build_hash(const std::vector<uint32_t> &keys);
+};
+
+/* Host lookup benchmark result */
+struct canfilter_firmware_bench_result {
+    uint32_t lookups = 0;
+    uint32_t accepted = 0;
+    uint32_t mismatches = 0;  // against canfilter_classifier
+    double firmware_ns = 0;   // per lookup, canfilter_firmware::match()
+    double classifier_ns = 0; // per lookup, canfilter_classifier::match()
+};
+
+// Look up pseudo-random can_ids, a quarter of them extended IDs of the specification
+bool canfilter_firmware_bench(const canfilter_firmware &firmware, uint32_t lookups,
+                              canfilter_firmware_bench_result &result);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef CANFILTER_GOLDEN_H
+#define CANFILTER_GOLDEN_H
+
+// canfilter_golden
+//
+// Golden-image regression corpus. A corpus file lists filter specifications
+// together with the byte-exact hardware image and filter usage expected for
+// every controller type. check() rebuilds each image and reports any change
+// in bytes or filter usage, so that images on deployed adapters do not change
+// silently when the tool is upgraded.
+//
+// Corpus file format, one item per line:
+//
+//   # comment
+//   spec 0x100-0x1ff 0x1000
+//   bxcan_f0 8 0100000080000000...
+//   fdcan_g0 2+1 03020100...
+//   fdcan_h7 full
+//
+// A device line holds the banks used (bxCAN) or standard+extended elements
+// used (FDCAN) and the image in hex, or "full" if the specification does not
+// fit. Device lines belong to the spec line above them.
+
+#include "canfilter.hpp"
+#include <string>
+#include <vector>
+
+class canfilter_golden {
+  public:
+    uint8_t verbose = 0;
+
+    // Read corpus file
+    bool load(const std::string &filename);
+
+    // Rebuild all images and compare; true if nothing changed
+    bool check();
+
+    // Rebuild all images and write corpus file
+    bool save(const std::string &filename);
+
+  private:
+    struct image_t {
+        canfilter_hardware_t dev;
+        std::string usage; // "8" or "2+1", empty if full
+        std::string hex;
+        bool compact_ok = true; // compact image expands to the same full image
+    };
+
+    struct entry_t {
+        std::vector<std::string> comments; // comment lines before the spec
+        std::string spec;
+        std::vector<image_t> images;
+    };
+
+    std::vector<entry_t> entries;
+    std::vector<std::string> trailer; // comment lines after the last spec
+
+    static bool build(const std::string &spec, canfilter_hardware_t dev, image_t &image);
+    static bool more_banks(const std::string &expected, const std::string &actual);
+};
+
+#endif
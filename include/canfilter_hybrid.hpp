@@ -0,0 +1,65 @@
+#ifndef CANFILTER_HYBRID_H
+#define CANFILTER_HYBRID_H
+
+// canfilter_hybrid
+//
+// Splits a specification that does not fit a controller into a coarser
+// hardware filter and an exact host filter. The adapter drops most bus
+// traffic before USB; the host drops the few extra IDs the hardware lets
+// through, so applications still see exactly the requested IDs.
+//
+// Key features:
+//   • split() – merge the cheapest gaps between ranges until the filter fits
+//   • gap cost: frames per second in the gap, from a DBC file or observed
+//     on the bus, else IDs in the gap
+//   • residual – IDs the hardware accepts that the host must drop
+//   • print() – one line summary of the split
+//
+// The host filter is the specification itself, compiled into socket
+// filters (canfilter_socketcan, canfilter_bpf) or canfilter_classifier.
+
+#include "canfilter.hpp"
+#include "canfilter_load.hpp"
+#include "canfilter_ranges.hpp"
+#include <ostream>
+#include <vector>
+
+// Frame rate of one ID
+struct canfilter_id_rate {
+    uint32_t id;
+    bool ext;
+    double rate; // frames per second
+};
+
+class canfilter_hybrid {
+  public:
+    // Filter for the adapter: the specification, or a superset of it that fits
+    canfilter_ranges hardware;
+
+    // IDs the hardware filter accepts that the specification does not
+    std::vector<canfilter_range> residual;
+
+    uint32_t merges = 0;  // gaps between ranges closed
+    bool widened = false; // merging all gaps was not enough; one mask per frame format
+
+    // Fit spec into dev. load, if given, weighs gaps by their DBC frame rate.
+    // CANFILTER_SUCCESS if spec fits as is or was split.
+    canfilter_error_t split(const canfilter_ranges &spec, canfilter_hardware_t dev,
+                            const canfilter_load *load = nullptr);
+
+    // Fit spec into dev, weighing gaps by the frame rates of the IDs in them
+    canfilter_error_t split(const canfilter_ranges &spec, canfilter_hardware_t dev,
+                            const std::vector<canfilter_id_rate> &rates);
+
+    // True if the hardware filter is the specification
+    bool exact() const {
+        return residual.empty();
+    }
+
+    // IDs in residual
+    uint64_t residual_ids(bool ext) const;
+
+    void print(std::ostream &out) const;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef CANFILTER_LOAD_H
+#define CANFILTER_LOAD_H
+
+// canfilter_load
+//
+// Host-load capacity planner. Reads message IDs, sizes and cycle times from a
+// DBC file and predicts, for a finished filter, the traffic that passes the
+// hardware filter and reaches the host over USB.
+//
+// The model covers:
+//   • frame rate and gs_usb byte rate arriving at the host
+//   • CAN bus load of the accepted frames (worst-case bit stuffing)
+//   • candleLight USB full-speed bulk budget (64-byte packets, 19 per 1 ms frame)
+//   • receive FIFO overrun risk (3-deep bxCAN/G0 FIFO) when accepted frames
+//     arrive back to back, rated apart from USB saturation
+//
+// Event-driven messages (no GenMsgCycleTime) are counted but do not add to the
+// predicted rate. The planner is compute-only; it never touches the device.
+
+#include "canfilter.hpp"
+#include <string>
+#include <vector>
+
+// CAN message from a DBC file
+struct canfilter_message {
+    uint32_t id;
+    bool ext;          // extended (29-bit) ID
+    uint32_t size;     // payload bytes
+    uint32_t cycle_ms; // cycle time, 0 if event-driven
+    std::string name;
+};
+
+// Predicted load behind one filter
+struct canfilter_load_result {
+    uint32_t messages = 0;       // messages accepted
+    uint32_t periodic = 0;       // accepted messages with a cycle time
+    double frames_per_sec = 0;   // frames reaching the host
+    double bytes_per_sec = 0;    // gs_usb bytes reaching the host
+    double bus_load = 0;         // accepted frames, fraction of bus bitrate
+    double usb_load = 0;         // fraction of usb full-speed bulk budget
+    uint32_t burst = 0;          // accepted frames that can be due at the same instant
+    double fifo_deadline_us = 0; // time to fill the rx fifo during a burst
+    const char *fifo_risk = "none"; // rx fifo overrun during a burst: none, low, high
+    const char *usb_risk = "none";  // usb bulk budget: none, medium (above half), high (exceeded)
+};
+
+class canfilter_load {
+  public:
+    uint32_t bitrate = 500000;   // nominal CAN bitrate
+    uint32_t isr_latency_us = 50; // assumed worst-case firmware rx interrupt latency
+
+    std::vector<canfilter_message> messages;
+
+    // Read BO_ and GenMsgCycleTime entries from a DBC file
+    bool parse_dbc(const std::string &filename);
+
+    // Predict load for a finished filter; nullptr means no filter
+    void estimate(const canfilter *filter, canfilter_hardware_t dev, canfilter_load_result &result) const;
+
+    // Print one line of the capacity table
+    static void print_header();
+    static void print(const std::string &label, const canfilter_load_result &result);
+
+  private:
+    uint32_t frame_bits(const canfilter_message &msg) const;
+};
+
+#endif
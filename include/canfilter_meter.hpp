@@ -0,0 +1,57 @@
+#ifndef CANFILTER_METER_H
+#define CANFILTER_METER_H
+
+// canfilter_meter
+//
+// Receive meter for the gs_usb bulk IN endpoint. Measures the traffic that
+// actually reaches the host, so the effect of a filter can be checked on the
+// bus instead of predicted from a DBC file (canfilter_load).
+//
+// Key features:
+//   • several bulk transfers in flight, so the adapter always has a buffer
+//     to send into and host latency does not drop frames
+//   • transfers read straight into the slots of a ring buffer; frames are
+//     decoded in place and the slot is resubmitted
+//   • run() – received frames, bytes, frames with GS_CAN_FLAG_OVERFLOW and
+//     failed transfers over a fixed time
+//   • print_header() / print() – one line per measurement
+//
+// Uses the transport (usb_device or gs_usb_sim) canfilter_usb already
+// opened. The channel must be started (canfilter_usb::startChannel()) and
+// the interface claimed.
+
+#include "gs_usb.hpp"
+#include "usb_transport.hpp"
+#include <string>
+#include <vector>
+
+// Traffic received in one measurement
+struct canfilter_meter_result {
+    double seconds = 0;
+    uint64_t frames = 0;    // received frames; TX echoes are not counted
+    uint64_t bytes = 0;     // bulk IN bytes of the received frames
+    uint64_t overflows = 0; // frames after which the adapter lost frames
+    uint64_t errors = 0;    // failed transfers, timeouts excluded
+    double frames_per_sec = 0;
+    double bytes_per_sec = 0;
+};
+
+class canfilter_meter {
+  public:
+    unsigned int transfers = 8;    // bulk transfers in flight
+    unsigned int timeout_ms = 100; // per transfer; on a quiet bus it times out and is resubmitted
+    uint8_t endpoint = GS_USB_ENDPOINT_IN;
+
+    // Receive for duration_ms. False if no transfer could be submitted.
+    bool run(usb_transport &usb, uint32_t duration_ms, canfilter_meter_result &result);
+
+    static void print_header();
+    static void print(const std::string &label, const canfilter_meter_result &result);
+
+  private:
+    enum : int { slot_size = 80 }; // largest gs_usb host frame: CAN FD with timestamp
+
+    std::vector<unsigned char> ring_; // slot_size bytes per transfer
+};
+
+#endif
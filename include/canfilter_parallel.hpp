@@ -0,0 +1,66 @@
+#ifndef CANFILTER_PARALLEL_H
+#define CANFILTER_PARALLEL_H
+
+// canfilter_parallel
+//
+// Programs many adapters concurrently. Each adapter gets its own worker
+// thread that opens the device, queries its filter type and uploads the
+// image. Images are compiled once per controller type and shared by all
+// workers.
+//
+// Key features:
+//   • program() – program a list of enumerated USB adapters, or a list of
+//     transports such as simulated adapters
+//   • results – one line per adapter: status, controller type and time
+//   • print_results() – result table
+//
+// The specification must be normalized (canfilter_ranges::end()) before use.
+
+#include "canfilter_device.hpp"
+#include "canfilter_ranges.hpp"
+#include "canfilter_usb.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Programming result for one adapter
+struct canfilter_parallel_result {
+    std::string name; // topology path or simulator name
+    std::string serial;
+    canfilter_hardware_t dev = CANFILTER_DEV_NONE;
+    bool success = false;
+    std::string status;
+    uint64_t duration_us = 0;
+};
+
+class canfilter_parallel {
+  public:
+    // dev is the controller type of all adapters, or CANFILTER_DEV_NONE to ask each adapter
+    canfilter_parallel(const canfilter_ranges &spec, canfilter_hardware_t dev = CANFILTER_DEV_NONE);
+
+    // Program adapters concurrently; true if all succeeded
+    bool program(const std::vector<usb_device_info> &devices);
+    bool program(const std::vector<usb_transport *> &transports);
+
+    std::vector<canfilter_parallel_result> results;
+
+    unsigned int timeout_ms = 1000; // per USB request
+    unsigned int retries = 0;       // resend a failed request this many times
+    bool skip_unchanged = true;     // do not upload an image the adapter already holds
+
+    void print_results() const;
+
+  private:
+    const canfilter_ranges &spec_;
+    canfilter_hardware_t dev_;
+
+    // images compiled so far, one per controller type
+    std::mutex mutex_;
+    std::map<int, canfilter_image> images_;
+
+    const canfilter_image &image(canfilter_hardware_t dev);
+    void program_one(canfilter_usb &usb, canfilter_parallel_result &result);
+};
+
+#endif
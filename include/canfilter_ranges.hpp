@@ -0,0 +1,82 @@
+#ifndef CANFILTER_RANGES_H
+#define CANFILTER_RANGES_H
+
+// canfilter_ranges
+//
+// Controller-independent filter specification. Collects the standard and
+// extended IDs and ranges added through the canfilter interface as a plain
+// list of ranges, without any hardware limits.
+//
+// end() normalizes the list: ranges are sorted (standard before extended,
+// ascending) and overlapping or duplicate ranges are merged. The normalized
+// list is what software backends, statistics and set operations work on.
+//
+// Specifications parsed from the command line (parse()) are compiled in
+// command line order: compile() replays the add_*() calls into a builder,
+// duplicates and overlaps included, with single IDs added as IDs. A
+// hardware builder thus gets the same calls as when the arguments were
+// parsed straight into it, and deployed images do not change. All other
+// specifications, and parsed ones after clear_replay(), are compiled from
+// the normalized ranges. Code that edits ranges directly must call
+// clear_replay().
+
+#include "canfilter.hpp"
+#include "canfilter_trace.hpp"
+
+class canfilter_ranges : public canfilter {
+  public:
+    // Ranges in the order added; sorted and merged after end()
+    std::vector<canfilter_range> ranges;
+
+    canfilter_error_t begin() override;
+    canfilter_error_t add_std_id(uint32_t id) override;
+    canfilter_error_t add_ext_id(uint32_t id) override;
+    canfilter_error_t add_std_range(uint32_t begin, uint32_t end) override;
+    canfilter_error_t add_ext_range(uint32_t begin, uint32_t end) override;
+    canfilter_error_t end() override;
+
+    // Parse IDs and ranges, to be compiled in command line order
+    bool parse(const std::string &arg);
+    bool parse(const std::vector<std::string> &args);
+
+    // Compile the normalized ranges from now on
+    void clear_replay();
+
+    // True if compile() replays the add_*() calls in command line order
+    bool replay_order() const {
+        return replay_order_;
+    }
+
+    // No hardware image
+    void *get_hw_config() override;
+    size_t get_hw_size() override;
+
+    void debug_print_reg() const override;
+    void debug_print() const override;
+
+    void get_ranges(std::vector<canfilter_range> &ranges) const override;
+    void get_stats(canfilter_stats &stats) const override;
+
+    // Sort and merge overlapping ranges; optionally also merge adjacent ranges
+    void normalize(bool merge_adjacent = false);
+
+    // Remove the IDs in removed; both normalized, and the result is. Compiles the normalized ranges.
+    void subtract(const canfilter_ranges &removed);
+
+    // Add all ranges to target, between target begin() and end()
+    canfilter_error_t apply(canfilter &target) const;
+
+    // begin(), apply() and end() on target, reporting decompose and pack stages
+    canfilter_error_t compile(canfilter &target, canfilter_trace *trace = nullptr) const;
+
+  private:
+    // One add_*() call since begin()
+    struct added_t {
+        canfilter_range range;
+        bool single; // add_std_id() or add_ext_id()
+    };
+    std::vector<added_t> replay_; // add_*() calls since begin()
+    bool replay_order_ = false;   // set by parse(), cleared by begin() and clear_replay()
+};
+
+#endif
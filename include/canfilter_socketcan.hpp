@@ -0,0 +1,81 @@
+#ifndef CANFILTER_SOCKETCAN_H
+#define CANFILTER_SOCKETCAN_H
+
+// canfilter_socketcan
+//
+// Builder for Linux SocketCAN CAN_RAW socket filters (struct can_filter),
+// for adapters without a hardware filter. The kernel compares every received
+// frame with each filter in turn, so the builder turns the specification into
+// as few id/mask pairs as possible.
+//
+// Key features:
+//   • CIDR aggregation of ranges into id/mask pairs, as the bxCAN builder
+//     does for mask banks; adjacent ranges are merged first
+//   • filters – the can_filter array, in the kernel's layout
+//   • to_candump() – the filters as candump arguments, for other tools
+//   • open_socket() / set_socket_filter() – apply with setsockopt(CAN_RAW_FILTER)
+//     on Linux; on other platforms these fail
+//
+// Standard ID filters do not match extended frames and vice versa; data and
+// remote frames are both accepted, as by the hardware filters.
+
+#include "canfilter.hpp"
+#include "canfilter_ranges.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* can_id flags - MUST MATCH <linux/can.h> */
+#define CANFILTER_CAN_EFF_FLAG 0x80000000U /* extended frame */
+#define CANFILTER_CAN_RTR_FLAG 0x40000000U /* remote frame */
+#define CANFILTER_CAN_ERR_FLAG 0x20000000U /* error frame */
+
+/* One socket filter, same layout as struct can_filter */
+struct canfilter_socketcan_filter {
+    uint32_t can_id;
+    uint32_t can_mask;
+};
+
+class canfilter_socketcan : public canfilter {
+  public:
+    static constexpr uint32_t max_filters = 512; // CAN_RAW_FILTER_MAX
+
+    // Socket filters, valid after end()
+    std::vector<canfilter_socketcan_filter> filters;
+
+    canfilter_error_t begin() override;
+    canfilter_error_t add_std_id(uint32_t id) override;
+    canfilter_error_t add_ext_id(uint32_t id) override;
+    canfilter_error_t add_std_range(uint32_t begin, uint32_t end) override;
+    canfilter_error_t add_ext_range(uint32_t begin, uint32_t end) override;
+    canfilter_error_t end() override;
+
+    // The filters array
+    void *get_hw_config() override;
+    size_t get_hw_size() override;
+
+    void debug_print_reg() const override;
+    void debug_print() const override;
+
+    void get_ranges(std::vector<canfilter_range> &ranges) const override;
+    void get_stats(canfilter_stats &stats) const override;
+
+    // Filters as candump arguments "id:mask,id:mask"; 8 digit ids are extended
+    std::string to_candump() const;
+
+    // CAN_RAW socket bound to interface ifname, -1 on failure
+    static int open_socket(const std::string &ifname);
+
+    // setsockopt(CAN_RAW_FILTER) on a CAN_RAW socket; false on failure
+    bool set_socket_filter(int fd) const;
+
+    // Read back the filters of a CAN_RAW socket; false on failure
+    static bool get_socket_filter(int fd, std::vector<canfilter_socketcan_filter> &filters);
+
+    static void close_socket(int fd);
+
+  private:
+    canfilter_ranges ranges_; // added since begin()
+};
+
+#endif
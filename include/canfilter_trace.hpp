@@ -0,0 +1,83 @@
+#ifndef CANFILTER_TRACE_H
+#define CANFILTER_TRACE_H
+
+// canfilter_trace
+//
+// Timing and counter hooks for the filter compile and programming pipeline.
+// The pipeline is split into stages:
+//
+//   parse      – text to ID ranges
+//   normalize  – sort and merge ranges
+//   decompose  – ranges to filter entries (CIDR blocks, ID pairs, ranges)
+//   pack       – flush partially filled banks or elements
+//   emit       – serialize the hardware image
+//   open       – libusb enumeration and device open
+//   query      – capability query control transfers
+//   transfer   – filter upload control transfer
+//
+// Each finished stage is reported to a canfilter_trace callback with its
+// duration and counters. canfilter_trace_print writes the events to stderr;
+// applications implement their own callback to collect them.
+
+#include <chrono>
+#include <cstdint>
+
+/* Pipeline stages */
+typedef enum {
+    CANFILTER_STAGE_PARSE = 0,
+    CANFILTER_STAGE_NORMALIZE,
+    CANFILTER_STAGE_DECOMPOSE,
+    CANFILTER_STAGE_PACK,
+    CANFILTER_STAGE_EMIT,
+    CANFILTER_STAGE_OPEN,
+    CANFILTER_STAGE_QUERY,
+    CANFILTER_STAGE_TRANSFER,
+    CANFILTER_STAGE_COUNT,
+} canfilter_stage_t;
+
+/* One finished stage */
+struct canfilter_trace_event {
+    canfilter_stage_t stage = CANFILTER_STAGE_PARSE;
+    uint64_t duration_us = 0;
+    bool success = true;
+
+    // Counters, zero if not applicable to the stage
+    uint32_t ranges_in = 0;  // ID ranges entering the stage
+    uint32_t blocks_out = 0; // ranges or filter entries leaving the stage
+    uint32_t banks_used = 0; // bxCAN banks or FDCAN elements in use
+    uint32_t bytes = 0;      // image bytes emitted or sent
+};
+
+/* Callback interface */
+class canfilter_trace {
+  public:
+    virtual ~canfilter_trace() = default;
+    virtual void stage_done(const canfilter_trace_event &event) = 0;
+};
+
+/* Print events on stderr */
+class canfilter_trace_print : public canfilter_trace {
+  public:
+    void stage_done(const canfilter_trace_event &event) override;
+};
+
+/* Measure one stage. Reports on done() or when going out of scope. */
+class canfilter_trace_timer {
+  public:
+    canfilter_trace_event event;
+
+    canfilter_trace_timer(canfilter_trace *trace, canfilter_stage_t stage);
+    ~canfilter_trace_timer();
+
+    void done();
+
+  private:
+    canfilter_trace *trace_;
+    std::chrono::steady_clock::time_point start_;
+    bool done_ = false;
+};
+
+// Stage name
+const char *canfilter_stage_name(canfilter_stage_t stage);
+
+#endif
@@ -9,15 +9,34 @@
 // and transfer of the filter image generated by a canfilter_* builder.
 //
 // Key features:
-//   • open() methods locate and connect to the device using VID/PID and optional serial
+//   • open() methods locate and connect to the device using VID/PID and optional serial,
+//     or its topology path
 //   • hasHardwareFilter() and getFilterInfo() query device capabilities
+//   • channel selects the CAN channel of a multi-channel adapter;
+//     getChannelCount() tells how many there are
 //   • programFilter() uploads a prebuilt hw_config buffer to the device
+//   • queryAndProgram() sends both capability queries at once, compiles as
+//     soon as the filter type is known and uploads the result
+//   • timeout_ms and retries apply to every request
+//   • programImage() sends the compact image if the adapter supports it
+//   • programDelta() sends the changed banks or elements only
+//   • skip_unchanged: programImage() does not upload an image the adapter
+//     already holds, compared by hash; unchanged tells it was skipped
+//   • trace, if set, receives open, query and transfer timings
+//   • set_transport() replaces the libusb device, e.g. by a simulated adapter
+//   • startChannel() / stopChannel() – bit timing and mode, so the channel
+//     receives frames on the bulk IN endpoint of transport()
 //
 // This class does not perform any filter computation or translation. It is
 // strictly a transport and management layer that delivers hardware-ready
 // filter data to the device.
 
+#include "canfilter.hpp"
+#include "canfilter_device.hpp"
+#include "canfilter_trace.hpp"
+#include "gs_usb.hpp"
 #include "usb_device.hpp"
+#include <functional>
 
 class canfilter_usb : public usb_device {
   public:
@@ -26,16 +45,87 @@ class canfilter_usb : public usb_device {
 
     bool open();                                                    // uses our vid/pid list
     bool open(uint16_t vid, uint16_t pid, std::string serial = ""); // uses vid/pid and optional serial.
+    bool open(const usb_device_info &info);                         // device found by enumerate()
+    bool open(const std::string &path);                             // topology path "bus-port.port"
+
+    // VID/PID pairs of supported adapters
+    static const std::vector<std::pair<uint16_t, uint16_t>> default_vid_pid_list_;
 
     bool hasHardwareFilter();
     uint32_t getFilterInfo();
+    uint32_t getChannelCount(); // CAN channels of the adapter, 0 if unknown
     bool programFilter(const void *config, uint32_t size);
 
+    // Upload compact image if the adapter reported GS_CAN_FEATURE_FILTER_COMPACT, else the full image
+    bool programImage(const canfilter_image &image);
+
+    // Upload a delta from canfilter::get_hw_config_delta(); needs GS_CAN_FEATURE_FILTER_DELTA
+    bool programDelta(const std::vector<uint8_t> &delta);
+
+    // CAN channel addressed by filter and capability requests (wValue)
+    uint16_t channel = 0;
+
+    // Feature bits from the last capability query, of channel
+    uint32_t features = 0;
+    bool features_known = false; // the last capability query was answered
+
+    // Skip the upload if the adapter reports the same image hash
+    bool skip_unchanged = true;
+    bool unchanged = false; // last programImage() or queryAndProgram() skipped the upload
+
+    // Filter image for a controller type
+    typedef std::function<canfilter_error_t(uint32_t filter_type, canfilter_image &image)> compile_fn;
+
+    // Pipelined hasHardwareFilter(), getFilterInfo() and programFilter(). Errors from
+    // compile are returned as is; USB failures and adapters without filter give
+    // CANFILTER_ERROR_PLATFORM. filter_type, if given, receives the controller type.
+    canfilter_error_t queryAndProgram(const compile_fn &compile, uint32_t *filter_type = nullptr);
+
+    unsigned int timeout_ms = 1000; // per request
+    unsigned int retries = 0;       // resend a failed request this many times, at most max_retries
+
+    static constexpr unsigned int max_retries = 10;
+
+    canfilter_trace *trace = nullptr; // stage timing callback
+
+    // Send requests to transport instead of the libusb device; nullptr restores
+    void set_transport(usb_transport *transport);
+
+    // Where requests go: this device or the transport set
+    usb_transport *transport() {
+        return transport_;
+    }
+
+    // Set the bit timing of channel for bitrate (sample point 87.5%) and start it
+    bool startChannel(uint32_t bitrate);
+
+    // Stop channel (MODE reset)
+    bool stopChannel();
+
   private:
-    const std::vector<std::pair<uint16_t, uint16_t>> default_vid_pid_list_ = {
-        {0x1D50, 0x606F},
-        {0x1209, 0xCA01},
-    };
+    usb_transport *transport_ = this;
+    // Filter state from the last GET_FILTER, or from the last upload
+    bool state_known_ = false;
+    uint16_t state_channel_ = 0;
+    bool state_hash_valid_ = false;
+    uint32_t state_hash_ = 0;
+
+    // Record the GET_FILTER answer of ret bytes
+    void set_state(int ret, const gs_filter_state &state);
+
+    bool claim_tried_ = false;       // claim_interface() called on transport_
+    bool transport_claimed_ = false; // and succeeded
+
+    // open default device unless transport is ready
+    bool ready();
+
+    // Claim interface after a busy request, tried once; true if claimed
+    bool claim();
+
+    // Control transfer with retries
+    int transfer(uint8_t request_type, uint8_t request, unsigned char *data, uint16_t length);
+    void submit(uint8_t request_type, uint8_t request, unsigned char *data, uint16_t length, unsigned int attempt,
+                const usb_transfer_done &done, bool resent = false);
 };
 
 #endif
@@ -0,0 +1,139 @@
+#ifndef GS_USB_H
+#define GS_USB_H
+
+// gs_usb
+//
+// gs_usb vendor requests and structures used to query and program the
+// hardware filter, and to start a channel and receive its frames. Filter,
+// capability, bit timing and mode requests address a CAN channel in wValue.
+// Shared by the libusb transport (canfilter_usb) and the simulated adapter
+// (gs_usb_sim). Values MUST MATCH CANDLELIGHT_FW, except those in the
+// canfilter extension block at the end, which match the canfilter firmware.
+
+#include <cstddef>
+#include <cstdint>
+#include <libusb-1.0/libusb.h>
+
+#define CANDLE_USB_CTRL_IN (LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_INTERFACE | LIBUSB_ENDPOINT_IN)
+#define CANDLE_USB_CTRL_OUT (LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_INTERFACE | LIBUSB_ENDPOINT_OUT)
+
+#define GS_USB_ENDPOINT_IN 0x81 // bulk IN: received frames and TX echoes
+
+// structures and enums (same as in candlelight_fw)
+enum gs_usb_breq {
+    GS_USB_BREQ_HOST_FORMAT = 0,
+    GS_USB_BREQ_BITTIMING,
+    GS_USB_BREQ_MODE,
+    GS_USB_BREQ_BERR,
+    GS_USB_BREQ_BT_CONST,
+    GS_USB_BREQ_DEVICE_CONFIG,
+    GS_USB_BREQ_TIMESTAMP,
+    GS_USB_BREQ_IDENTIFY,
+    GS_USB_BREQ_GET_USER_ID, // not implemented
+    GS_USB_BREQ_SET_USER_ID, // not implemented
+    GS_USB_BREQ_DATA_BITTIMING,
+    GS_USB_BREQ_BT_CONST_EXT,
+    GS_USB_BREQ_SET_TERMINATION,
+    GS_USB_BREQ_GET_TERMINATION,
+    GS_USB_BREQ_GET_STATE,
+    GS_USB_BREQ_SET_FILTER,
+    GS_USB_BREQ_GET_FILTER,
+    __GS_USB_BREQ_PLACEHOLDER_17,
+    __GS_USB_BREQ_PLACEHOLDER_18,
+    __GS_USB_BREQ_PLACEHOLDER_19,
+    GS_USB_BREQ_ELM_GET_BOARDINFO = 20,
+    GS_USB_BREQ_ELM_SET_FILTER,
+    GS_USB_BREQ_ELM_GET_LASTERROR,
+    GS_USB_BREQ_ELM_SET_BUSLOADREPORT,
+    GS_USB_BREQ_ELM_SET_PINSTATUS,
+    GS_USB_BREQ_ELM_GET_PINSTATUS,
+};
+
+struct gs_device_capability {
+    uint32_t feature;
+    uint32_t fclk_can;
+    uint32_t tseg1_min;
+    uint32_t tseg1_max;
+    uint32_t tseg2_min;
+    uint32_t tseg2_max;
+    uint32_t sjw_max;
+    uint32_t brp_min;
+    uint32_t brp_max;
+    uint32_t brp_inc;
+} __attribute__((packed));
+
+struct gs_device_config {
+    uint8_t reserved1;
+    uint8_t reserved2;
+    uint8_t reserved3;
+    uint8_t icount; // number of CAN channels - 1
+    uint32_t sw_version;
+    uint32_t hw_version;
+} __attribute__((packed));
+
+struct gs_device_bittiming {
+    uint32_t prop_seg;
+    uint32_t phase_seg1;
+    uint32_t phase_seg2;
+    uint32_t sjw;
+    uint32_t brp;
+} __attribute__((packed));
+
+enum gs_can_mode {
+    GS_CAN_MODE_RESET = 0,
+    GS_CAN_MODE_START,
+};
+
+struct gs_device_mode {
+    uint32_t mode; // gs_can_mode
+    uint32_t flags;
+} __attribute__((packed));
+
+// Classic CAN frame on the bulk endpoints, with hardware timestamp
+struct gs_host_frame {
+    uint32_t echo_id; // GS_HOST_FRAME_RX for received frames, else the echo of a sent frame
+    uint32_t can_id;  // as in struct can_frame
+    uint8_t can_dlc;
+    uint8_t channel;
+    uint8_t flags; // GS_CAN_FLAG_*
+    uint8_t reserved;
+    uint8_t data[8];
+    uint32_t timestamp_us;
+} __attribute__((packed));
+
+#define GS_HOST_FRAME_RX 0xFFFFFFFFU
+#define GS_HOST_FRAME_HEADER 12 // bytes before data
+static_assert(offsetof(gs_host_frame, data) == GS_HOST_FRAME_HEADER, "gs_host_frame header size");
+#define GS_CAN_FLAG_OVERFLOW (1 << 0) // the adapter lost frames before this one
+
+// ---- canfilter extension ----
+//
+// NOT UPSTREAM CANDLELIGHT VALUES. The feature bits, the SET_FILTER_DELTA
+// request number and the GET_FILTER hash below are defined by canfilter and
+// the filter firmware it programs; upstream candleLight_fw does not assign
+// them and may use the same numbers for something else. Firmware that does
+// not set GS_CAN_FEATURE_FILTER is never sent any of these requests.
+
+#define GS_CAN_FEATURE_FILTER (1 << 16)         // SET_FILTER and GET_FILTER supported
+#define GS_CAN_FEATURE_FILTER_COMPACT (1 << 17) // SET_FILTER accepts CANFILTER_IMAGE_COMPACT images
+#define GS_CAN_FEATURE_FILTER_DELTA (1 << 18)   // SET_FILTER_DELTA supported
+
+// changed banks or elements only, see canfilter_delta.hpp; takes __GS_USB_BREQ_PLACEHOLDER_17
+#define GS_USB_BREQ_SET_FILTER_DELTA 17
+
+struct gs_filter_info {
+    uint8_t dev;
+    uint8_t reserved[3];
+} __attribute__((packed)) __attribute__((aligned(4)));
+
+// GET_FILTER with wLength 8. Firmware without hash support answers the first 4 bytes only.
+struct gs_filter_state {
+    uint8_t dev;
+    uint8_t flags; // GS_FILTER_STATE_*
+    uint8_t reserved[2];
+    uint32_t hash; // canfilter_image_hash() of the full image in use
+} __attribute__((packed)) __attribute__((aligned(4)));
+
+#define GS_FILTER_STATE_HASH 0x01 // a filter is programmed and hash is valid
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef GS_USB_SIM_H
+#define GS_USB_SIM_H
+
+// gs_usb_sim
+//
+// In-process simulated candleLight adapter with hardware filter support.
+// Implements the usb_transport interface, so canfilter_usb can query and
+// program it exactly like a real adapter:
+//
+//   • DEVICE_CONFIG – number of channels
+//   • BT_CONST   – capability with GS_CAN_FEATURE_FILTER
+//   • GET_FILTER – controller type
+//   • SET_FILTER – checks and stores the uploaded filter image, full or
+//     compact (GS_CAN_FEATURE_FILTER_COMPACT)
+//   • SET_FILTER_DELTA – applies a delta to the stored image
+//     (GS_CAN_FEATURE_FILTER_DELTA)
+//   • BITTIMING, MODE – start and stop a channel
+//   • bulk IN – frames of a simulated bus, bus_rate frames per second, that
+//     pass the channel 0 filter; received once channel 0 is started and the
+//     interface is claimed
+//
+// The Linux gs_usb kernel driver is modelled: by default requests pass the
+// bound driver. With vendor_needs_claim requests fail with LIBUSB_ERROR_BUSY
+// until the interface is claimed, which detaches the driver and resets the
+// network interface (link_resets).
+//
+// Latency and failures can be injected to benchmark and test the programming
+// path, including retries and timeouts, without hardware. Submitted
+// (asynchronous) requests are in flight concurrently: each completes its own
+// latency after submission.
+//
+// Every channel has its own filter image; wValue selects the channel.
+//
+// The bus model: frames that pass the filter while no bulk transfer is
+// pending wait in a receive FIFO of rx_fifo_depth frames; beyond that they
+// are lost and the next frame sent carries GS_CAN_FLAG_OVERFLOW.
+
+#include "canfilter.hpp"
+#include "usb_transport.hpp"
+#include <chrono>
+#include <deque>
+#include <libusb-1.0/libusb.h>
+#include <vector>
+
+class gs_usb_sim : public usb_transport {
+  public:
+    explicit gs_usb_sim(canfilter_hardware_t dev = CANFILTER_DEV_BXCAN_F0);
+
+    canfilter_hardware_t dev; // controller type reported by GET_FILTER
+    bool has_filter = true;   // report GS_CAN_FEATURE_FILTER
+    bool compact = true;      // report GS_CAN_FEATURE_FILTER_COMPACT
+    bool delta = true;        // report GS_CAN_FEATURE_FILTER_DELTA
+    bool hash = true;         // GET_FILTER reports the hash of the stored image
+    uint8_t channels = 1;     // CAN channels, all with the same filter type
+
+    // Injected latency and failures
+    uint32_t latency_us = 0;               // per request; a request slower than its timeout times out
+    uint32_t fail_first = 0;               // fail this many requests, then succeed
+    uint32_t fail_every = 0;               // fail every n-th request, 0 = never
+    int fail_error = LIBUSB_ERROR_TIMEOUT; // error returned by failed requests
+
+    // Kernel driver model
+    bool kernel_driver = true;       // gs_usb driver bound, network interface up
+    bool vendor_needs_claim = false; // requests fail with LIBUSB_ERROR_BUSY until claimed
+    bool claimed = false;            // interface claimed
+    uint32_t link_resets = 0;        // network interface torn down by a driver detach
+
+    // Bus traffic on channel 0
+    uint32_t bus_rate = 0;      // frames per second; standard IDs 0x000 to 0x7FF in turn
+    uint32_t rx_fifo_depth = 3; // passed frames held while no bulk transfer is pending
+    bool started = false;       // channel 0 started by MODE
+
+    // Per channel: filter image stored by the last SET_FILTER, expanded to the full image
+    std::vector<std::vector<uint8_t>> images;
+
+    // Counters
+    uint32_t requests = 0;
+    uint32_t failures = 0;
+    uint32_t filters_set = 0;
+    uint32_t deltas_set = 0;
+    uint32_t bytes_received = 0; // SET_FILTER and SET_FILTER_DELTA data
+    uint32_t frames_sent = 0;    // bulk IN frames
+    uint32_t frames_lost = 0;    // passed frames lost to a full receive FIFO
+
+    bool is_open() const override;
+    bool claim_interface() override;
+    bool kernel_driver_detached() const override;
+    int control_transfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, unsigned char *data,
+                         uint16_t length, unsigned int timeout_ms) override;
+    bool submit_control_transfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                                 unsigned char *data, uint16_t length, unsigned int timeout_ms,
+                                 usb_transfer_done done) override;
+    bool submit_bulk_transfer(uint8_t endpoint, unsigned char *data, int length, unsigned int timeout_ms,
+                              usb_transfer_done done) override;
+    void handle_events(unsigned int timeout_ms) override;
+
+    // Print simulator state
+    void debug_print() const;
+
+  private:
+    struct in_flight {
+        std::chrono::steady_clock::time_point due;
+        int result;
+        usb_transfer_done done;
+    };
+    std::vector<in_flight> in_flight_;
+
+    // Answer a request; delay_us is how long the adapter takes
+    int process(uint8_t request_type, uint8_t request, uint16_t channel, unsigned char *data, uint16_t length,
+                unsigned int timeout_ms, uint64_t &delay_us);
+
+    // Bus model
+    std::chrono::steady_clock::time_point rx_start_; // channel 0 started
+    std::chrono::steady_clock::time_point rx_next_;  // next frame on the bus
+    uint32_t rx_id_ = 0;                             // and its ID
+    std::deque<uint32_t> rx_fifo_;                   // passed frames waiting for a bulk transfer
+    bool rx_overflow_ = false;                       // frames lost since the last frame sent
+    std::vector<bool> rx_pass_;                      // per standard ID: passes the channel 0 filter
+    uint32_t rx_filters_ = 0xFFFFFFFFU;              // filters_set + deltas_set when rx_pass_ was built
+
+    // Next frame for a bulk transfer submitted now; delay_us until it arrives
+    int receive(unsigned char *data, int length, unsigned int timeout_ms, uint64_t &delay_us);
+};
+
+#endif
@@ -4,21 +4,40 @@
 // usb_device
 //
 // Provides a cross-platform abstraction over libusb for enumerating and
-// connecting to USB devices. Handles initialization of the libusb context,
-// device opening by VID/PID or from a list, and safe cleanup on close.
+// connecting to USB devices. Uses one process-wide libusb context, shared by
+// all usb_device objects, and opens devices by VID/PID or from a list.
 //
 // Key features:
+//   • enumerate() – one pass over the bus matching all VID/PID pairs and an
+//     optional serial; serial strings are cached per device
+//   • describe() – identity, serial and path of a single device
+//   • find_path() – device at a topology path, without opening any device
+//   • resolve() – devices by VID/PID and serial; a serial found before is
+//     looked up by topology path in the path cache, opening one device only
+//   • open_device() – open a device found by enumerate()
 //   • open_vid_pid() – open a device using a specific vendor and product ID
+//   • open_path() – open the device at a topology path, e.g. a fixed hub port
 //   • open_from_list() – attempt to open a device from a list of VID/PID pairs
-//   • close() – cleanly release the device handle and libusb context
+//   • close() – cleanly release the device handle
+//   • control_transfer() – usb_transport interface on the open handle
+//   • submit_control_transfer() / handle_events() – asynchronous libusb
+//     transfers on the open handle
+//   • submit_bulk_transfer() – asynchronous bulk IN read into the caller's
+//     buffer, without copying; needs the claimed interface
 //
-// Platform-specific behavior (e.g., detaching the kernel driver on Linux) is
-// managed internally. The class stores opaque pointers to the libusb context
+// Platform-specific behavior (e.g., the kernel driver on Linux) is managed
+// internally. By default a device bound to a kernel driver is opened without
+// detaching the driver or claiming the interface: vendor control requests do
+// not need the interface, and the driver's network interface stays up.
+// claim_interface() detaches the driver and claims the interface when a
+// request needs it. The class stores opaque pointers to the libusb context
 // and device handle, but does not perform any higher-level device-specific
 // operations; derived classes implement protocol-specific logic.
 
+#include "usb_transport.hpp"
 #include <cstdint>
 #include <libusb-1.0/libusb.h>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -33,20 +52,81 @@
     } while (0)
 #endif
 
-class usb_device {
+// Device found by enumerate()
+struct usb_device_info {
+    uint16_t vid = 0;
+    uint16_t pid = 0;
+    uint8_t bus = 0;
+    uint8_t address = 0;
+    std::string path;             // topology "bus-port.port"
+    std::string serial;           // empty unless a serial was requested
+    std::shared_ptr<void> device; // libusb_device*, referenced while held
+};
+
+class usb_device : public usb_transport {
   public:
     usb_device();
-    virtual ~usb_device();
+    ~usb_device() override;
+
+    // Process-wide libusb context, nullptr if libusb_init failed
+    static void *shared_context();
+
+    // One pass over all devices; match any VID/PID in list and, if not empty, serial
+    static bool enumerate(const std::vector<std::pair<uint16_t, uint16_t>> &list, const std::string &serial,
+                          std::vector<usb_device_info> &found);
+
+    // Fill info for a libusb_device*, for instance from a hotplug event; reads the serial from
+    // the device, not from the cache, and updates the cache
+    static bool describe(void *device, usb_device_info &info);
+
+    // Device at topology path "bus-port.port"; no device is opened, serial stays empty
+    static bool find_path(const std::string &path, usb_device_info &info);
+
+    // As enumerate() for one VID/PID, but a serial is first looked up in the path cache.
+    // Serials found by a full enumeration are added to the cache.
+    static bool resolve(uint16_t vid, uint16_t pid, const std::string &serial, std::vector<usb_device_info> &found);
 
+    // Path cache file: serial number to topology path. $CANFILTER_USB_CACHE if set, else, if
+    // path_cache, $XDG_CACHE_HOME or $HOME/.cache, or %LOCALAPPDATA% on Windows; empty if none
+    static std::string path_cache_file();
+
+    // Use the default path cache file; off, only $CANFILTER_USB_CACHE enables the cache
+    static bool path_cache;
+
+    bool open_device(const usb_device_info &info);
     bool open_vid_pid(uint16_t vid, uint16_t pid, const std::string &serial = "");
+    bool open_path(const std::string &path);
     bool open_from_list(const std::vector<std::pair<uint16_t, uint16_t>> &list);
 
     void close();
 
+    // Linux: open without detaching a bound kernel driver; false restores detach on open
+    bool keep_kernel_driver = true;
+
+    // Detach kernel driver and claim interface 0; true if claimed
+    bool claim_interface() override;
+
+    // Kernel driver detached, will be reattached on close()
+    bool kernel_driver_detached() const override;
+
+    bool is_open() const override;
+    int control_transfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, unsigned char *data,
+                         uint16_t length, unsigned int timeout_ms) override;
+    bool submit_control_transfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                                 unsigned char *data, uint16_t length, unsigned int timeout_ms,
+                                 usb_transfer_done done) override;
+    bool submit_bulk_transfer(uint8_t endpoint, unsigned char *data, int length, unsigned int timeout_ms,
+                              usb_transfer_done done) override;
+    void handle_events(unsigned int timeout_ms) override;
+
   protected:
-    void *context_ = nullptr;      // libusb_context*
+    void *context_ = nullptr;      // libusb_context*, shared
     void *handle_ = nullptr;       // libusb_device_handle*
     bool driver_detached_ = false; // Linux only
+    bool claimed_ = false;         // interface 0 claimed
+
+  private:
+    static void LIBUSB_CALL transfer_callback(libusb_transfer *transfer);
 };
 
 #endif
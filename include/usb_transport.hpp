@@ -0,0 +1,113 @@
+#ifndef USB_TRANSPORT_H
+#define USB_TRANSPORT_H
+
+// usb_transport
+//
+// Minimal interface for the USB requests canfilter_usb needs. usb_device
+// implements it on a libusb device handle; gs_usb_sim implements it as an
+// in-process simulated adapter, so the programming path can be tested and
+// benchmarked without hardware.
+//
+// control_transfer() has libusb_control_transfer() semantics: it returns the
+// number of bytes transferred, or a negative LIBUSB_ERROR_* code.
+//
+// Requests are sent without claiming the interface. If a request fails with
+// LIBUSB_ERROR_BUSY, the caller may claim_interface() and resend it.
+//
+// submit_control_transfer() starts the same request without waiting. Its
+// callback receives the same result and is called from handle_events(), on
+// the thread calling handle_events(). Several requests can be in flight at
+// once. The default implementation runs the request synchronously and
+// completes it on the next handle_events().
+//
+// submit_bulk_transfer() reads from a bulk IN endpoint straight into the
+// caller's buffer, completing through handle_events() the same way. The
+// default implementation does not support it.
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Completion callback: bytes transferred or LIBUSB_ERROR_*
+typedef std::function<void(int result)> usb_transfer_done;
+
+class usb_transport {
+  public:
+    usb_transport() = default;
+    virtual ~usb_transport() = default;
+
+    // Copies do not share pending completions
+    usb_transport(const usb_transport &) {}
+    usb_transport &operator=(const usb_transport &) {
+        return *this;
+    }
+
+    // True if requests can be sent
+    virtual bool is_open() const = 0;
+
+    // Claim the interface, taking it from a kernel driver; true if claimed
+    virtual bool claim_interface() {
+        return true;
+    }
+
+    // True if claim_interface() detached a kernel driver
+    virtual bool kernel_driver_detached() const {
+        return false;
+    }
+
+    virtual int control_transfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                                 unsigned char *data, uint16_t length, unsigned int timeout_ms) = 0;
+
+    // Start a request; data must stay valid until done is called. False if not submitted.
+    virtual bool submit_control_transfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                                         unsigned char *data, uint16_t length, unsigned int timeout_ms,
+                                         usb_transfer_done done) {
+        complete(done, control_transfer(request_type, request, value, index, data, length, timeout_ms));
+        return true;
+    }
+
+    // Start a bulk IN read of up to length bytes into data; data must stay valid until done is
+    // called. False if not submitted.
+    virtual bool submit_bulk_transfer(uint8_t endpoint, unsigned char *data, int length, unsigned int timeout_ms,
+                                      usb_transfer_done done) {
+        (void)endpoint;
+        (void)data;
+        (void)length;
+        (void)timeout_ms;
+        (void)done;
+        return false;
+    }
+
+    // Wait up to timeout_ms for submitted requests and call their callbacks
+    virtual void handle_events(unsigned int timeout_ms) {
+        (void)timeout_ms;
+        dispatch();
+    }
+
+  protected:
+    // Queue a completion; thread safe
+    void complete(const usb_transfer_done &done, int result) {
+        std::lock_guard<std::mutex> lock(completed_mutex_);
+        completed_.push_back(std::make_pair(done, result));
+    }
+
+    // Call queued callbacks; returns number called
+    size_t dispatch() {
+        std::vector<std::pair<usb_transfer_done, int>> completed;
+        {
+            std::lock_guard<std::mutex> lock(completed_mutex_);
+            completed.swap(completed_);
+        }
+        for (auto &c : completed)
+            c.first(c.second);
+        return completed.size();
+    }
+
+  private:
+    std::mutex completed_mutex_;
+    std::vector<std::pair<usb_transfer_done, int>> completed_;
+};
+
+#endif
@@ -7,6 +7,8 @@
  * - Parse single CAN IDs or ID ranges from strings or argument vectors.
  * - Distinguish between standard (11-bit) and extended (29-bit) IDs.
  * - Call virtual functions in derived classes to add IDs or ranges to the hardware configuration.
+ * - Check whether a finished filter accepts a given ID.
+ * - Count accepted IDs and print filter usage from the builder statistics.
  *
  * Notes:
  * - No hardware-specific logic; this is purely parsing and classification.
@@ -14,12 +16,15 @@
  */
 
 #include "canfilter.hpp"
+#include <algorithm>
 #include <cctype>
 #include <cerrno>
 #include <cstdint>
 #include <cstdlib>
+#include <iostream>
 
 bool canfilter::parse(const std::string &input) {
+    error = CANFILTER_SUCCESS;
     if (input.empty()) {
         return true;
     }
@@ -42,6 +47,7 @@ bool canfilter::parse(const std::string &input) {
         uint32_t id1 = strtoul(start, &end, 0);
 
         if (end == start || errno == ERANGE) {
+            error = CANFILTER_ERROR_PARAM;
             return false;
         }
 
@@ -67,27 +73,30 @@ bool canfilter::parse(const std::string &input) {
             uint32_t id2 = strtoul(start, &end, 0);
 
             if (end == start || errno == ERANGE) {
+                error = CANFILTER_ERROR_PARAM;
                 return false;
             }
 
             pos += (end - start);
 
             if (id1 <= max_std_id && id2 <= max_std_id) {
-                add_std_range(id1, id2);
+                error = add_std_range(id1, id2);
             } else if (id1 <= max_ext_id && id2 <= max_ext_id) {
-                add_ext_range(id1, id2);
+                error = add_ext_range(id1, id2);
             } else {
-                return false;
+                error = CANFILTER_ERROR_PARAM;
             }
         } else {
             if (id1 <= max_std_id) {
-                add_std_id(id1);
+                error = add_std_id(id1);
             } else if (id1 <= max_ext_id) {
-                add_ext_id(id1);
+                error = add_ext_id(id1);
             } else {
-                return false;
+                error = CANFILTER_ERROR_PARAM;
             }
         }
+        if (error != CANFILTER_SUCCESS)
+            return false;
 
         // Skip whitespace or comma after ID/range
         while (pos < len && (std::isspace(input[pos]) || (input[pos] == ','))) {
@@ -106,3 +115,86 @@ bool canfilter::parse(const std::vector<std::string> &args) {
     }
     return true;
 }
+
+bool canfilter::accepts(uint32_t id, bool ext) const {
+    std::vector<canfilter_range> ranges;
+    get_ranges(ranges);
+    for (const auto &r : ranges) {
+        if (r.ext == ext && id >= r.begin && id <= r.end)
+            return true;
+    }
+    return false;
+}
+
+void canfilter::count_ids(canfilter_stats &stats) const {
+    std::vector<canfilter_range> ranges;
+    get_ranges(ranges);
+    std::sort(ranges.begin(), ranges.end(), [](const canfilter_range &a, const canfilter_range &b) {
+        return a.ext != b.ext ? b.ext : a.begin < b.begin;
+    });
+
+    // sum range sizes, counting overlapping ranges once
+    stats.std_ids = 0;
+    stats.ext_ids = 0;
+    uint32_t next = 0; // first id not yet counted
+    bool ext = false;
+    for (const auto &r : ranges) {
+        if (r.ext != ext) {
+            ext = r.ext;
+            next = 0;
+        }
+        uint32_t begin = std::max(r.begin, next);
+        if (r.end < begin)
+            continue;
+        uint32_t count = r.end - begin + 1;
+        if (ext)
+            stats.ext_ids += count;
+        else
+            stats.std_ids += count;
+        next = r.end + 1;
+    }
+}
+
+void canfilter::print_usage() const {
+    canfilter_stats stats;
+    get_stats(stats);
+
+    if (stats.banks_total) {
+        uint32_t percent = (stats.banks_used * 100 + stats.banks_total / 2) / stats.banks_total;
+        std::cout << "Filter usage: " << stats.banks_used << "/" << stats.banks_total << " (" << percent << "%)"
+                  << std::endl;
+    } else {
+        uint32_t std_percent = stats.std_total ? (stats.std_used * 100 + stats.std_total / 2) / stats.std_total : 0;
+        uint32_t ext_percent = stats.ext_total ? (stats.ext_used * 100 + stats.ext_total / 2) / stats.ext_total : 0;
+        std::cout << "Filter usage: " << stats.std_used << "/" << stats.std_total << " standard (" << std_percent
+                  << "%), " << stats.ext_used << "/" << stats.ext_total << " extended (" << ext_percent << "%)"
+                  << std::endl;
+    }
+}
+
+void canfilter::get_hw_config_compact(std::vector<uint8_t> &image) {
+    const uint8_t *p = (const uint8_t *)get_hw_config();
+    if (p)
+        image.assign(p, p + get_hw_size());
+    else
+        image.clear();
+}
+
+bool canfilter::set_hw_config_compact(const uint8_t *image, size_t size) {
+    (void)image;
+    (void)size;
+    return false;
+}
+
+bool canfilter::get_hw_config_delta(std::vector<uint8_t> &delta) {
+    delta.clear();
+    return false;
+}
+
+void canfilter::reset_delta() {}
+
+bool canfilter::apply_hw_config_delta(const uint8_t *delta, size_t size) {
+    (void)delta;
+    (void)size;
+    return false;
+}
@@ -0,0 +1,230 @@
+/*
+ * canfilter_adaptive.cpp
+ *
+ * Implements the adaptive filter daemon.
+ *
+ * Responsibilities:
+ * - Keep per-ID frame counts in a ring of 1 s buckets.
+ * - Detect unwanted IDs that become chatty, split the specification again
+ *   with the observed rates and reprogram the adapter through canfilter_usb.
+ * - Read frames from a CAN_RAW socket on Linux.
+ *
+ * Notes:
+ * - Only frames that pass the hardware filter are seen. Once an ID is
+ *   blocked its rate decays to zero, so the peak rate of a chatty ID is
+ *   remembered and used in every later split: the filter does not flip
+ *   back and forth between letting the ID through and blocking it.
+ * - A new split can let through IDs the current filter blocks. Chatty IDs
+ *   among them count at their peak rate when the new split is weighed
+ *   against the current one; the rate of the others is unknown and counted
+ *   as zero.
+ */
+
+#include "canfilter_adaptive.hpp"
+#include "canfilter_socketcan.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/can.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+static bool is_ext(uint32_t can_id) {
+    return can_id & canfilter_classifier::eff_flag;
+}
+
+static uint32_t id_bits(uint32_t can_id) {
+    return can_id & (is_ext(can_id) ? canfilter::max_ext_id : canfilter::max_std_id);
+}
+
+canfilter_adaptive::canfilter_adaptive(const canfilter_ranges &spec, canfilter_hardware_t dev, canfilter_usb &usb)
+    : spec_(spec), dev_(dev), usb_(usb), running_(false) {
+    spec_.compile(wanted_);
+}
+
+bool canfilter_adaptive::start() {
+    counts_.clear();
+    chatty_.clear();
+    bucket_ = seconds_ = last_program_ = 0;
+
+    canfilter_hybrid first;
+    if (first.split(spec_, dev_) != CANFILTER_SUCCESS)
+        return false;
+    if (verbose)
+        first.print(std::cerr);
+    if (!program(first))
+        return false;
+    return true;
+}
+
+void canfilter_adaptive::observe(uint32_t can_id) {
+    if (can_id & CANFILTER_CAN_ERR_FLAG)
+        return;
+    uint32_t key = (can_id & canfilter_classifier::eff_flag) | id_bits(can_id);
+    std::vector<uint32_t> &counts = counts_[key];
+    if (counts.size() != window_s)
+        counts.assign(window_s, 0);
+    counts[bucket_]++;
+}
+
+double canfilter_adaptive::rate(uint32_t can_id) const {
+    auto it = counts_.find(can_id);
+    if (it == counts_.end())
+        return 0;
+    uint32_t frames = 0;
+    for (uint32_t count : it->second)
+        frames += count;
+    uint32_t span = std::max(1U, std::min(seconds_, window_s));
+    return (double)frames / span;
+}
+
+double canfilter_adaptive::unwanted_rate() const {
+    return unwanted_rate(hardware_);
+}
+
+double canfilter_adaptive::unwanted_rate(const canfilter_classifier &hardware) const {
+    double total = 0;
+    for (const auto &c : counts_)
+        if (hardware.match(c.first) && !wanted_.match(c.first))
+            total += rate(c.first);
+
+    // chatty IDs the current hardware blocks: their frames no longer arrive, so count the
+    // part of the peak rate missing above if hardware would let them through again
+    for (const auto &c : chatty_)
+        if (hardware.match(c.first) && !hardware_.match(c.first))
+            total += std::max(0.0, c.second - rate(c.first));
+    return total;
+}
+
+bool canfilter_adaptive::tick() {
+    seconds_++;
+
+    // new chatty IDs; an ID is forgotten only if it still passes the hardware and has calmed down
+    bool trigger = false;
+    for (const auto &c : counts_) {
+        if (wanted_.match(c.first))
+            continue;
+        double r = rate(c.first);
+        auto it = chatty_.find(c.first);
+        if (r >= chatty_rate && it == chatty_.end())
+            trigger = true;
+        else if (it != chatty_.end() && r < chatty_rate / 2 && hardware_.match(c.first))
+            chatty_.erase(it);
+    }
+
+    bool success = true;
+    if (trigger && seconds_ - last_program_ >= hold_s) {
+        last_program_ = seconds_;
+
+        // observed rates, and the peak rates of chatty IDs the hardware blocks
+        std::map<uint32_t, double> rates;
+        for (const auto &c : counts_)
+            rates[c.first] = rate(c.first);
+        for (const auto &c : counts_)
+            if (!wanted_.match(c.first) && rates[c.first] >= chatty_rate)
+                chatty_[c.first] = std::max(chatty_[c.first], rates[c.first]);
+        for (const auto &c : chatty_)
+            rates[c.first] = std::max(rates[c.first], c.second);
+
+        std::vector<canfilter_id_rate> id_rates;
+        for (const auto &r : rates)
+            id_rates.push_back({id_bits(r.first), is_ext(r.first), r.second});
+
+        canfilter_hybrid next;
+        canfilter_classifier next_hardware;
+        success = (next.split(spec_, dev_, id_rates) == CANFILTER_SUCCESS) &&
+                  (next.hardware.compile(next_hardware) == CANFILTER_SUCCESS);
+
+        double before = unwanted_rate(hardware_);
+        double after = unwanted_rate(next_hardware);
+        if (!success) {
+            std::cerr << "adaptive: could not split filter" << std::endl;
+        } else if (after > before * (1 - min_gain)) {
+            kept++;
+            if (verbose)
+                std::cerr << "adaptive: unwanted " << before << " frames/s, new filter " << after
+                          << " frames/s, filter kept" << std::endl;
+        } else {
+            if (verbose)
+                std::cerr << "adaptive: unwanted " << before << " frames/s, new filter " << after
+                          << " frames/s, reprogramming" << std::endl;
+            success = program(next);
+            if (success)
+                reprogrammed++;
+        }
+    }
+
+    // oldest bucket becomes the current one
+    bucket_ = (bucket_ + 1) % window_s;
+    for (auto it = counts_.begin(); it != counts_.end();) {
+        it->second[bucket_] = 0;
+        if (std::all_of(it->second.begin(), it->second.end(), [](uint32_t count) { return count == 0; }))
+            it = counts_.erase(it);
+        else
+            ++it;
+    }
+
+    return success;
+}
+
+bool canfilter_adaptive::program(const canfilter_hybrid &next) {
+    canfilter_image image;
+    if (canfilter_compile(dev_, next.hardware, image) != CANFILTER_SUCCESS || !usb_.programImage(image)) {
+        std::cerr << "adaptive: programming failed" << std::endl;
+        return false;
+    }
+    split = next;
+    hardware_ = canfilter_classifier();
+    split.hardware.compile(hardware_);
+    return true;
+}
+
+void canfilter_adaptive::stop() {
+    running_ = false;
+}
+
+#ifdef __linux__
+bool canfilter_adaptive::run(const std::string &ifname) {
+    int fd = canfilter_socketcan::open_socket(ifname);
+    if (fd < 0)
+        return false;
+
+    // wake up to advance the clock when the bus is quiet
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    bool success = true;
+    running_ = true;
+    auto next_tick = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (running_) {
+        struct can_frame frame;
+        ssize_t n = read(fd, &frame, sizeof(frame));
+        if (n == sizeof(frame)) {
+            observe(frame.can_id);
+        } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            success = false;
+            break;
+        }
+
+        while (std::chrono::steady_clock::now() >= next_tick) {
+            tick();
+            next_tick += std::chrono::seconds(1);
+        }
+    }
+
+    canfilter_socketcan::close_socket(fd);
+    return success;
+}
+#else
+bool canfilter_adaptive::run(const std::string &ifname) {
+    (void)ifname;
+    return false;
+}
+#endif
@@ -0,0 +1,241 @@
+/*
+ * canfilter_batch.cpp
+ *
+ * Implements the batch command mode.
+ *
+ * Responsibilities:
+ * - Parse command lines and edit the controller-independent specification.
+ * - Compile into one persistent builder and program the adapter through the
+ *   canfilter_usb opened once.
+ * - Answer every command with one line on the output stream.
+ *
+ * Notes:
+ * - The builder is the delta base: get_hw_config_delta() is only called
+ *   after a successful compile, so a specification that does not fit leaves
+ *   the base at the image the adapter holds. A failed upload resets it and
+ *   the next program sends the full image.
+ * - Without delta support programImage() compares image hashes, so
+ *   programming what the adapter already holds costs no transfer.
+ * - Extended ranges are told from standard ones by their IDs, as on the
+ *   command line: IDs above 0x7FF are extended.
+ * - The initial IDs and set compile in command line order, as a plain run
+ *   does, so both program the same image. add and remove compile the
+ *   normalized ranges.
+ */
+
+#include "canfilter_batch.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// hex formatting macro
+#define FORMAT_HEX(val, width)                                                                                         \
+    "0x" << std::hex << std::setw(width) << std::setfill('0') << (val) << std::dec << std::setfill(' ')
+
+static bool same(const std::vector<canfilter_range> &a, const std::vector<canfilter_range> &b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](const canfilter_range &x, const canfilter_range &y) {
+               return x.begin == y.begin && x.end == y.end && x.ext == y.ext;
+           });
+}
+
+static const char *error_text(canfilter_error_t err) {
+    switch (err) {
+        case CANFILTER_ERROR_PARAM:
+            return "invalid id or range";
+        case CANFILTER_ERROR_FULL:
+            return "does not fit";
+        default:
+            return "failed";
+    }
+}
+
+canfilter_batch::canfilter_batch(canfilter_usb &usb) : usb_(usb) {}
+
+bool canfilter_batch::start(const canfilter_ranges &spec) {
+    spec_ = spec;
+    spec_.end();
+    compiled_ = programmed_ = quit_ = false;
+
+    if (!dry_run) {
+        if (!usb_.hasHardwareFilter()) {
+            std::cerr << "error: no hardware filter" << std::endl;
+            return false;
+        }
+        uint32_t filter_type = usb_.getFilterInfo();
+        if (dev == CANFILTER_DEV_NONE)
+            dev = (canfilter_hardware_t)filter_type;
+    }
+
+    filter_.reset(canfilter_create(dev));
+    if (!filter_) {
+        std::cerr << "error: invalid filter type" << std::endl;
+        return false;
+    }
+
+    if (verbose)
+        std::cerr << "waiting for commands, " << canfilter_device_name(dev)
+                  << ((usb_.features & GS_CAN_FEATURE_FILTER_DELTA) ? ", delta" : "") << std::endl;
+    return true;
+}
+
+void canfilter_batch::update(canfilter_ranges &next) {
+    next.end();
+    if (same(next.ranges, spec_.ranges))
+        return;
+    spec_ = next;
+    compiled_ = false;
+}
+
+canfilter_error_t canfilter_batch::compile() {
+    if (compiled_)
+        return CANFILTER_SUCCESS;
+    canfilter_error_t err = spec_.compile(*filter_);
+    compiled_ = (err == CANFILTER_SUCCESS);
+    return err;
+}
+
+bool canfilter_batch::program(std::ostream &out) {
+    if (programmed_ && same(spec_.ranges, programmed_ranges_)) {
+        out << "ok unchanged" << std::endl;
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    canfilter_error_t err = compile();
+    if (err != CANFILTER_SUCCESS) {
+        out << "error: " << error_text(err) << std::endl;
+        return false;
+    }
+
+    bool success = true;
+    bool unchanged = false;
+    const char *kind = "programmed";
+    size_t bytes = 0;
+    std::vector<uint8_t> delta;
+    if (dry_run) {
+        kind = "compiled";
+        bytes = filter_->get_hw_size();
+    } else if ((usb_.features & GS_CAN_FEATURE_FILTER_DELTA) && filter_->get_hw_config_delta(delta)) {
+        kind = "delta";
+        bytes = delta.size();
+        success = usb_.programDelta(delta);
+    } else {
+        canfilter_image image;
+        image.dev = dev;
+        filter_->get_stats(image.stats);
+        const uint8_t *p = (const uint8_t *)filter_->get_hw_config();
+        image.data.assign(p, p + filter_->get_hw_size());
+        filter_->get_hw_config_compact(image.compact);
+        image.hash = canfilter_image_hash(image.data.data(), image.data.size());
+        success = usb_.programImage(image);
+        unchanged = usb_.unchanged;
+        bool compact = (usb_.features & GS_CAN_FEATURE_FILTER_COMPACT) && !image.compact.empty();
+        bytes = compact ? image.compact.size() : image.data.size();
+    }
+
+    programmed_ = success;
+    programmed_ranges_ = spec_.ranges;
+    if (!success) {
+        filter_->reset_delta();
+        out << "error: transfer failed" << std::endl;
+        return false;
+    }
+
+    double ms =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() /
+        1000000.0;
+    if (unchanged) {
+        out << "ok unchanged " << ms << " ms" << std::endl;
+    } else {
+        if (!dry_run)
+            programmed++;
+        out << "ok " << kind << " " << bytes << " bytes " << ms << " ms" << std::endl;
+    }
+    return true;
+}
+
+bool canfilter_batch::command(const std::string &line, std::ostream &out) {
+    std::istringstream words(line);
+    std::string cmd;
+    if (!(words >> cmd) || cmd[0] == '#')
+        return true;
+    commands++;
+
+    std::vector<std::string> args;
+    std::string word;
+    while (words >> word)
+        args.push_back(word);
+
+    bool success = true;
+    if (cmd == "set" || cmd == "add" || cmd == "remove") {
+        canfilter_ranges ids;
+        ids.begin();
+        if (!ids.parse(args)) {
+            out << "error: " << error_text(ids.error) << std::endl;
+            success = false;
+        } else {
+            ids.end();
+            canfilter_ranges next;
+            if (cmd == "set") {
+                next = ids;
+            } else if (cmd == "add") {
+                next = spec_;
+                next.ranges.insert(next.ranges.end(), ids.ranges.begin(), ids.ranges.end());
+                next.clear_replay();
+            } else {
+                next = spec_;
+                next.subtract(ids);
+            }
+            update(next);
+            out << "ok " << spec_.ranges.size() << " ranges" << std::endl;
+        }
+    } else if (cmd == "clear") {
+        canfilter_ranges next;
+        next.begin();
+        update(next);
+        out << "ok 0 ranges" << std::endl;
+    } else if (cmd == "show") {
+        out << "ok";
+        for (const auto &r : spec_.ranges) {
+            int width = r.ext ? 8 : 3;
+            out << " " << FORMAT_HEX(r.begin, width);
+            if (r.end != r.begin)
+                out << "-" << FORMAT_HEX(r.end, width);
+        }
+        out << std::endl;
+    } else if (cmd == "program") {
+        success = program(out);
+    } else if (cmd == "stats") {
+        canfilter_error_t err = compile();
+        if (err != CANFILTER_SUCCESS) {
+            out << "error: " << error_text(err) << std::endl;
+            success = false;
+        } else {
+            canfilter_stats stats;
+            filter_->get_stats(stats);
+            out << "ok ";
+            canfilter_print_stats_json(out, stats);
+        }
+    } else if (cmd == "quit") {
+        quit_ = true;
+        out << "ok" << std::endl;
+    } else {
+        out << "error: unknown command " << cmd << std::endl;
+        success = false;
+    }
+
+    if (!success)
+        failed++;
+    return success;
+}
+
+bool canfilter_batch::run(std::istream &in, std::ostream &out) {
+    std::string line;
+    while (!quit_ && std::getline(in, line))
+        command(line, out);
+    return failed == 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * canfilter_bench.cpp
+ *
+ * Implements the USB programming latency benchmark.
+ *
+ * Responsibilities:
+ * - Open, query and program an adapter repeatedly.
+ * - Collect stage durations through the trace callback.
+ * - Print p50, p99 and max latency per stage.
+ *
+ * Notes:
+ * - Every round uses a new canfilter_usb, so open includes libusb
+ *   enumeration and the kernel driver handling of a real run.
+ * - The image is compiled once per controller type, outside the timed stages.
+ * - Uploads are forced: an adapter that already holds the image is still
+ *   programmed, or every round after the first would skip the transfer.
+ */
+
+#include "canfilter_bench.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+bool canfilter_bench::run(uint32_t n, const open_fn &open, const canfilter_ranges &spec, canfilter_hardware_t dev) {
+    for (uint32_t i = 0; i < n; i++) {
+        rounds++;
+        if (!round(open, spec, dev))
+            failed_rounds++;
+    }
+
+    for (auto &stage : stages_)
+        std::sort(stage.duration_us.begin(), stage.duration_us.end());
+
+    return failed_rounds == 0;
+}
+
+bool canfilter_bench::round(const open_fn &open, const canfilter_ranges &spec, canfilter_hardware_t dev) {
+    canfilter_usb usb;
+    usb.trace = this;
+    usb.timeout_ms = timeout_ms;
+    usb.retries = retries;
+    usb.keep_kernel_driver = keep_kernel_driver;
+    usb.skip_unchanged = false;
+
+    if (!open(usb))
+        return false;
+
+    if (!usb.hasHardwareFilter())
+        return false;
+    uint32_t filter_type = usb.getFilterInfo();
+    if (dev == CANFILTER_DEV_NONE)
+        dev = (canfilter_hardware_t)filter_type;
+
+    auto it = images_.find(dev);
+    if (it == images_.end()) {
+        it = images_.insert(std::make_pair((int)dev, canfilter_image())).first;
+        canfilter_compile(dev, spec, it->second);
+    }
+    if (it->second.error != CANFILTER_SUCCESS)
+        return false;
+
+    return usb.programImage(it->second);
+}
+
+void canfilter_bench::stage_done(const canfilter_trace_event &event) {
+    if (event.stage >= CANFILTER_STAGE_COUNT)
+        return;
+    samples &stage = stages_[event.stage];
+    stage.duration_us.push_back(event.duration_us);
+    if (!event.success)
+        stage.failed++;
+}
+
+uint64_t canfilter_bench::percentile(canfilter_stage_t stage, double p) const {
+    const std::vector<uint64_t> &d = stages_[stage].duration_us;
+    if (d.empty())
+        return 0;
+    size_t rank = (size_t)std::ceil(p / 100.0 * d.size());
+    if (rank < 1)
+        rank = 1;
+    return d[std::min(rank, d.size()) - 1];
+}
+
+void canfilter_bench::print(std::ostream &out) const {
+    out << rounds << " rounds, " << failed_rounds << " failed\n";
+    out << std::left << std::setw(10) << "stage" << std::right << std::setw(8) << "count" << std::setw(8) << "failed"
+        << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::setw(12) << "max us" << "\n";
+    for (int s = CANFILTER_STAGE_OPEN; s < CANFILTER_STAGE_COUNT; s++) {
+        canfilter_stage_t stage = (canfilter_stage_t)s;
+        const samples &st = stages_[s];
+        out << std::left << std::setw(10) << canfilter_stage_name(stage) << std::right << std::setw(8)
+            << st.duration_us.size() << std::setw(8) << st.failed << std::setw(12) << percentile(stage, 50)
+            << std::setw(12) << percentile(stage, 99) << std::setw(12) << percentile(stage, 100) << "\n";
+    }
+    out.flush();
+}
+
+void canfilter_bench::print_json(std::ostream &out) const {
+    out << "{\"rounds\":" << rounds << ",\"failed\":" << failed_rounds << ",\"stages\":{";
+    for (int s = CANFILTER_STAGE_OPEN; s < CANFILTER_STAGE_COUNT; s++) {
+        canfilter_stage_t stage = (canfilter_stage_t)s;
+        const samples &st = stages_[s];
+        if (s != CANFILTER_STAGE_OPEN)
+            out << ",";
+        out << "\"" << canfilter_stage_name(stage) << "\":{\"count\":" << st.duration_us.size()
+            << ",\"failed\":" << st.failed << ",\"p50_us\":" << percentile(stage, 50)
+            << ",\"p99_us\":" << percentile(stage, 99) << ",\"max_us\":" << percentile(stage, 100) << "}";
+    }
+    out << "}}" << std::endl;
+}
@@ -0,0 +1,460 @@
+/*
+ * canfilter_bpf.cpp
+ *
+ * Implements the classic BPF compiler for CAN_RAW sockets.
+ *
+ * Responsibilities:
+ * - Merge ranges and compile them into a binary search over can_id.
+ * - Interpret the emitted instructions, to check and measure programs.
+ * - Attach programs to CAN_RAW sockets and benchmark them on Linux.
+ *
+ * Notes:
+ * - A socket filter sees the struct can_frame. BPF word loads are big
+ *   endian, can_id is in host order: on little endian hosts can_id is
+ *   assembled from its four bytes.
+ * - Program layout: load can_id; accept error frames; branch on
+ *   CAN_EFF_FLAG; mask the ID bits, which also drops CAN_RTR_FLAG; search
+ *   the standard or extended ranges.
+ * - Search node: "A >= begin of the middle range". The left subtree follows
+ *   the node; the right subtree is reached by jt, or by a JA if the left
+ *   subtree is longer than a jump offset (255).
+ * - Leaves return 0xFFFFFFFF (keep the frame) or 0 (drop it).
+ */
+
+#include "canfilter_bpf.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <ctime>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/filter.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static_assert(sizeof(struct sock_filter) == sizeof(canfilter_bpf_insn), "sock_filter layout");
+static_assert(BPF_LD == CANFILTER_BPF_LD && BPF_ALU == CANFILTER_BPF_ALU && BPF_JMP == CANFILTER_BPF_JMP &&
+                  BPF_RET == CANFILTER_BPF_RET && BPF_MISC == CANFILTER_BPF_MISC,
+              "BPF classes");
+static_assert(BPF_B == CANFILTER_BPF_B && BPF_ABS == CANFILTER_BPF_ABS && BPF_JSET == CANFILTER_BPF_JSET &&
+                  BPF_X == CANFILTER_BPF_X && BPF_LSH == CANFILTER_BPF_LSH,
+              "BPF opcodes");
+static_assert(CAN_ERR_FLAG == CANFILTER_CAN_ERR_FLAG, "CAN_ERR_FLAG");
+#endif
+
+// hex formatting macro
+#define FORMAT_HEX(val, width)                                                                                         \
+    "0x" << std::hex << std::setw(width) << std::setfill('0') << (val) << std::dec << std::setfill(' ')
+
+static const uint32_t accept_frame = 0xFFFFFFFF;
+static const uint32_t max_jump = 255;
+
+static canfilter_bpf_insn insn(uint16_t code, uint32_t k, uint8_t jt = 0, uint8_t jf = 0) {
+    canfilter_bpf_insn i;
+    i.code = code;
+    i.jt = jt;
+    i.jf = jf;
+    i.k = k;
+    return i;
+}
+
+static bool host_little_endian() {
+    uint16_t one = 1;
+    return *(const uint8_t *)&one == 1;
+}
+
+// Search tree over ranges[lo, hi). lower_known: A >= ranges[lo].begin is already known.
+static std::vector<canfilter_bpf_insn> search_tree(const std::vector<canfilter_range> &ranges, size_t lo, size_t hi,
+                                                   bool lower_known, uint32_t max_id) {
+    const uint16_t jeq = CANFILTER_BPF_JMP | CANFILTER_BPF_JEQ | CANFILTER_BPF_K;
+    const uint16_t jgt = CANFILTER_BPF_JMP | CANFILTER_BPF_JGT | CANFILTER_BPF_K;
+    const uint16_t jge = CANFILTER_BPF_JMP | CANFILTER_BPF_JGE | CANFILTER_BPF_K;
+    const uint16_t ret = CANFILTER_BPF_RET | CANFILTER_BPF_K;
+    std::vector<canfilter_bpf_insn> code;
+
+    if (lo == hi) {
+        code.push_back(insn(ret, 0));
+        return code;
+    }
+
+    // leaf: one range
+    if (hi - lo == 1) {
+        const canfilter_range &r = ranges[lo];
+        lower_known = lower_known || r.begin == 0;
+        bool check_upper = (r.end != max_id);
+        if (!lower_known && r.begin == r.end) {
+            code.push_back(insn(jeq, r.begin, 0, 1));
+        } else {
+            if (!lower_known)
+                code.push_back(insn(jge, r.begin, 0, check_upper ? 2 : 1));
+            if (check_upper)
+                code.push_back(insn(jgt, r.end, 1, 0));
+        }
+        code.push_back(insn(ret, accept_frame));
+        if (code.size() > 1)
+            code.push_back(insn(ret, 0));
+        return code;
+    }
+
+    size_t mid = (lo + hi) / 2;
+    std::vector<canfilter_bpf_insn> left = search_tree(ranges, lo, mid, lower_known, max_id);
+    std::vector<canfilter_bpf_insn> right = search_tree(ranges, mid, hi, true, max_id);
+    if (left.size() <= max_jump) {
+        code.push_back(insn(jge, ranges[mid].begin, left.size(), 0));
+    } else {
+        code.push_back(insn(jge, ranges[mid].begin, 0, 1));
+        code.push_back(insn(CANFILTER_BPF_JMP | CANFILTER_BPF_JA, left.size()));
+    }
+    code.insert(code.end(), left.begin(), left.end());
+    code.insert(code.end(), right.begin(), right.end());
+    return code;
+}
+
+void canfilter_bpf::emit(uint16_t code, uint32_t k, uint8_t jt, uint8_t jf) {
+    program.push_back(insn(code, k, jt, jf));
+}
+
+canfilter_error_t canfilter_bpf::begin() {
+    program.clear();
+    blocks = 0;
+    return ranges_.begin();
+}
+
+canfilter_error_t canfilter_bpf::add_std_id(uint32_t id) {
+    return ranges_.add_std_id(id);
+}
+
+canfilter_error_t canfilter_bpf::add_ext_id(uint32_t id) {
+    return ranges_.add_ext_id(id);
+}
+
+canfilter_error_t canfilter_bpf::add_std_range(uint32_t begin, uint32_t end) {
+    return ranges_.add_std_range(begin, end);
+}
+
+canfilter_error_t canfilter_bpf::add_ext_range(uint32_t begin, uint32_t end) {
+    return ranges_.add_ext_range(begin, end);
+}
+
+canfilter_error_t canfilter_bpf::end() {
+    ranges_.normalize(true);
+
+    std::vector<canfilter_range> std_ranges, ext_ranges;
+    for (const auto &r : ranges_.ranges)
+        (r.ext ? ext_ranges : std_ranges).push_back(r);
+    blocks = ranges_.ranges.size();
+
+    // A = can_id, in host byte order
+    program.clear();
+    if (host_little_endian()) {
+        emit(CANFILTER_BPF_LD | CANFILTER_BPF_B | CANFILTER_BPF_ABS, 3);
+        emit(CANFILTER_BPF_ALU | CANFILTER_BPF_LSH | CANFILTER_BPF_K, 24);
+        for (uint32_t byte = 2; byte != (uint32_t)-1; byte--) {
+            emit(CANFILTER_BPF_MISC | CANFILTER_BPF_TAX, 0);
+            emit(CANFILTER_BPF_LD | CANFILTER_BPF_B | CANFILTER_BPF_ABS, byte);
+            if (byte)
+                emit(CANFILTER_BPF_ALU | CANFILTER_BPF_LSH | CANFILTER_BPF_K, 8 * byte);
+            emit(CANFILTER_BPF_ALU | CANFILTER_BPF_OR | CANFILTER_BPF_X, 0);
+        }
+    } else {
+        emit(CANFILTER_BPF_LD | CANFILTER_BPF_W | CANFILTER_BPF_ABS, 0);
+    }
+
+    // error frames only arrive if the socket asked for them
+    emit(CANFILTER_BPF_JMP | CANFILTER_BPF_JSET | CANFILTER_BPF_K, CANFILTER_CAN_ERR_FLAG, 0, 1);
+    emit(CANFILTER_BPF_RET | CANFILTER_BPF_K, accept_frame);
+
+    std::vector<canfilter_bpf_insn> std_tree = search_tree(std_ranges, 0, std_ranges.size(), false, max_std_id);
+    std::vector<canfilter_bpf_insn> ext_tree = search_tree(ext_ranges, 0, ext_ranges.size(), false, max_ext_id);
+
+    // standard frames fall through, extended frames jump over the standard tree
+    if (std_tree.size() + 1 <= max_jump) {
+        emit(CANFILTER_BPF_JMP | CANFILTER_BPF_JSET | CANFILTER_BPF_K, CANFILTER_CAN_EFF_FLAG, std_tree.size() + 1, 0);
+    } else {
+        emit(CANFILTER_BPF_JMP | CANFILTER_BPF_JSET | CANFILTER_BPF_K, CANFILTER_CAN_EFF_FLAG, 0, 1);
+        emit(CANFILTER_BPF_JMP | CANFILTER_BPF_JA, std_tree.size() + 1);
+    }
+    emit(CANFILTER_BPF_ALU | CANFILTER_BPF_AND | CANFILTER_BPF_K, max_std_id);
+    program.insert(program.end(), std_tree.begin(), std_tree.end());
+    emit(CANFILTER_BPF_ALU | CANFILTER_BPF_AND | CANFILTER_BPF_K, max_ext_id);
+    program.insert(program.end(), ext_tree.begin(), ext_tree.end());
+
+    if (verbose)
+        std::cout << "bpf " << std_ranges.size() << " std ranges, " << ext_ranges.size() << " ext ranges, "
+                  << program.size() << " instructions" << std::endl;
+
+    if (program.size() > max_insns)
+        return CANFILTER_ERROR_FULL;
+    return CANFILTER_SUCCESS;
+}
+
+void *canfilter_bpf::get_hw_config() {
+    return program.data();
+}
+
+size_t canfilter_bpf::get_hw_size() {
+    return program.size() * sizeof(canfilter_bpf_insn);
+}
+
+void canfilter_bpf::debug_print_reg() const {
+    for (size_t i = 0; i < program.size(); i++)
+        std::cout << std::setw(4) << i << ": code " << FORMAT_HEX(program[i].code, 2) << " jt " << std::setw(3)
+                  << (int)program[i].jt << " jf " << std::setw(3) << (int)program[i].jf << " k "
+                  << FORMAT_HEX(program[i].k, 8) << std::endl;
+}
+
+void canfilter_bpf::debug_print() const {
+    std::cout << std::endl << "bpf ranges:" << std::endl;
+    for (const auto &r : ranges_.ranges) {
+        int width = r.ext ? 8 : 3;
+        std::cout << (r.ext ? "ext " : "std ") << FORMAT_HEX(r.begin, width);
+        if (r.end != r.begin)
+            std::cout << " - " << FORMAT_HEX(r.end, width);
+        std::cout << std::endl;
+    }
+}
+
+void canfilter_bpf::get_ranges(std::vector<canfilter_range> &ranges) const {
+    ranges = ranges_.ranges;
+}
+
+void canfilter_bpf::get_stats(canfilter_stats &stats) const {
+    stats = canfilter_stats();
+    stats.banks_used = program.size();
+    stats.banks_total = max_insns;
+    for (const auto &r : ranges_.ranges) {
+        if (r.ext)
+            (r.begin == r.end ? stats.ext_list : stats.ext_mask)++;
+        else
+            (r.begin == r.end ? stats.std_list : stats.std_mask)++;
+    }
+    count_ids(stats);
+}
+
+uint32_t canfilter_bpf::run(const uint8_t *frame, size_t size, uint32_t *steps) const {
+    uint32_t a = 0, x = 0;
+    if (steps)
+        *steps = 0;
+
+    for (size_t pc = 0; pc < program.size(); pc++) {
+        const canfilter_bpf_insn &i = program[pc];
+        if (steps)
+            (*steps)++;
+        uint32_t operand = (i.code & CANFILTER_BPF_X) ? x : i.k;
+
+        switch (i.code & 0x07) {
+            case CANFILTER_BPF_LD:
+                if ((i.code & 0x18) == CANFILTER_BPF_B) {
+                    if (i.k >= size)
+                        return 0;
+                    a = frame[i.k];
+                } else {
+                    if (i.k + 4 > size)
+                        return 0;
+                    a = (uint32_t)frame[i.k] << 24 | (uint32_t)frame[i.k + 1] << 16 | (uint32_t)frame[i.k + 2] << 8 |
+                        frame[i.k + 3];
+                }
+                break;
+            case CANFILTER_BPF_ALU:
+                switch (i.code & 0xF0) {
+                    case CANFILTER_BPF_OR:
+                        a |= operand;
+                        break;
+                    case CANFILTER_BPF_AND:
+                        a &= operand;
+                        break;
+                    case CANFILTER_BPF_LSH:
+                        a <<= operand;
+                        break;
+                    default:
+                        return 0;
+                }
+                break;
+            case CANFILTER_BPF_JMP:
+                switch (i.code & 0xF0) {
+                    case CANFILTER_BPF_JA:
+                        pc += i.k;
+                        break;
+                    case CANFILTER_BPF_JEQ:
+                        pc += (a == operand) ? i.jt : i.jf;
+                        break;
+                    case CANFILTER_BPF_JGT:
+                        pc += (a > operand) ? i.jt : i.jf;
+                        break;
+                    case CANFILTER_BPF_JGE:
+                        pc += (a >= operand) ? i.jt : i.jf;
+                        break;
+                    case CANFILTER_BPF_JSET:
+                        pc += (a & operand) ? i.jt : i.jf;
+                        break;
+                    default:
+                        return 0;
+                }
+                break;
+            case CANFILTER_BPF_RET:
+                return i.k;
+            case CANFILTER_BPF_MISC:
+                x = a;
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 0;
+}
+
+bool canfilter_bpf::match(uint32_t can_id, uint32_t *steps) const {
+    uint8_t frame[16] = {}; // struct can_frame
+    std::memcpy(frame, &can_id, sizeof(can_id));
+    frame[4] = 8;
+    return run(frame, sizeof(frame), steps) != 0;
+}
+
+bool canfilter_bpf::verify() const {
+    std::vector<std::pair<uint32_t, bool>> ids = {{0, false}, {max_std_id, false}, {0, true}, {max_ext_id, true}};
+    for (const auto &r : ranges_.ranges) {
+        uint32_t max_id = r.ext ? max_ext_id : max_std_id;
+        if (r.begin > 0)
+            ids.push_back({r.begin - 1, r.ext});
+        ids.push_back({r.begin, r.ext});
+        ids.push_back({r.end, r.ext});
+        if (r.end < max_id)
+            ids.push_back({r.end + 1, r.ext});
+    }
+
+    for (const auto &id : ids) {
+        uint32_t can_id = id.first | (id.second ? CANFILTER_CAN_EFF_FLAG : 0);
+        bool expected = accepts(id.first, id.second);
+        if (match(can_id) != expected || match(can_id | CANFILTER_CAN_RTR_FLAG) != expected)
+            return false;
+    }
+    return match(CANFILTER_CAN_ERR_FLAG);
+}
+
+uint32_t canfilter_bpf::max_steps() const {
+    // jumps only go forward: longest path from the end backwards
+    std::vector<uint32_t> longest(program.size() + 1, 0);
+    for (size_t pc = program.size(); pc-- > 0;) {
+        const canfilter_bpf_insn &i = program[pc];
+        uint32_t next = 0;
+        auto follow = [&](size_t target) {
+            if (target < longest.size())
+                next = std::max(next, longest[target]);
+        };
+        if ((i.code & 0x07) == CANFILTER_BPF_RET) {
+        } else if ((i.code & 0x07) == CANFILTER_BPF_JMP && (i.code & 0xF0) == CANFILTER_BPF_JA) {
+            follow(pc + 1 + i.k);
+        } else if ((i.code & 0x07) == CANFILTER_BPF_JMP) {
+            follow(pc + 1 + i.jt);
+            follow(pc + 1 + i.jf);
+        } else {
+            follow(pc + 1);
+        }
+        longest[pc] = 1 + next;
+    }
+    return longest[0];
+}
+
+void canfilter_bpf::print_program(std::ostream &out) const {
+    out << program.size() << "\n";
+    for (const auto &i : program)
+        out << i.code << " " << (int)i.jt << " " << (int)i.jf << " " << i.k << "\n";
+    out.flush();
+}
+
+#ifdef __linux__
+bool canfilter_bpf::attach_socket_filter(int fd) const {
+    struct sock_fprog prog;
+    prog.len = program.size();
+    prog.filter = (struct sock_filter *)program.data();
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == 0;
+}
+
+bool canfilter_socket_bench(const std::string &ifname, uint32_t frames, const canfilter_socketcan &list,
+                            const canfilter_bpf &bpf, std::vector<canfilter_socket_bench_result> &results) {
+    std::vector<canfilter_range> ranges;
+    bpf.get_ranges(ranges);
+    results.clear();
+
+    for (int mode = 0; mode < 3; mode++) {
+        canfilter_socket_bench_result result;
+        int rx = canfilter_socketcan::open_socket(ifname);
+        int tx = canfilter_socketcan::open_socket(ifname);
+        bool ok = (rx >= 0 && tx >= 0);
+
+        // the sender receives nothing
+        ok = ok && setsockopt(tx, SOL_CAN_RAW, CAN_RAW_FILTER, nullptr, 0) == 0;
+        if (mode == 0) {
+            result.filter = "none";
+        } else if (mode == 1) {
+            result.filter = "can_filter";
+            result.entries = list.filters.size();
+            ok = ok && list.set_socket_filter(rx);
+        } else {
+            result.filter = "bpf";
+            result.entries = bpf.program.size();
+            ok = ok && bpf.attach_socket_filter(rx);
+        }
+        if (!ok) {
+            canfilter_socketcan::close_socket(rx);
+            canfilter_socketcan::close_socket(tx);
+            return false;
+        }
+
+        struct can_frame frame, in;
+        std::memset(&frame, 0, sizeof(frame));
+        frame.can_dlc = 8;
+        uint32_t seed = 1;
+        struct timespec start, stop;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+        for (uint32_t n = 0; n < frames; n++) {
+            // half the frames from the accepted ranges, half anywhere
+            seed = seed * 1103515245 + 12345;
+            if ((n & 1) && !ranges.empty()) {
+                const canfilter_range &r = ranges[(seed >> 8) % ranges.size()];
+                uint32_t id = r.begin + (seed >> 4) % ((uint64_t)r.end - r.begin + 1);
+                frame.can_id = id | (r.ext ? CAN_EFF_FLAG : 0);
+            } else if (seed & 0x100) {
+                frame.can_id = ((seed >> 3) & CAN_EFF_MASK) | CAN_EFF_FLAG;
+            } else {
+                frame.can_id = (seed >> 16) & CAN_SFF_MASK;
+            }
+
+            if (write(tx, &frame, sizeof(frame)) == sizeof(frame))
+                result.sent++;
+            while (recv(rx, &in, sizeof(in), MSG_DONTWAIT) == sizeof(in))
+                result.received++;
+        }
+        while (recv(rx, &in, sizeof(in), MSG_DONTWAIT) == sizeof(in))
+            result.received++;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stop);
+
+        double ns = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+        result.cpu_ns = result.sent ? ns / result.sent : 0;
+        results.push_back(result);
+
+        canfilter_socketcan::close_socket(rx);
+        canfilter_socketcan::close_socket(tx);
+    }
+    return true;
+}
+#else
+bool canfilter_bpf::attach_socket_filter(int fd) const {
+    (void)fd;
+    return false;
+}
+
+bool canfilter_socket_bench(const std::string &ifname, uint32_t frames, const canfilter_socketcan &list,
+                            const canfilter_bpf &bpf, std::vector<canfilter_socket_bench_result> &results) {
+    (void)ifname;
+    (void)frames;
+    (void)list;
+    (void)bpf;
+    results.clear();
+    return false;
+}
+#endif
@@ -252,6 +252,7 @@ template <uint8_t max_banks_t, uint8_t dev_val> canfilter_error_t canfilter_bxca
     std_mask_count = 0;
     ext_list_count = 0;
     bank = 0;
+    blocks = 0;
     hw_config = hw_t(); // zero out
     hw_config.dev = dev_val;
 
@@ -291,6 +292,7 @@ canfilter_error_t canfilter_bxcan<max_banks_t, dev_val>::add_std_range(uint32_t
         int prefix = std_largest_prefix(begin, end);
         uint32_t mask = (~0U << (11 - prefix)) & max_std_id;
         uint32_t id = begin;
+        blocks++;
         if (mask == max_std_id) {
             err = add_std_list(id);
             if (verbose)
@@ -301,7 +303,8 @@ canfilter_error_t canfilter_bxcan<max_banks_t, dev_val>::add_std_range(uint32_t
                 std::cout << "bxcan std mask id " << FORMAT_HEX(id, 3) << " mask " << FORMAT_HEX(mask, 3) << std::endl;
         }
         if (err != CANFILTER_SUCCESS) {
-            std::cout << "bxcan std filter fail" << std::endl;
+            if (verbose)
+                std::cout << "bxcan std filter fail" << std::endl;
             return err;
         }
 
@@ -330,6 +333,7 @@ canfilter_error_t canfilter_bxcan<max_banks_t, dev_val>::add_ext_range(uint32_t
         int prefix = ext_largest_prefix(begin, end);
         uint32_t mask = (~0U << (29 - prefix)) & max_ext_id;
         uint32_t id = begin;
+        blocks++;
         if (mask == max_ext_id) {
             err = add_ext_list(id);
             if (verbose)
@@ -340,7 +344,8 @@ canfilter_error_t canfilter_bxcan<max_banks_t, dev_val>::add_ext_range(uint32_t
                 std::cout << "bxcan ext mask id " << FORMAT_HEX(id, 8) << " mask " << FORMAT_HEX(mask, 8) << std::endl;
         }
         if (err != CANFILTER_SUCCESS) {
-            std::cout << "bxcan ext filter fail" << std::endl;
+            if (verbose)
+                std::cout << "bxcan ext filter fail" << std::endl;
             return err;
         }
 
@@ -369,6 +374,146 @@ template <uint8_t max_banks_t, uint8_t dev_val> size_t canfilter_bxcan<max_banks
     return sizeof(hw_config);
 }
 
+/*
+ * Compact image, little endian:
+ *   dev, banks in use, 0, CANFILTER_IMAGE_COMPACT
+ *   fs1r, fm1r, ffa1r, fa1r
+ *   fr1, fr2 of each bank in use
+ * Banks are used from bank 0 up, so the banks in use are 0 .. n-1.
+ */
+template <uint8_t max_banks_t, uint8_t dev_val>
+void canfilter_bxcan<max_banks_t, dev_val>::get_hw_config_compact(std::vector<uint8_t> &image) {
+    const uint32_t regs[4] = {hw_config.fs1r, hw_config.fm1r, hw_config.ffa1r, hw_config.fa1r};
+
+    image.assign(4 + sizeof(regs) + 8 * bank, 0);
+    image[0] = dev_val;
+    image[1] = bank;
+    image[3] = CANFILTER_IMAGE_COMPACT;
+    std::memcpy(&image[4], regs, sizeof(regs));
+    for (uint32_t i = 0; i < bank; i++) {
+        uint32_t fr[2] = {hw_config.fr1[i], hw_config.fr2[i]};
+        std::memcpy(&image[20 + 8 * i], fr, sizeof(fr));
+    }
+}
+
+template <uint8_t max_banks_t, uint8_t dev_val>
+bool canfilter_bxcan<max_banks_t, dev_val>::set_hw_config_compact(const uint8_t *image, size_t size) {
+    if (size < 20 || image[0] != dev_val || !(image[3] & CANFILTER_IMAGE_COMPACT))
+        return false;
+    uint32_t n = image[1];
+    if (n > max_banks || size != 20 + 8 * n)
+        return false;
+
+    uint32_t regs[4];
+    std::memcpy(regs, &image[4], sizeof(regs));
+
+    hw_config = hw_t();
+    hw_config.dev = dev_val;
+    hw_config.fs1r = regs[0];
+    hw_config.fm1r = regs[1];
+    hw_config.ffa1r = regs[2];
+    hw_config.fa1r = regs[3];
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t fr[2];
+        std::memcpy(fr, &image[20 + 8 * i], sizeof(fr));
+        hw_config.fr1[i] = fr[0];
+        hw_config.fr2[i] = fr[1];
+    }
+    bank = n;
+
+    return true;
+}
+
+template <uint8_t max_banks_t, uint8_t dev_val>
+void canfilter_bxcan<max_banks_t, dev_val>::get_slots(const hw_t &config, uint32_t n,
+                                                      std::vector<canfilter_slot> &slots) {
+    slots.assign(n, canfilter_slot());
+    for (uint32_t i = 0; i < n; i++) {
+        slots[i].mode = ((config.fs1r >> i) & 1) | (((config.fm1r >> i) & 1) << 1) | (((config.ffa1r >> i) & 1) << 2);
+        slots[i].word[0] = config.fr1[i];
+        slots[i].word[1] = config.fr2[i];
+    }
+}
+
+template <uint8_t max_banks_t, uint8_t dev_val>
+void canfilter_bxcan<max_banks_t, dev_val>::set_slots(const std::vector<canfilter_slot> &slots) {
+    hw_config.fs1r = hw_config.fm1r = hw_config.ffa1r = hw_config.fa1r = 0;
+    for (uint32_t i = 0; i < max_banks; i++) {
+        hw_config.fr1[i] = hw_config.fr2[i] = 0;
+        if (i >= slots.size())
+            continue;
+        hw_config.fs1r |= (slots[i].mode & 1) << i;
+        hw_config.fm1r |= ((slots[i].mode >> 1) & 1) << i;
+        hw_config.ffa1r |= ((slots[i].mode >> 2) & 1) << i;
+        hw_config.fa1r |= 1 << i;
+        hw_config.fr1[i] = slots[i].word[0];
+        hw_config.fr2[i] = slots[i].word[1];
+    }
+    bank = slots.size();
+}
+
+template <uint8_t max_banks_t, uint8_t dev_val>
+bool canfilter_bxcan<max_banks_t, dev_val>::get_hw_config_delta(std::vector<uint8_t> &delta) {
+    delta.clear();
+    reordered = false;
+    if (!has_previous) {
+        previous_config = hw_config;
+        previous_banks = bank;
+        has_previous = true;
+        return false;
+    }
+
+    std::vector<canfilter_slot> prev, next;
+    get_slots(previous_config, previous_banks, prev);
+    get_slots(hw_config, bank, next);
+    std::vector<canfilter_slot> compiled = next;
+    canfilter_stable_order(prev, next);
+    reordered = (next != compiled);
+    set_slots(next);
+
+    const uint32_t regs[4] = {hw_config.fs1r, hw_config.fm1r, hw_config.ffa1r, hw_config.fa1r};
+    canfilter_delta_header(dev_val, bank, 0, delta);
+    delta.insert(delta.end(), (const uint8_t *)regs, (const uint8_t *)regs + sizeof(regs));
+    canfilter_delta_add(0, prev, next, delta);
+
+    previous_config = hw_config;
+    previous_banks = bank;
+    return true;
+}
+
+template <uint8_t max_banks_t, uint8_t dev_val> void canfilter_bxcan<max_banks_t, dev_val>::reset_delta() {
+    has_previous = false;
+}
+
+template <uint8_t max_banks_t, uint8_t dev_val>
+bool canfilter_bxcan<max_banks_t, dev_val>::apply_hw_config_delta(const uint8_t *delta, size_t size) {
+    const size_t offset = CANFILTER_DELTA_HEADER_SIZE + 16;
+    std::vector<canfilter_delta_entry> entries;
+    if (size < offset || delta[0] != dev_val || !(delta[3] & CANFILTER_IMAGE_DELTA) || delta[1] > max_banks ||
+        !canfilter_delta_entries(delta, size, offset, entries))
+        return false;
+    uint32_t n = delta[1];
+    for (auto &e : entries)
+        if (e.kind != 0 || e.index >= n)
+            return false;
+
+    uint32_t regs[4];
+    std::memcpy(regs, &delta[CANFILTER_DELTA_HEADER_SIZE], sizeof(regs));
+    hw_config.fs1r = regs[0];
+    hw_config.fm1r = regs[1];
+    hw_config.ffa1r = regs[2];
+    hw_config.fa1r = regs[3];
+    for (uint32_t i = n; i < max_banks; i++)
+        hw_config.fr1[i] = hw_config.fr2[i] = 0;
+    for (auto &e : entries) {
+        hw_config.fr1[e.index] = e.word[0];
+        hw_config.fr2[e.index] = e.word[1];
+    }
+    bank = n;
+
+    return true;
+}
+
 template <uint8_t max_banks_t, uint8_t dev_val> void canfilter_bxcan<max_banks_t, dev_val>::debug_print_reg() const {
     std::cout << std::endl << "bxcan registers:" << std::endl;
 
@@ -433,10 +578,88 @@ template <uint8_t max_banks_t, uint8_t dev_val> void canfilter_bxcan<max_banks_t
     }
 }
 
-template <uint8_t max_banks_t, uint8_t dev_val> void canfilter_bxcan<max_banks_t, dev_val>::print_usage() const {
-    uint32_t percent = (bank * 100 + max_banks / 2) / max_banks;
-    std::cout << "Filter usage: " << (int)bank << "/" << (int)max_banks << " (" << percent << "%)" << std::endl;
-    return;
+template <uint8_t max_banks_t, uint8_t dev_val>
+void canfilter_bxcan<max_banks_t, dev_val>::get_ranges(std::vector<canfilter_range> &ranges) const {
+    ranges.clear();
+    for (int i = 0; i < max_banks; i++) {
+        if (!(hw_config.fa1r & (1 << i)))
+            continue;
+        bool is_32bit = hw_config.fs1r & (1 << i);
+        bool is_list = hw_config.fm1r & (1 << i);
+        if (is_32bit) {
+            uint32_t id1 = (hw_config.fr1[i] >> 3) & max_ext_id;
+            uint32_t id2 = (hw_config.fr2[i] >> 3) & max_ext_id;
+            if (is_list) {
+                ranges.push_back({id1, id1, true});
+                if (id2 != id1)
+                    ranges.push_back({id2, id2, true});
+            } else {
+                uint32_t begin = id1 & id2;
+                ranges.push_back({begin, (begin | ~id2) & max_ext_id, true});
+            }
+        } else {
+            uint32_t id1 = (hw_config.fr1[i] >> 5) & max_std_id;
+            uint32_t id2 = (hw_config.fr1[i] >> 21) & max_std_id;
+            uint32_t id3 = (hw_config.fr2[i] >> 5) & max_std_id;
+            uint32_t id4 = (hw_config.fr2[i] >> 21) & max_std_id;
+            if (is_list) {
+                uint32_t ids[4] = {id1, id2, id3, id4};
+                for (int j = 0; j < 4; j++) {
+                    // skip the duplicates used to pad a partially filled bank
+                    bool dup = false;
+                    for (int k = 0; k < j; k++)
+                        dup = dup || ids[k] == ids[j];
+                    if (!dup)
+                        ranges.push_back({ids[j], ids[j], false});
+                }
+            } else {
+                uint32_t begin1 = id1 & id2;
+                uint32_t begin2 = id3 & id4;
+                ranges.push_back({begin1, (begin1 | ~id2) & max_std_id, false});
+                if (begin2 != begin1 || id4 != id2)
+                    ranges.push_back({begin2, (begin2 | ~id4) & max_std_id, false});
+            }
+        }
+    }
+}
+
+template <uint8_t max_banks_t, uint8_t dev_val>
+void canfilter_bxcan<max_banks_t, dev_val>::get_stats(canfilter_stats &stats) const {
+    stats = canfilter_stats();
+    stats.dev = (canfilter_hardware_t)dev_val;
+    stats.banks_used = bank;
+    stats.banks_total = max_banks;
+
+    for (int i = 0; i < max_banks; i++) {
+        if (!(hw_config.fa1r & (1 << i)))
+            continue;
+        bool is_32bit = hw_config.fs1r & (1 << i);
+        bool is_list = hw_config.fm1r & (1 << i);
+        uint32_t fr1 = hw_config.fr1[i];
+        uint32_t fr2 = hw_config.fr2[i];
+        if (is_32bit && is_list) {
+            stats.ext_list++;
+            stats.padding += (fr1 == fr2);
+        } else if (is_32bit) {
+            stats.ext_mask++;
+        } else if (is_list) {
+            stats.std_list++;
+            uint32_t ids[4] = {fr1 & 0xffff, fr1 >> 16, fr2 & 0xffff, fr2 >> 16};
+            for (int j = 1; j < 4; j++) {
+                for (int k = 0; k < j; k++) {
+                    if (ids[k] == ids[j]) {
+                        stats.padding++;
+                        break;
+                    }
+                }
+            }
+        } else {
+            stats.std_mask++;
+            stats.padding += (fr1 == fr2);
+        }
+    }
+
+    count_ids(stats);
 }
 
 // Explicit template instantiation for bxcan_f0 and bxcan_f4
@@ -0,0 +1,329 @@
+/*
+ * canfilter_daemon.cpp
+ *
+ * Implements the hotplug daemon.
+ *
+ * Responsibilities:
+ * - Read filter profiles and compile them for every controller type.
+ * - Register libusb hotplug callbacks for the supported VID/PID pairs.
+ * - Program adapters from the precompiled images as soon as they appear.
+ * - Poll the bus on platforms without hotplug support.
+ * - Switch one open adapter between named profiles on command.
+ *
+ * Notes:
+ * - libusb does not allow synchronous transfers inside a hotplug callback.
+ *   The callback only queues the device; run() programs it after
+ *   libusb_handle_events_timeout() returns.
+ * - A freshly attached adapter may not accept requests yet, so opening is
+ *   retried for a short while.
+ * - Switching queries the adapter once at startup. The filter state it
+ *   returns, and the state after each upload, let programImage() compare
+ *   image hashes locally, so a switch costs one SET_FILTER request, or none
+ *   if the adapter already holds the profile.
+ */
+
+#include "canfilter_daemon.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+canfilter_daemon::canfilter_daemon() : running_(false) {}
+
+canfilter_daemon::~canfilter_daemon() {
+    stop();
+}
+
+bool canfilter_daemon::add_profile(const std::string &serial, const canfilter_ranges &spec) {
+    profile &p = profiles_[serial];
+    p.spec = spec;
+    p.images.clear();
+
+    bool fits = false;
+    for (canfilter_hardware_t d : canfilter_device_list) {
+        canfilter_image &image = p.images[d];
+        canfilter_compile(d, p.spec, image);
+        fits = fits || (image.error == CANFILTER_SUCCESS);
+        if (verbose && image.error != CANFILTER_SUCCESS)
+            std::cerr << "profile " << serial << ": does not fit " << canfilter_device_name(d) << std::endl;
+    }
+
+    return fits;
+}
+
+bool canfilter_daemon::load_profiles(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in)
+        return false;
+
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        lineno++;
+        std::istringstream words(line);
+        std::string serial;
+        if (!(words >> serial) || serial[0] == '#')
+            continue;
+
+        std::vector<std::string> args;
+        std::string word;
+        while (words >> word)
+            args.push_back(word);
+
+        canfilter_ranges spec;
+        spec.begin();
+        if (args.empty() || !spec.parse(args)) {
+            std::cerr << filename << ":" << lineno << ": invalid profile" << std::endl;
+            return false;
+        }
+        spec.end();
+
+        if (!add_profile(serial, spec)) {
+            std::cerr << filename << ":" << lineno << ": profile does not fit any controller" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t canfilter_daemon::profile_count() const {
+    return profiles_.size();
+}
+
+const canfilter_daemon::profile *canfilter_daemon::find_profile(const std::string &serial) const {
+    auto it = profiles_.find(serial);
+    if (it == profiles_.end())
+        it = profiles_.find("*");
+    if (it == profiles_.end())
+        return nullptr;
+    return &it->second;
+}
+
+bool canfilter_daemon::attach(canfilter_usb &usb, const std::string &name, const std::string &serial) {
+    auto start = std::chrono::steady_clock::now();
+    const char *status;
+
+    usb.timeout_ms = timeout_ms;
+    usb.retries = retries;
+    usb.skip_unchanged = skip_unchanged;
+
+    const profile *p = find_profile(serial);
+    canfilter_hardware_t d = dev;
+    bool success = false;
+    if (!p) {
+        status = "no profile";
+    } else if (d == CANFILTER_DEV_NONE) {
+        uint32_t filter_type = CANFILTER_DEV_NONE;
+        canfilter_error_t err = usb.queryAndProgram(
+            [p](uint32_t type, canfilter_image &image) {
+                auto it = p->images.find(type);
+                if (it == p->images.end())
+                    return CANFILTER_ERROR_PARAM;
+                image = it->second;
+                return image.error;
+            },
+            &filter_type);
+        d = (canfilter_hardware_t)filter_type;
+        success = (err == CANFILTER_SUCCESS);
+        status = canfilter_program_status(err, d, usb.unchanged);
+    } else {
+        auto it = p->images.find(d);
+        canfilter_error_t err = (it == p->images.end()) ? CANFILTER_ERROR_PARAM : it->second.error;
+        if (err == CANFILTER_SUCCESS && !usb.programImage(it->second))
+            err = CANFILTER_ERROR_PLATFORM;
+        success = (err == CANFILTER_SUCCESS);
+        status = canfilter_program_status(err, d, usb.unchanged);
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ms = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / 1000.0;
+    std::cout << name << " " << (serial.empty() ? "-" : serial) << " " << canfilter_device_name(d) << " "
+              << status << " " << ms << " ms" << std::endl;
+
+    if (success)
+        programmed++;
+    else
+        failed++;
+    return success;
+}
+
+bool canfilter_daemon::switch_profile(canfilter_usb &usb, const std::string &name) {
+    auto start = std::chrono::steady_clock::now();
+
+    auto it = profiles_.find(name);
+    const canfilter_image *image = nullptr;
+    canfilter_error_t err = (dev == CANFILTER_DEV_NONE) ? CANFILTER_ERROR_PLATFORM : CANFILTER_ERROR_PARAM;
+    if (it != profiles_.end()) {
+        auto found = it->second.images.find(dev);
+        if (found != it->second.images.end()) {
+            image = &found->second;
+            err = image->error;
+        }
+    }
+    auto ready = std::chrono::steady_clock::now();
+
+    usb.unchanged = false;
+    if (err == CANFILTER_SUCCESS && !usb.programImage(*image))
+        err = CANFILTER_ERROR_PLATFORM;
+    const char *status = (it == profiles_.end()) ? "no profile" : canfilter_program_status(err, dev, usb.unchanged);
+
+    auto done = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration_cast<std::chrono::nanoseconds>(done - start).count() / 1000000.0;
+    double image_us = std::chrono::duration_cast<std::chrono::nanoseconds>(ready - start).count() / 1000.0;
+    std::cout << name << " " << canfilter_device_name(dev) << " " << status << " " << ms << " ms (image " << image_us
+              << " us)" << std::endl;
+
+    bool success = (err == CANFILTER_SUCCESS && it != profiles_.end());
+    if (success)
+        programmed++;
+    else
+        failed++;
+    return success;
+}
+
+bool canfilter_daemon::run_switch(canfilter_usb &usb, std::istream &in) {
+    usb.timeout_ms = timeout_ms;
+    usb.retries = retries;
+    usb.skip_unchanged = skip_unchanged;
+
+    if (!usb.hasHardwareFilter()) {
+        std::cerr << "error: no hardware filter" << std::endl;
+        return false;
+    }
+    uint32_t filter_type = usb.getFilterInfo();
+    if (dev == CANFILTER_DEV_NONE)
+        dev = (canfilter_hardware_t)filter_type;
+    for (const auto &p : profiles_) {
+        auto it = p.second.images.find(dev);
+        if (it == p.second.images.end() || it->second.error != CANFILTER_SUCCESS)
+            std::cerr << "profile " << p.first << ": does not fit " << canfilter_device_name(dev) << std::endl;
+    }
+    if (verbose)
+        std::cerr << "waiting for profile names, " << profiles_.size() << " profiles, "
+                  << canfilter_device_name(dev) << std::endl;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::string name;
+        if (!(words >> name) || name[0] == '#')
+            continue;
+        switch_profile(usb, name);
+    }
+
+    return failed == 0;
+}
+
+int canfilter_daemon::hotplug_callback(libusb_context *, libusb_device *device, libusb_hotplug_event event,
+                                       void *user_data) {
+    canfilter_daemon *daemon = (canfilter_daemon *)user_data;
+    if (event != LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+        return 0;
+
+    // no transfers allowed here; remember the device until run() gets control again
+    usb_device_info info;
+    info.device = std::shared_ptr<void>(libusb_ref_device(device), [](void *d) {
+        libusb_unref_device((libusb_device *)d);
+    });
+    daemon->pending_.push_back(info);
+    return 0;
+}
+
+void canfilter_daemon::attach_pending() {
+    std::vector<usb_device_info> pending;
+    pending.swap(pending_);
+
+    for (auto &p : pending) {
+        usb_device_info info;
+        if (!usb_device::describe(p.device.get(), info))
+            continue;
+
+        canfilter_usb usb;
+        bool opened = false;
+        for (int attempt = 0; attempt < 10 && !(opened = usb.open(info)); attempt++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        if (opened) {
+            attach(usb, info.path, info.serial);
+        } else {
+            std::cout << info.path << " " << (info.serial.empty() ? "-" : info.serial) << " open failed"
+                      << std::endl;
+            failed++;
+        }
+        usb.close();
+    }
+}
+
+void canfilter_daemon::poll() {
+    std::vector<usb_device_info> found;
+    if (!usb_device::enumerate(canfilter_usb::default_vid_pid_list_, "", found))
+        return;
+
+    // new path, or same path with a new address after a re-plug
+    std::map<std::string, uint16_t> seen;
+    for (auto &info : found) {
+        uint16_t key = (info.bus << 8) | info.address;
+        auto it = seen_.find(info.path);
+        if (it == seen_.end() || it->second != key)
+            pending_.push_back(info);
+        seen[info.path] = key;
+    }
+    seen_.swap(seen);
+}
+
+bool canfilter_daemon::run() {
+    libusb_context *ctx = (libusb_context *)usb_device::shared_context();
+    if (!ctx)
+        return false;
+
+    running_ = true;
+    bool success = true;
+    bool hotplug = libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG);
+    std::vector<libusb_hotplug_callback_handle> handles;
+
+    if (hotplug) {
+        for (auto &vp : canfilter_usb::default_vid_pid_list_) {
+            libusb_hotplug_callback_handle handle;
+            int rc = libusb_hotplug_register_callback(ctx, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED,
+                                                      LIBUSB_HOTPLUG_ENUMERATE, vp.first, vp.second,
+                                                      LIBUSB_HOTPLUG_MATCH_ANY, hotplug_callback, this, &handle);
+            if (rc != LIBUSB_SUCCESS) {
+                std::cerr << "error: hotplug registration failed" << std::endl;
+                running_ = false;
+                success = false;
+                break;
+            }
+            handles.push_back(handle);
+        }
+    } else if (verbose) {
+        std::cerr << "no hotplug support, polling every " << poll_ms << " ms" << std::endl;
+    }
+
+    if (verbose)
+        std::cerr << "waiting for adapters, " << profiles_.size() << " profiles" << std::endl;
+
+    while (running_) {
+        if (hotplug) {
+            struct timeval tv = {0, 200000};
+            libusb_handle_events_timeout(ctx, &tv);
+        } else {
+            poll();
+        }
+
+        attach_pending();
+
+        if (!hotplug && running_)
+            std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+    }
+
+    for (auto handle : handles)
+        libusb_hotplug_deregister_callback(ctx, handle);
+
+    return success;
+}
+
+void canfilter_daemon::stop() {
+    running_ = false;
+}
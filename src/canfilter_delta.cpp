@@ -0,0 +1,84 @@
+/*
+ * canfilter_delta.cpp
+ *
+ * Implements the delta programming helpers.
+ *
+ * Responsibilities:
+ * - Stable renumbering of banks or filter elements.
+ * - Encode and decode delta entries.
+ *
+ * Notes:
+ * - Renumbering only uses positions below the new slot count, so the slots
+ *   in use stay contiguous and compact images remain valid.
+ * - Slot counts are small (at most 128), a quadratic match is fine.
+ */
+
+#include "canfilter_delta.hpp"
+#include <cstring>
+
+void canfilter_stable_order(const std::vector<canfilter_slot> &prev, std::vector<canfilter_slot> &next) {
+    size_t n = next.size();
+    std::vector<canfilter_slot> order(n);
+    std::vector<bool> placed(n, false); // position in order filled
+    std::vector<bool> taken(n, false);  // slot in next used
+
+    // unchanged slots keep their position
+    for (size_t pos = 0; pos < n && pos < prev.size(); pos++) {
+        for (size_t k = 0; k < n; k++) {
+            if (!taken[k] && next[k] == prev[pos]) {
+                order[pos] = next[k];
+                placed[pos] = true;
+                taken[k] = true;
+                break;
+            }
+        }
+    }
+
+    // new slots fill the free positions, in their original order
+    size_t k = 0;
+    for (size_t pos = 0; pos < n; pos++) {
+        if (placed[pos])
+            continue;
+        while (taken[k])
+            k++;
+        order[pos] = next[k];
+        taken[k] = true;
+    }
+
+    next.swap(order);
+}
+
+void canfilter_delta_header(uint8_t dev, uint8_t count0, uint8_t count1, std::vector<uint8_t> &delta) {
+    delta.clear();
+    delta.push_back(dev);
+    delta.push_back(count0);
+    delta.push_back(count1);
+    delta.push_back(CANFILTER_IMAGE_DELTA);
+}
+
+void canfilter_delta_add(uint8_t kind, const std::vector<canfilter_slot> &prev, const std::vector<canfilter_slot> &next,
+                         std::vector<uint8_t> &delta) {
+    for (size_t pos = 0; pos < next.size(); pos++) {
+        if (pos < prev.size() && next[pos] == prev[pos])
+            continue;
+        uint8_t entry[CANFILTER_DELTA_ENTRY_SIZE] = {(uint8_t)pos, kind, 0, 0};
+        std::memcpy(&entry[4], next[pos].word, sizeof(next[pos].word));
+        delta.insert(delta.end(), entry, entry + sizeof(entry));
+    }
+}
+
+bool canfilter_delta_entries(const uint8_t *delta, size_t size, size_t offset,
+                             std::vector<canfilter_delta_entry> &entries) {
+    entries.clear();
+    if (size < offset || (size - offset) % CANFILTER_DELTA_ENTRY_SIZE)
+        return false;
+
+    for (size_t i = offset; i < size; i += CANFILTER_DELTA_ENTRY_SIZE) {
+        canfilter_delta_entry e;
+        e.index = delta[i];
+        e.kind = delta[i + 1];
+        std::memcpy(e.word, &delta[i + 4], sizeof(e.word));
+        entries.push_back(e);
+    }
+    return true;
+}
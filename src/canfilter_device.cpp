@@ -0,0 +1,149 @@
+/*
+ * canfilter_device.cpp
+ *
+ * Maps controller types to filter builders and names.
+ *
+ * Responsibilities:
+ * - Construct the canfilter_* builder matching a controller type.
+ * - Convert controller types to and from command line names.
+ * - Format filter usage statistics as JSON.
+ * - Compile a specification into a standalone hardware image.
+ * - Describe the outcome of programming an adapter.
+ * - Hash images, to compare with the image an adapter holds.
+ *
+ * Notes:
+ * - Adding a controller type means adding it here and to canfilter_hardware_t.
+ */
+
+#include "canfilter_device.hpp"
+#include "canfilter_bxcan.hpp"
+#include "canfilter_fdcan.hpp"
+#include <memory>
+
+const canfilter_hardware_t canfilter_device_list[4] = {
+    CANFILTER_DEV_BXCAN_F0,
+    CANFILTER_DEV_BXCAN_F4,
+    CANFILTER_DEV_FDCAN_G0,
+    CANFILTER_DEV_FDCAN_H7,
+};
+
+canfilter *canfilter_create(canfilter_hardware_t dev) {
+    switch (dev) {
+        case CANFILTER_DEV_BXCAN_F0:
+            return new canfilter_bxcan_f0();
+        case CANFILTER_DEV_BXCAN_F4:
+            return new canfilter_bxcan_f4();
+        case CANFILTER_DEV_FDCAN_G0:
+            return new canfilter_fdcan_g0();
+        case CANFILTER_DEV_FDCAN_H7:
+            return new canfilter_fdcan_h7();
+        case CANFILTER_DEV_NONE:
+        default:
+            return nullptr;
+    }
+}
+
+const char *canfilter_device_name(canfilter_hardware_t dev) {
+    switch (dev) {
+        case CANFILTER_DEV_BXCAN_F0:
+            return "bxcan_f0";
+        case CANFILTER_DEV_BXCAN_F4:
+            return "bxcan_f4";
+        case CANFILTER_DEV_FDCAN_G0:
+            return "fdcan_g0";
+        case CANFILTER_DEV_FDCAN_H7:
+            return "fdcan_h7";
+        case CANFILTER_DEV_NONE:
+        default:
+            return "none";
+    }
+}
+
+const char *canfilter_device_description(canfilter_hardware_t dev) {
+    switch (dev) {
+        case CANFILTER_DEV_BXCAN_F0:
+            return "bxCAN (F0/F1/F3) with 14 filter banks";
+        case CANFILTER_DEV_BXCAN_F4:
+            return "bxCAN (F4/F7) with 28 filter banks";
+        case CANFILTER_DEV_FDCAN_G0:
+            return "FDCAN (G0) with 28 standard, 8 extended filters";
+        case CANFILTER_DEV_FDCAN_H7:
+            return "FDCAN (H7) with 128 standard, 64 extended filters";
+        case CANFILTER_DEV_NONE:
+        default:
+            return "no hardware filter";
+    }
+}
+
+canfilter_hardware_t canfilter_device_from_name(const std::string &name) {
+    for (canfilter_hardware_t dev : canfilter_device_list) {
+        if (name == canfilter_device_name(dev))
+            return dev;
+    }
+    return CANFILTER_DEV_NONE;
+}
+
+canfilter_error_t canfilter_compile(canfilter_hardware_t dev, const canfilter_ranges &spec, canfilter_image &image,
+                                    canfilter_trace *trace) {
+    image = canfilter_image();
+    image.dev = dev;
+
+    std::unique_ptr<canfilter> filter(canfilter_create(dev));
+    if (!filter)
+        image.error = CANFILTER_ERROR_PARAM;
+    else
+        image.error = spec.compile(*filter, trace);
+    if (image.error != CANFILTER_SUCCESS)
+        return image.error;
+
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_EMIT);
+    filter->get_stats(image.stats);
+    const uint8_t *p = (const uint8_t *)filter->get_hw_config();
+    image.data.assign(p, p + filter->get_hw_size());
+    filter->get_hw_config_compact(image.compact);
+    image.hash = canfilter_image_hash(image.data.data(), image.data.size());
+    timer.event.bytes = image.data.size();
+
+    return CANFILTER_SUCCESS;
+}
+
+const char *canfilter_program_status(canfilter_error_t err, canfilter_hardware_t dev, bool unchanged, bool reordered) {
+    switch (err) {
+        case CANFILTER_SUCCESS:
+            if (unchanged)
+                return "unchanged";
+            return reordered ? "reordered" : "programmed";
+        case CANFILTER_ERROR_FULL:
+            return "does not fit";
+        case CANFILTER_ERROR_PARAM:
+            return "invalid filter type";
+        default:
+            return dev == CANFILTER_DEV_NONE ? "no hardware filter" : "transfer failed";
+    }
+}
+
+uint32_t canfilter_image_hash(const uint8_t *data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+void canfilter_print_stats_json(std::ostream &out, const canfilter_stats &stats) {
+    out << "{\"device\":\"" << canfilter_device_name(stats.dev) << "\"";
+    if (stats.banks_total) {
+        out << ",\"banks\":{\"used\":" << stats.banks_used << ",\"free\":" << stats.banks_total - stats.banks_used
+            << ",\"total\":" << stats.banks_total << "}";
+    } else {
+        out << ",\"std_filters\":{\"used\":" << stats.std_used << ",\"free\":" << stats.std_total - stats.std_used
+            << ",\"total\":" << stats.std_total << "}";
+        out << ",\"ext_filters\":{\"used\":" << stats.ext_used << ",\"free\":" << stats.ext_total - stats.ext_used
+            << ",\"total\":" << stats.ext_total << "}";
+    }
+    out << ",\"std_list\":" << stats.std_list << ",\"std_mask\":" << stats.std_mask
+        << ",\"ext_list\":" << stats.ext_list << ",\"ext_mask\":" << stats.ext_mask << ",\"padding\":" << stats.padding
+        << ",\"std_ids\":" << stats.std_ids << ",\"ext_ids\":" << stats.ext_ids << "}" << std::endl;
+}
@@ -121,6 +121,7 @@ canfilter_error_t canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::begi
     // no pending id's
     std_id_count = 0;
     ext_id_count = 0;
+    blocks = 0;
     // no filters written
     hw_config.std_filter_nbr = 0;
     hw_config.ext_filter_nbr = 0;
@@ -149,6 +150,7 @@ canfilter_error_t canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::add_
     if (id > max_std_id || std_id_count > 1)
         return CANFILTER_ERROR_PARAM;
 
+    blocks++;
     std_id[std_id_count++] = id;
     if (std_id_count == 1) {
         std_id[1] = id;
@@ -167,6 +169,7 @@ canfilter_error_t canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::add_
     if (id > max_ext_id || ext_id_count > 1)
         return CANFILTER_ERROR_PARAM;
 
+    blocks++;
     ext_id[ext_id_count++] = id;
     if (ext_id_count == 1) {
         ext_id[1] = id;
@@ -184,6 +187,7 @@ canfilter_error_t canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::add_
     if (begin > max_std_id || end > max_std_id)
         return CANFILTER_ERROR_PARAM;
 
+    blocks++;
     if (begin <= end)
         return emit_std_range(begin, end);
     else
@@ -197,6 +201,7 @@ canfilter_error_t canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::add_
     if (begin > max_ext_id || end > max_ext_id)
         return CANFILTER_ERROR_PARAM;
 
+    blocks++;
     if (begin <= end)
         return emit_ext_range(begin, end);
     else
@@ -214,6 +219,154 @@ size_t canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::get_hw_size() {
     return sizeof(hw_config);
 }
 
+/*
+ * Compact image, little endian:
+ *   dev, standard elements, extended elements, CANFILTER_IMAGE_COMPACT
+ *   standard elements in use, one word each
+ *   extended elements in use, two words each
+ */
+template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
+void canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::get_hw_config_compact(std::vector<uint8_t> &image) {
+    uint32_t nstd = hw_config.std_filter_nbr;
+    uint32_t next = hw_config.ext_filter_nbr;
+
+    image.assign(4 + 4 * nstd + 8 * next, 0);
+    image[0] = dev_val;
+    image[1] = nstd;
+    image[2] = next;
+    image[3] = CANFILTER_IMAGE_COMPACT;
+    for (uint32_t i = 0; i < nstd; i++) {
+        uint32_t w = hw_config.std_filter[i];
+        std::memcpy(&image[4 + 4 * i], &w, sizeof(w));
+    }
+    for (uint32_t i = 0; i < next; i++) {
+        uint32_t w[2] = {hw_config.ext_filter[i][0], hw_config.ext_filter[i][1]};
+        std::memcpy(&image[4 + 4 * nstd + 8 * i], w, sizeof(w));
+    }
+}
+
+template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
+bool canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::set_hw_config_compact(const uint8_t *image,
+                                                                                     size_t size) {
+    if (size < 4 || image[0] != dev_val || !(image[3] & CANFILTER_IMAGE_COMPACT))
+        return false;
+    uint32_t nstd = image[1];
+    uint32_t next = image[2];
+    if (nstd > max_std_filter || next > max_ext_filter || size != 4 + 4 * nstd + 8 * next)
+        return false;
+
+    hw_config = hw_t();
+    hw_config.dev = dev_val;
+    hw_config.std_filter_nbr = nstd;
+    hw_config.ext_filter_nbr = next;
+    for (uint32_t i = 0; i < nstd; i++) {
+        uint32_t w;
+        std::memcpy(&w, &image[4 + 4 * i], sizeof(w));
+        hw_config.std_filter[i] = w;
+    }
+    for (uint32_t i = 0; i < next; i++) {
+        uint32_t w[2];
+        std::memcpy(w, &image[4 + 4 * nstd + 8 * i], sizeof(w));
+        hw_config.ext_filter[i][0] = w[0];
+        hw_config.ext_filter[i][1] = w[1];
+    }
+
+    return true;
+}
+
+template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
+void canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::get_slots(const hw_t &config,
+                                                                         std::vector<canfilter_slot> &std_slots,
+                                                                         std::vector<canfilter_slot> &ext_slots) {
+    std_slots.assign(config.std_filter_nbr, canfilter_slot());
+    for (uint32_t i = 0; i < config.std_filter_nbr; i++)
+        std_slots[i].word[0] = config.std_filter[i];
+
+    ext_slots.assign(config.ext_filter_nbr, canfilter_slot());
+    for (uint32_t i = 0; i < config.ext_filter_nbr; i++) {
+        ext_slots[i].word[0] = config.ext_filter[i][0];
+        ext_slots[i].word[1] = config.ext_filter[i][1];
+    }
+}
+
+template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
+void canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::set_slots(const std::vector<canfilter_slot> &std_slots,
+                                                                         const std::vector<canfilter_slot> &ext_slots) {
+    for (uint32_t i = 0; i < max_std_filter; i++)
+        hw_config.std_filter[i] = (i < std_slots.size()) ? std_slots[i].word[0] : 0;
+    for (uint32_t i = 0; i < max_ext_filter; i++) {
+        hw_config.ext_filter[i][0] = (i < ext_slots.size()) ? ext_slots[i].word[0] : 0;
+        hw_config.ext_filter[i][1] = (i < ext_slots.size()) ? ext_slots[i].word[1] : 0;
+    }
+    hw_config.std_filter_nbr = std_slots.size();
+    hw_config.ext_filter_nbr = ext_slots.size();
+}
+
+template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
+bool canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::get_hw_config_delta(std::vector<uint8_t> &delta) {
+    delta.clear();
+    reordered = false;
+    if (!has_previous) {
+        previous_config = hw_config;
+        has_previous = true;
+        return false;
+    }
+
+    std::vector<canfilter_slot> prev_std, prev_ext, next_std, next_ext;
+    get_slots(previous_config, prev_std, prev_ext);
+    get_slots(hw_config, next_std, next_ext);
+    std::vector<canfilter_slot> compiled_std = next_std, compiled_ext = next_ext;
+    canfilter_stable_order(prev_std, next_std);
+    canfilter_stable_order(prev_ext, next_ext);
+    reordered = (next_std != compiled_std || next_ext != compiled_ext);
+    set_slots(next_std, next_ext);
+
+    canfilter_delta_header(dev_val, hw_config.std_filter_nbr, hw_config.ext_filter_nbr, delta);
+    canfilter_delta_add(0, prev_std, next_std, delta);
+    canfilter_delta_add(1, prev_ext, next_ext, delta);
+
+    previous_config = hw_config;
+    return true;
+}
+
+template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
+void canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::reset_delta() {
+    has_previous = false;
+}
+
+template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
+bool canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::apply_hw_config_delta(const uint8_t *delta,
+                                                                                     size_t size) {
+    std::vector<canfilter_delta_entry> entries;
+    if (size < CANFILTER_DELTA_HEADER_SIZE || delta[0] != dev_val || !(delta[3] & CANFILTER_IMAGE_DELTA) ||
+        !canfilter_delta_entries(delta, size, CANFILTER_DELTA_HEADER_SIZE, entries))
+        return false;
+    uint32_t nstd = delta[1];
+    uint32_t next = delta[2];
+    if (nstd > max_std_filter || next > max_ext_filter)
+        return false;
+    for (auto &e : entries)
+        if (e.kind > 1 || e.index >= (e.kind ? next : nstd))
+            return false;
+
+    for (uint32_t i = nstd; i < max_std_filter; i++)
+        hw_config.std_filter[i] = 0;
+    for (uint32_t i = next; i < max_ext_filter; i++)
+        hw_config.ext_filter[i][0] = hw_config.ext_filter[i][1] = 0;
+    for (auto &e : entries) {
+        if (e.kind == 0) {
+            hw_config.std_filter[e.index] = e.word[0];
+        } else {
+            hw_config.ext_filter[e.index][0] = e.word[0];
+            hw_config.ext_filter[e.index][1] = e.word[1];
+        }
+    }
+    hw_config.std_filter_nbr = nstd;
+    hw_config.ext_filter_nbr = next;
+
+    return true;
+}
+
 // Debug print function: Show configuration (e.g., filter registers)
 template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
 void canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::debug_print_reg() const {
@@ -254,14 +407,65 @@ void canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::debug_print() con
 }
 
 template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
-void canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::print_usage() const {
-    uint32_t std_percent = (hw_config.std_filter_nbr * 100 + max_std_filter / 2) / max_std_filter;
-    uint32_t ext_percent = (hw_config.ext_filter_nbr * 100 + max_ext_filter / 2) / max_ext_filter;
-
-    std::cout << "Filter usage: " << (int)hw_config.std_filter_nbr << "/" << max_std_filter << " standard ("
-              << std_percent << "%), " << (int)hw_config.ext_filter_nbr << "/" << max_ext_filter << " extended ("
-              << ext_percent << "%)" << std::endl;
-    return;
+void canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::get_ranges(std::vector<canfilter_range> &ranges) const {
+    ranges.clear();
+    for (uint32_t i = 0; i < hw_config.std_filter_nbr; ++i) {
+        uint32_t sfid1 = (hw_config.std_filter[i] >> 16) & max_std_id;
+        uint32_t sfid2 = (hw_config.std_filter[i] & max_std_id);
+        uint32_t sft = (hw_config.std_filter[i] >> 30) & 0x3;
+        if (sft == SFT_RANGE) {
+            ranges.push_back({sfid1, sfid2, false});
+        } else {
+            ranges.push_back({sfid1, sfid1, false});
+            if (sfid2 != sfid1)
+                ranges.push_back({sfid2, sfid2, false});
+        }
+    }
+    for (uint32_t i = 0; i < hw_config.ext_filter_nbr; ++i) {
+        uint32_t efid1 = hw_config.ext_filter[i][0] & max_ext_id;
+        uint32_t efid2 = hw_config.ext_filter[i][1] & max_ext_id;
+        uint32_t eft = (hw_config.ext_filter[i][1] >> 30) & 0x3;
+        if (eft == EFT_RANGE) {
+            ranges.push_back({efid1, efid2, true});
+        } else {
+            ranges.push_back({efid1, efid1, true});
+            if (efid2 != efid1)
+                ranges.push_back({efid2, efid2, true});
+        }
+    }
+}
+
+template <uint32_t max_std_filter, uint32_t max_ext_filter, uint32_t dev_val>
+void canfilter_fdcan<max_std_filter, max_ext_filter, dev_val>::get_stats(canfilter_stats &stats) const {
+    stats = canfilter_stats();
+    stats.dev = (canfilter_hardware_t)dev_val;
+    stats.std_used = hw_config.std_filter_nbr;
+    stats.std_total = max_std_filter;
+    stats.ext_used = hw_config.ext_filter_nbr;
+    stats.ext_total = max_ext_filter;
+
+    for (uint32_t i = 0; i < hw_config.std_filter_nbr; ++i) {
+        uint32_t sfid1 = (hw_config.std_filter[i] >> 16) & max_std_id;
+        uint32_t sfid2 = (hw_config.std_filter[i] & max_std_id);
+        if (((hw_config.std_filter[i] >> 30) & 0x3) == SFT_RANGE) {
+            stats.std_mask++;
+        } else {
+            stats.std_list++;
+            stats.padding += (sfid1 == sfid2);
+        }
+    }
+    for (uint32_t i = 0; i < hw_config.ext_filter_nbr; ++i) {
+        uint32_t efid1 = hw_config.ext_filter[i][0] & max_ext_id;
+        uint32_t efid2 = hw_config.ext_filter[i][1] & max_ext_id;
+        if (((hw_config.ext_filter[i][1] >> 30) & 0x3) == EFT_RANGE) {
+            stats.ext_mask++;
+        } else {
+            stats.ext_list++;
+            stats.padding += (efid1 == efid2);
+        }
+    }
+
+    count_ids(stats);
 }
 
 // Explicit template instantiation for G0 and H7
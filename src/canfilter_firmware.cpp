@@ -0,0 +1,436 @@
+/*
+ * canfilter_firmware.cpp
+ *
+ * Implements the firmware software filter tables and their C source.
+ *
+ * Responsibilities:
+ * - Fill the standard ID bitmap.
+ * - Build a perfect hash for single extended IDs and a sorted table for
+ *   extended ranges.
+ * - Emit both as C99 with a lookup function, and look up on the host with
+ *   the same arithmetic.
+ * - Benchmark host lookups against canfilter_classifier.
+ *
+ * Notes:
+ * - Hash: the lowbias32 integer mix. A key's bucket is the top bucket_bits
+ *   of hash(id, 0); its slot the top slot_bits of hash(id, pilot + 1).
+ *   Buckets are placed largest first, each with the first pilot that puts
+ *   all its keys in free slots. About four keys per bucket and a table of
+ *   the next power of two; if a bucket finds no pilot the table doubles.
+ * - The hash table is not minimal: up to half its slots are free. Free
+ *   slots hold 0xFFFFFFFF, which is not an extended ID.
+ * - Range search: begin of the range table padded with 0xFFFFFFFF, so
+ *   "begin[i + step] <= id" never walks into padding.
+ */
+
+#include "canfilter_firmware.hpp"
+#include "canfilter_classifier.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+// hex formatting macro
+#define FORMAT_HEX(val, width)                                                                                         \
+    "0x" << std::hex << std::uppercase << std::setw(width) << std::setfill('0') << (val) << std::dec                   \
+         << std::nouppercase << std::setfill(' ')
+
+static const uint32_t empty_key = 0xFFFFFFFFU;
+static const uint32_t max_pilot = 0xFFFF;
+static const uint32_t max_slot_bits = 16;
+
+static uint32_t fw_hash(uint32_t x, uint32_t seed) {
+    x ^= seed * 0x9E3779B9U;
+    x ^= x >> 16;
+    x *= 0x7FEB352DU;
+    x ^= x >> 15;
+    x *= 0x846CA68BU;
+    x ^= x >> 16;
+    return x;
+}
+
+canfilter_error_t canfilter_firmware::begin() {
+    blocks = 0;
+    has_std_ = false;
+    std::fill(std_bits_, std_bits_ + max_std_id / 32 + 1, 0);
+    bucket_bits_ = slot_bits_ = 0;
+    pilots_.clear();
+    keys_.clear();
+    range_begin_.clear();
+    range_end_.clear();
+    return ranges_.begin();
+}
+
+canfilter_error_t canfilter_firmware::add_std_id(uint32_t id) {
+    return ranges_.add_std_id(id);
+}
+
+canfilter_error_t canfilter_firmware::add_ext_id(uint32_t id) {
+    return ranges_.add_ext_id(id);
+}
+
+canfilter_error_t canfilter_firmware::add_std_range(uint32_t begin, uint32_t end) {
+    return ranges_.add_std_range(begin, end);
+}
+
+canfilter_error_t canfilter_firmware::add_ext_range(uint32_t begin, uint32_t end) {
+    return ranges_.add_ext_range(begin, end);
+}
+
+bool canfilter_firmware::build_hash(const std::vector<uint32_t> &keys) {
+    if (keys.empty())
+        return true;
+
+    uint32_t bits = 1;
+    while ((1U << bits) < keys.size())
+        bits++;
+
+    for (; bits <= max_slot_bits; bits++) {
+        slot_bits_ = bits;
+        bucket_bits_ = bits > 3 ? bits - 2 : 1;
+
+        std::vector<std::vector<uint32_t>> buckets(1U << bucket_bits_);
+        for (uint32_t key : keys)
+            buckets[fw_hash(key, 0) >> (32 - bucket_bits_)].push_back(key);
+        std::vector<uint32_t> order(buckets.size());
+        for (uint32_t b = 0; b < order.size(); b++)
+            order[b] = b;
+        std::stable_sort(order.begin(), order.end(),
+                         [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+
+        pilots_.assign(buckets.size(), 0);
+        keys_.assign(1U << slot_bits_, empty_key);
+        bool placed = true;
+        for (uint32_t b : order) {
+            if (buckets[b].empty())
+                break;
+            placed = false;
+            std::vector<uint32_t> slots;
+            for (uint32_t pilot = 0; pilot <= max_pilot && !placed; pilot++) {
+                slots.clear();
+                placed = true;
+                for (uint32_t key : buckets[b]) {
+                    uint32_t slot = fw_hash(key, pilot + 1) >> (32 - slot_bits_);
+                    if (keys_[slot] != empty_key || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+                        placed = false;
+                        break;
+                    }
+                    slots.push_back(slot);
+                }
+                if (placed) {
+                    pilots_[b] = pilot;
+                    for (size_t k = 0; k < slots.size(); k++)
+                        keys_[slots[k]] = buckets[b][k];
+                }
+            }
+            if (!placed)
+                break;
+        }
+        if (placed)
+            return true;
+    }
+
+    pilots_.clear();
+    keys_.clear();
+    return false;
+}
+
+canfilter_error_t canfilter_firmware::end() {
+    ranges_.normalize(true);
+    blocks = ranges_.ranges.size();
+
+    std::vector<uint32_t> single;
+    for (const auto &r : ranges_.ranges) {
+        if (!r.ext) {
+            has_std_ = true;
+            for (uint32_t id = r.begin; id <= r.end; id++)
+                std_bits_[id >> 5] |= 1U << (id & 31);
+        } else if (r.begin == r.end) {
+            single.push_back(r.begin);
+        } else {
+            range_begin_.push_back(r.begin);
+            range_end_.push_back(r.end);
+        }
+    }
+
+    if (!range_begin_.empty()) {
+        size_t size = 1;
+        while (size < range_begin_.size())
+            size <<= 1;
+        range_begin_.resize(size, empty_key);
+        range_end_.resize(size, 0);
+    }
+
+    if (!build_hash(single))
+        return CANFILTER_ERROR_FULL;
+
+    if (verbose)
+        std::cout << "firmware " << single.size() << " extended IDs in " << keys_.size() << " slots, "
+                  << range_begin_.size() << " extended range slots, " << table_bytes() << " bytes" << std::endl;
+
+    if (table_bytes() > flash_budget)
+        return CANFILTER_ERROR_FULL;
+    return CANFILTER_SUCCESS;
+}
+
+void *canfilter_firmware::get_hw_config() {
+    return nullptr;
+}
+
+size_t canfilter_firmware::get_hw_size() {
+    return 0;
+}
+
+void canfilter_firmware::debug_print_reg() const {
+    for (size_t b = 0; b < pilots_.size(); b++)
+        std::cout << "pilot " << std::setw(4) << b << ": " << pilots_[b] << std::endl;
+    for (size_t s = 0; s < keys_.size(); s++)
+        if (keys_[s] != empty_key)
+            std::cout << "slot " << std::setw(5) << s << ": " << FORMAT_HEX(keys_[s], 8) << std::endl;
+}
+
+void canfilter_firmware::debug_print() const {
+    ranges_.debug_print();
+}
+
+void canfilter_firmware::get_ranges(std::vector<canfilter_range> &ranges) const {
+    ranges = ranges_.ranges;
+}
+
+void canfilter_firmware::get_stats(canfilter_stats &stats) const {
+    stats = canfilter_stats();
+    stats.banks_used = table_bytes();
+    stats.banks_total = flash_budget;
+    for (const auto &r : ranges_.ranges) {
+        if (r.ext)
+            (r.begin == r.end ? stats.ext_list : stats.ext_mask)++;
+        else
+            (r.begin == r.end ? stats.std_list : stats.std_mask)++;
+    }
+    count_ids(stats);
+}
+
+uint32_t canfilter_firmware::table_bytes() const {
+    return (has_std_ ? sizeof(std_bits_) : 0) + pilots_.size() * sizeof(uint16_t) + keys_.size() * sizeof(uint32_t) +
+           range_begin_.size() * 2 * sizeof(uint32_t);
+}
+
+uint32_t canfilter_firmware::range_steps() const {
+    uint32_t steps = 0;
+    while ((1U << steps) < range_begin_.size())
+        steps++;
+    return steps;
+}
+
+bool canfilter_firmware::match(uint32_t can_id) const {
+    if (!(can_id & CANFILTER_CAN_EFF_FLAG)) {
+        uint32_t id = can_id & max_std_id;
+        return (std_bits_[id >> 5] >> (id & 31)) & 1;
+    }
+
+    uint32_t id = can_id & max_ext_id;
+    if (!keys_.empty()) {
+        uint32_t bucket = fw_hash(id, 0) >> (32 - bucket_bits_);
+        if (keys_[fw_hash(id, pilots_[bucket] + 1) >> (32 - slot_bits_)] == id)
+            return true;
+    }
+    if (range_begin_.empty())
+        return false;
+    uint32_t i = 0;
+    for (uint32_t step = range_begin_.size() / 2; step; step >>= 1)
+        if (range_begin_[i + step] <= id)
+            i += step;
+    return range_begin_[i] <= id && id <= range_end_[i];
+}
+
+bool canfilter_firmware::verify() const {
+    std::vector<std::pair<uint32_t, bool>> ids = {{0, false}, {max_std_id, false}, {0, true}, {max_ext_id, true}};
+    for (const auto &r : ranges_.ranges) {
+        uint32_t max_id = r.ext ? max_ext_id : max_std_id;
+        if (r.begin > 0)
+            ids.push_back({r.begin - 1, r.ext});
+        ids.push_back({r.begin, r.ext});
+        ids.push_back({r.end, r.ext});
+        if (r.end < max_id)
+            ids.push_back({r.end + 1, r.ext});
+    }
+
+    for (const auto &id : ids) {
+        uint32_t can_id = id.first | (id.second ? CANFILTER_CAN_EFF_FLAG : 0);
+        bool expected = accepts(id.first, id.second);
+        if (match(can_id) != expected || match(can_id | CANFILTER_CAN_RTR_FLAG) != expected)
+            return false;
+    }
+    return true;
+}
+
+// values as a C initializer, 8 per line
+template <typename T> static void print_table(std::ostream &out, const std::vector<T> &values, int width) {
+    for (size_t n = 0; n < values.size(); n++) {
+        out << (n % 8 ? " " : "    ") << FORMAT_HEX(values[n], width) << (width > 4 ? "u" : "") << ",";
+        if (n % 8 == 7 || n + 1 == values.size())
+            out << "\n";
+    }
+}
+
+void canfilter_firmware::print_source(std::ostream &out) const {
+    canfilter_stats stats;
+    get_stats(stats);
+    uint32_t ext_ids = std::count_if(keys_.begin(), keys_.end(), [](uint32_t key) { return key != empty_key; });
+    uint32_t ext_ranges = std::count_if(range_begin_.begin(), range_begin_.end(),
+                                        [](uint32_t begin) { return begin != empty_key; });
+
+    std::string ext_cost;
+    if (!keys_.empty())
+        ext_cost = "2 hashes, 2 table reads";
+    if (!range_begin_.empty())
+        ext_cost += (ext_cost.empty() ? "" : ", ") + std::to_string(range_steps() + 2) + " range table reads";
+
+    out << "/*\n"
+        << " * Generated by canfilter: software CAN filter for the adapter firmware.\n"
+        << " *\n"
+        << " * " << stats.std_ids << " standard IDs, " << ext_ids << " single extended IDs, " << ext_ranges
+        << (ext_ranges == 1 ? " extended range.\n" : " extended ranges.\n")
+        << " * Tables: " << table_bytes() << " bytes of flash, no RAM.\n"
+        << " * Standard frames: " << (has_std_ ? "1 table read" : "none")
+        << ". Extended frames: " << (ext_cost.empty() ? "none" : ext_cost) << ".\n"
+        << " *\n"
+        << " * " << prefix << "_match(can_id): can_id as in struct can_frame; CAN_EFF_FLAG\n"
+        << " * selects the format, CAN_RTR_FLAG and CAN_ERR_FLAG are ignored.\n"
+        << " */\n\n"
+        << "#include <stdbool.h>\n"
+        << "#include <stdint.h>\n\n";
+
+    if (has_std_) {
+        out << "static const uint32_t " << prefix << "_std[64] = {\n";
+        print_table(out, std::vector<uint32_t>(std_bits_, std_bits_ + max_std_id / 32 + 1), 8);
+        out << "};\n\n";
+    }
+
+    if (!keys_.empty()) {
+        out << "static const uint16_t " << prefix << "_pilot[" << pilots_.size() << "] = {\n";
+        print_table(out, pilots_, 4);
+        out << "};\n\n";
+        out << "static const uint32_t " << prefix << "_key[" << keys_.size() << "] = {\n";
+        print_table(out, keys_, 8);
+        out << "};\n\n";
+    }
+
+    if (!range_begin_.empty()) {
+        out << "static const uint32_t " << prefix << "_begin[" << range_begin_.size() << "] = {\n";
+        print_table(out, range_begin_, 8);
+        out << "};\n\n";
+        out << "static const uint32_t " << prefix << "_end[" << range_end_.size() << "] = {\n";
+        print_table(out, range_end_, 8);
+        out << "};\n\n";
+    }
+
+    if (!keys_.empty()) {
+        out << "static uint32_t " << prefix << "_hash(uint32_t x, uint32_t seed)\n"
+            << "{\n"
+            << "    x ^= seed * 0x9E3779B9u;\n"
+            << "    x ^= x >> 16;\n"
+            << "    x *= 0x7FEB352Du;\n"
+            << "    x ^= x >> 15;\n"
+            << "    x *= 0x846CA68Bu;\n"
+            << "    x ^= x >> 16;\n"
+            << "    return x;\n"
+            << "}\n\n";
+    }
+
+    out << "bool " << prefix << "_match(uint32_t can_id)\n"
+        << "{\n"
+        << "    uint32_t id;\n";
+    if (!keys_.empty())
+        out << "    uint32_t bucket;\n";
+    if (!range_begin_.empty())
+        out << "    uint32_t i = 0;\n";
+    out << "\n"
+        << "    if (!(can_id & 0x80000000u)) {\n";
+    if (has_std_)
+        out << "        id = can_id & 0x7FFu;\n"
+            << "        return (" << prefix << "_std[id >> 5] >> (id & 31)) & 1;\n";
+    else
+        out << "        return false;\n";
+    out << "    }\n\n"
+        << "    id = can_id & 0x1FFFFFFFu;\n";
+    if (!keys_.empty())
+        out << "    bucket = " << prefix << "_hash(id, 0) >> " << 32 - bucket_bits_ << ";\n"
+            << "    if (" << prefix << "_key[" << prefix << "_hash(id, " << prefix << "_pilot[bucket] + 1u) >> "
+            << 32 - slot_bits_ << "] == id)\n"
+            << "        return true;\n";
+    if (!range_begin_.empty()) {
+        for (uint32_t step = range_begin_.size() / 2; step; step >>= 1)
+            out << "    if (" << prefix << "_begin[i + " << step << "] <= id)\n"
+                << "        i += " << step << ";\n";
+        out << "    return " << prefix << "_begin[i] <= id && id <= " << prefix << "_end[i];\n";
+    } else {
+        out << "    return false;\n";
+    }
+    out << "}\n";
+}
+
+bool canfilter_firmware_bench(const canfilter_firmware &firmware, uint32_t lookups,
+                              canfilter_firmware_bench_result &result) {
+    result = canfilter_firmware_bench_result();
+    result.lookups = lookups;
+
+    std::vector<canfilter_range> ranges;
+    firmware.get_ranges(ranges);
+    canfilter_classifier classifier;
+    classifier.begin();
+    for (const auto &r : ranges) {
+        if (r.ext)
+            classifier.add_ext_range(r.begin, r.end);
+        else
+            classifier.add_std_range(r.begin, r.end);
+    }
+    if (classifier.end() != CANFILTER_SUCCESS)
+        return false;
+
+    std::vector<canfilter_range> ext;
+    for (const auto &r : ranges)
+        if (r.ext)
+            ext.push_back(r);
+
+    // xorshift, the same sequence every run
+    uint32_t state = 0x12345678;
+    auto next = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+    std::vector<uint32_t> can_ids(lookups);
+    for (auto &can_id : can_ids) {
+        uint32_t r = next();
+        if (r % 4 == 0 && !ext.empty()) {
+            const canfilter_range &range = ext[next() % ext.size()];
+            can_id = CANFILTER_CAN_EFF_FLAG | (range.begin + next() % ((uint64_t)range.end - range.begin + 1));
+        } else if (r % 4 == 1) {
+            can_id = CANFILTER_CAN_EFF_FLAG | (next() & canfilter::max_ext_id);
+        } else {
+            can_id = next() & canfilter::max_std_id;
+        }
+    }
+
+    std::vector<uint8_t> fw_accept(lookups), cl_accept(lookups);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < lookups; n++)
+        fw_accept[n] = firmware.match(can_ids[n]);
+    auto middle = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < lookups; n++)
+        cl_accept[n] = classifier.match(can_ids[n]);
+    auto stop = std::chrono::steady_clock::now();
+
+    for (uint32_t n = 0; n < lookups; n++) {
+        result.accepted += fw_accept[n];
+        result.mismatches += fw_accept[n] != cl_accept[n];
+    }
+    if (lookups) {
+        result.firmware_ns = std::chrono::duration<double, std::nano>(middle - start).count() / lookups;
+        result.classifier_ns = std::chrono::duration<double, std::nano>(stop - middle).count() / lookups;
+    }
+    return result.mismatches == 0;
+}
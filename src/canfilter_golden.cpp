@@ -0,0 +1,196 @@
+/*
+ * canfilter_golden.cpp
+ *
+ * Implements the golden-image regression corpus.
+ *
+ * Responsibilities:
+ * - Read and write corpus files of specifications and expected images.
+ * - Rebuild images for every controller type and compare them byte by byte.
+ * - Flag changed images and specifications that need more banks than before.
+ * - Check that the compact image of every case expands to the full image.
+ *
+ * Notes:
+ * - Images are compared as hex strings of get_hw_config()/get_hw_size().
+ * - Specifications are compiled the same way the command line does:
+ *   parse, normalize, compile.
+ */
+
+#include "canfilter_golden.hpp"
+#include "canfilter_device.hpp"
+#include "canfilter_ranges.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+bool canfilter_golden::load(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in)
+        return false;
+
+    entries.clear();
+    trailer.clear();
+    std::vector<std::string> comments;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string tag;
+        if (!(ls >> tag) || tag[0] == '#') {
+            comments.push_back(line);
+            continue;
+        }
+
+        if (tag == "spec") {
+            entry_t entry;
+            entry.comments.swap(comments);
+            std::getline(ls >> std::ws, entry.spec);
+            entries.push_back(entry);
+            continue;
+        }
+
+        image_t image;
+        image.dev = canfilter_device_from_name(tag);
+        if (image.dev == CANFILTER_DEV_NONE || entries.empty()) {
+            std::cerr << filename << ": unexpected line: " << line << std::endl;
+            return false;
+        }
+        std::string usage;
+        ls >> usage;
+        if (usage != "full") {
+            image.usage = usage;
+            ls >> image.hex;
+        }
+        entries.back().images.push_back(image);
+    }
+    trailer.swap(comments);
+
+    return true;
+}
+
+bool canfilter_golden::build(const std::string &spec, canfilter_hardware_t dev, image_t &image) {
+    image.dev = dev;
+    image.usage.clear();
+    image.hex.clear();
+
+    canfilter_ranges ranges;
+    ranges.begin();
+    if (!ranges.parse(spec))
+        return false;
+    ranges.end();
+
+    std::unique_ptr<canfilter> filter(canfilter_create(dev));
+    canfilter_error_t err = ranges.compile(*filter);
+    if (err == CANFILTER_ERROR_FULL)
+        return true;
+    if (err != CANFILTER_SUCCESS)
+        return false;
+
+    canfilter_stats stats;
+    filter->get_stats(stats);
+    if (stats.banks_total)
+        image.usage = std::to_string(stats.banks_used);
+    else
+        image.usage = std::to_string(stats.std_used) + "+" + std::to_string(stats.ext_used);
+
+    static const char digits[] = "0123456789abcdef";
+    const uint8_t *p = (const uint8_t *)filter->get_hw_config();
+    size_t size = filter->get_hw_size();
+    for (size_t i = 0; i < size; i++) {
+        image.hex += digits[p[i] >> 4];
+        image.hex += digits[p[i] & 0xf];
+    }
+
+    // compact image round trip
+    std::vector<uint8_t> compact;
+    filter->get_hw_config_compact(compact);
+    std::unique_ptr<canfilter> loaded(canfilter_create(dev));
+    image.compact_ok = loaded->set_hw_config_compact(compact.data(), compact.size()) &&
+                       loaded->get_hw_size() == size && std::memcmp(loaded->get_hw_config(), p, size) == 0;
+
+    return true;
+}
+
+// true if any component of actual usage is larger than expected
+bool canfilter_golden::more_banks(const std::string &expected, const std::string &actual) {
+    if (expected.empty())
+        return false; // was full
+    if (actual.empty())
+        return true; // now full
+
+    std::istringstream e(expected), a(actual);
+    uint32_t ev, av;
+    char sep;
+    while (e >> ev && a >> av) {
+        if (av > ev)
+            return true;
+        e >> sep;
+        a >> sep;
+    }
+    return false;
+}
+
+bool canfilter_golden::check() {
+    uint32_t checked = 0;
+    uint32_t changed = 0;
+
+    for (const auto &entry : entries) {
+        for (const auto &expected : entry.images) {
+            image_t actual;
+            const char *name = canfilter_device_name(expected.dev);
+            checked++;
+            if (!build(entry.spec, expected.dev, actual)) {
+                std::cout << "FAIL  " << name << " spec " << entry.spec << ": does not compile" << std::endl;
+                changed++;
+                continue;
+            }
+
+            std::string was = expected.usage.empty() ? "full" : expected.usage;
+            std::string now = actual.usage.empty() ? "full" : actual.usage;
+            if (more_banks(expected.usage, actual.usage)) {
+                std::cout << "BANKS " << name << " spec " << entry.spec << ": " << was << " -> " << now << std::endl;
+                changed++;
+            } else if (actual.usage != expected.usage || actual.hex != expected.hex) {
+                std::cout << "IMAGE " << name << " spec " << entry.spec << ": image changed (" << was << " -> " << now
+                          << ")" << std::endl;
+                changed++;
+            } else if (!actual.compact_ok) {
+                std::cout << "COMPACT " << name << " spec " << entry.spec << ": compact image differs" << std::endl;
+                changed++;
+            } else if (verbose) {
+                std::cout << "ok    " << name << " spec " << entry.spec << std::endl;
+            }
+        }
+    }
+
+    std::cout << checked - changed << "/" << checked << " golden images unchanged" << std::endl;
+    return changed == 0;
+}
+
+bool canfilter_golden::save(const std::string &filename) {
+    std::ofstream out(filename);
+    if (!out)
+        return false;
+
+    for (const auto &entry : entries) {
+        for (const auto &comment : entry.comments)
+            out << comment << std::endl;
+        out << "spec " << entry.spec << std::endl;
+        for (canfilter_hardware_t dev : canfilter_device_list) {
+            image_t image;
+            if (!build(entry.spec, dev, image)) {
+                std::cerr << "error: spec " << entry.spec << " does not compile" << std::endl;
+                return false;
+            }
+            out << canfilter_device_name(dev) << " ";
+            if (image.usage.empty())
+                out << "full" << std::endl;
+            else
+                out << image.usage << " " << image.hex << std::endl;
+        }
+    }
+    for (const auto &comment : trailer)
+        out << comment << std::endl;
+
+    return true;
+}
@@ -0,0 +1,184 @@
+/*
+ * canfilter_hybrid.cpp
+ *
+ * Implements the split of a specification into hardware superset and host residual.
+ *
+ * Responsibilities:
+ * - Compile the specification; if the controller is full, close the
+ *   cheapest gaps between neighbouring ranges until it fits.
+ * - Decode the ranges the hardware filter accepts and subtract the
+ *   specification, giving the IDs the host must drop.
+ *
+ * Notes:
+ * - Fit is searched with a binary search over the number of gaps closed,
+ *   cheapest first. On bxCAN a merged range can need more mask banks than
+ *   the IDs it replaces, so fit is not strictly monotonic; the search only
+ *   returns a count that was compiled and fits.
+ * - If closing every gap is not enough, each frame format becomes the
+ *   smallest aligned block holding all its ranges: one mask, which every
+ *   controller can hold.
+ */
+
+#include "canfilter_hybrid.hpp"
+#include "canfilter_device.hpp"
+#include <algorithm>
+#include <memory>
+
+// Gap between ranges[index - 1] and ranges[index]
+struct canfilter_gap {
+    size_t index;
+    double rate; // frames per second in the gap
+    uint64_t ids;
+};
+
+static canfilter_error_t fits(const canfilter_ranges &spec, canfilter_hardware_t dev,
+                              std::vector<canfilter_range> *accepted = nullptr) {
+    std::unique_ptr<canfilter> filter(canfilter_create(dev));
+    if (!filter)
+        return CANFILTER_ERROR_PARAM;
+    canfilter_error_t err = spec.compile(*filter);
+    if (err == CANFILTER_SUCCESS && accepted)
+        filter->get_ranges(*accepted);
+    return err;
+}
+
+// ranges with the first count gaps closed
+static void close_gaps(const std::vector<canfilter_range> &ranges, const std::vector<canfilter_gap> &gaps,
+                       size_t count, canfilter_ranges &out) {
+    std::vector<bool> closed(ranges.size(), false);
+    for (size_t n = 0; n < count; n++)
+        closed[gaps[n].index] = true;
+
+    out.begin(); // also compile the normalized ranges
+    for (size_t n = 0; n < ranges.size(); n++) {
+        if (closed[n])
+            out.ranges.back().end = ranges[n].end;
+        else
+            out.ranges.push_back(ranges[n]);
+    }
+    out.blocks = out.ranges.size();
+}
+
+// Smallest aligned block holding begin and end
+static void widen(canfilter_range &r) {
+    uint32_t mask = 0xFFFFFFFFU;
+    while ((r.begin & mask) != (r.end & mask))
+        mask <<= 1;
+    r.begin &= mask;
+    r.end |= ~mask & (r.ext ? canfilter::max_ext_id : canfilter::max_std_id);
+}
+
+canfilter_error_t canfilter_hybrid::split(const canfilter_ranges &spec, canfilter_hardware_t dev,
+                                          const canfilter_load *load) {
+    std::vector<canfilter_id_rate> rates;
+    if (load) {
+        for (const auto &msg : load->messages)
+            if (msg.cycle_ms)
+                rates.push_back({msg.id, msg.ext, 1000.0 / msg.cycle_ms});
+    }
+    return split(spec, dev, rates);
+}
+
+canfilter_error_t canfilter_hybrid::split(const canfilter_ranges &spec, canfilter_hardware_t dev,
+                                          const std::vector<canfilter_id_rate> &rates) {
+    hardware = spec;
+    residual.clear();
+    merges = 0;
+    widened = false;
+
+    canfilter_error_t err = fits(hardware, dev);
+    if (err != CANFILTER_ERROR_FULL)
+        return err;
+
+    // gaps between neighbours of the same format, cheapest first
+    const std::vector<canfilter_range> &ranges = spec.ranges;
+    std::vector<canfilter_gap> gaps;
+    for (size_t n = 1; n < ranges.size(); n++) {
+        const canfilter_range &prev = ranges[n - 1];
+        const canfilter_range &next = ranges[n];
+        if (prev.ext != next.ext)
+            continue;
+        canfilter_gap gap = {n, 0, (uint64_t)next.begin - prev.end - 1};
+        for (const auto &r : rates)
+            if (r.ext == next.ext && r.id > prev.end && r.id < next.begin)
+                gap.rate += r.rate;
+        gaps.push_back(gap);
+    }
+    std::stable_sort(gaps.begin(), gaps.end(), [](const canfilter_gap &a, const canfilter_gap &b) {
+        return a.rate != b.rate ? a.rate < b.rate : a.ids < b.ids;
+    });
+
+    // Candidates are compiled from the normalized ranges, which can pack
+    // differently from the command line order; try them without merging
+    close_gaps(ranges, gaps, 0, hardware);
+    err = fits(hardware, dev);
+    if (err != CANFILTER_ERROR_FULL)
+        return err;
+
+    // lo gaps closed does not fit, hi gaps closed fits
+    size_t lo = 0, hi = gaps.size();
+    close_gaps(ranges, gaps, hi, hardware);
+    err = fits(hardware, dev);
+    if (err == CANFILTER_SUCCESS) {
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            canfilter_ranges candidate;
+            close_gaps(ranges, gaps, mid, candidate);
+            if (fits(candidate, dev) == CANFILTER_SUCCESS)
+                hi = mid;
+            else
+                lo = mid;
+        }
+        close_gaps(ranges, gaps, hi, hardware);
+        merges = hi;
+    } else if (err == CANFILTER_ERROR_FULL) {
+        merges = gaps.size();
+        widened = true;
+        for (auto &r : hardware.ranges)
+            widen(r);
+    } else {
+        return err;
+    }
+
+    // residual: accepted by the hardware filter, not by the specification
+    canfilter_ranges accepted;
+    err = fits(hardware, dev, &accepted.ranges);
+    if (err != CANFILTER_SUCCESS)
+        return err;
+    accepted.normalize(true);
+    canfilter_ranges wanted = spec;
+    wanted.normalize(true);
+
+    auto want = wanted.ranges.begin();
+    for (canfilter_range r : accepted.ranges) {
+        // ranges are sorted standard first, then by begin
+        while (want != wanted.ranges.end() && (want->ext < r.ext || (want->ext == r.ext && want->end < r.begin)))
+            ++want;
+        uint64_t begin = r.begin;
+        for (auto w = want; w != wanted.ranges.end() && w->ext == r.ext && w->begin <= r.end; ++w) {
+            if (w->begin > begin)
+                residual.push_back({(uint32_t)begin, w->begin - 1, r.ext});
+            begin = std::max(begin, (uint64_t)w->end + 1);
+        }
+        if (begin <= r.end)
+            residual.push_back({(uint32_t)begin, r.end, r.ext});
+    }
+    return CANFILTER_SUCCESS;
+}
+
+uint64_t canfilter_hybrid::residual_ids(bool ext) const {
+    uint64_t ids = 0;
+    for (const auto &r : residual)
+        if (r.ext == ext)
+            ids += (uint64_t)r.end - r.begin + 1;
+    return ids;
+}
+
+void canfilter_hybrid::print(std::ostream &out) const {
+    if (exact()) {
+        out << "Hybrid: filter fits, no host filter needed" << std::endl;
+        return;
+    }
+    out << "Hybrid: " << merges << " gaps merged" << (widened ? " and widened to one mask" : "") << ", host drops "
+        << residual_ids(false) << " standard and " << residual_ids(true) << " extended IDs" << std::endl;
+}
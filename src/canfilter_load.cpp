@@ -0,0 +1,183 @@
+/*
+ * canfilter_load.cpp
+ *
+ * Predicts host load behind a hardware filter from DBC message cycle times.
+ *
+ * Responsibilities:
+ * - Parse BO_ (message) and GenMsgCycleTime attributes from a DBC file.
+ * - Sum frame rate, bus load and gs_usb byte rate of the accepted messages.
+ * - Compare against the USB full-speed bulk budget and the rx FIFO depth.
+ *
+ * Notes:
+ * - Frame length uses the worst-case bit stuffing formula for classic CAN.
+ *   CAN FD payloads are counted at the nominal bitrate, which overestimates.
+ * - Host frames are gs_host_frame with hardware timestamp; CAN FD frames
+ *   carry 64 instead of 8 data bytes.
+ * - Worst case burst assumes all accepted messages become due at the same time.
+ */
+
+#include "canfilter_load.hpp"
+#include "gs_usb.hpp"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+// usb full speed bulk: 64 byte packets, at most 19 packets per 1 ms frame
+#define USB_FS_PACKET_SIZE 64U
+#define USB_FS_PACKETS_PER_SEC 19000.0
+
+// gs_usb host frame carrying payload bytes
+static uint32_t host_frame_size(uint32_t payload) {
+    return sizeof(gs_host_frame) - sizeof(gs_host_frame::data) + (payload > 8 ? 64 : 8);
+}
+
+// rx fifo depth
+static uint32_t fifo_depth(canfilter_hardware_t dev) {
+    switch (dev) {
+        case CANFILTER_DEV_FDCAN_H7:
+            return 64; // message RAM, configured by firmware
+        case CANFILTER_DEV_BXCAN_F0:
+        case CANFILTER_DEV_BXCAN_F4:
+        case CANFILTER_DEV_FDCAN_G0:
+        default:
+            return 3;
+    }
+}
+
+bool canfilter_load::parse_dbc(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in)
+        return false;
+
+    uint32_t default_cycle = 0;
+    std::map<uint32_t, uint32_t> cycle; // raw dbc id -> cycle time
+    std::vector<uint32_t> raw_ids;
+    std::string line;
+
+    messages.clear();
+    while (std::getline(in, line)) {
+        std::istringstream ls(line);
+        std::string tag;
+        ls >> tag;
+        if (tag == "BO_") {
+            // BO_ <id> <name>: <size> <transmitter>
+            uint32_t raw_id;
+            std::string name;
+            uint32_t size;
+            if (!(ls >> raw_id >> name >> size))
+                continue;
+            if (!name.empty() && name.back() == ':')
+                name.pop_back();
+            if (name == "VECTOR__INDEPENDENT_SIG_MSG")
+                continue;
+            canfilter_message msg;
+            msg.ext = raw_id & 0x80000000U;
+            msg.id = raw_id & (msg.ext ? canfilter::max_ext_id : canfilter::max_std_id);
+            msg.size = size;
+            msg.cycle_ms = 0;
+            msg.name = name;
+            messages.push_back(msg);
+            raw_ids.push_back(raw_id);
+        } else if (tag == "BA_DEF_DEF_") {
+            // BA_DEF_DEF_ "GenMsgCycleTime" <value>;
+            std::string attr;
+            uint32_t value;
+            if (ls >> attr >> value && attr == "\"GenMsgCycleTime\"")
+                default_cycle = value;
+        } else if (tag == "BA_") {
+            // BA_ "GenMsgCycleTime" BO_ <id> <value>;
+            std::string attr, obj;
+            uint32_t raw_id, value;
+            if (ls >> attr >> obj >> raw_id >> value && attr == "\"GenMsgCycleTime\"" && obj == "BO_")
+                cycle[raw_id] = value;
+        }
+    }
+
+    for (size_t i = 0; i < messages.size(); i++) {
+        auto it = cycle.find(raw_ids[i]);
+        messages[i].cycle_ms = (it != cycle.end()) ? it->second : default_cycle;
+    }
+
+    return true;
+}
+
+// Worst-case frame length in bits, including bit stuffing and intermission
+uint32_t canfilter_load::frame_bits(const canfilter_message &msg) const {
+    uint32_t data_bits = 8 * msg.size;
+    if (msg.ext)
+        return 64 + data_bits + (54 + data_bits - 1) / 4 + 3;
+    else
+        return 44 + data_bits + (34 + data_bits - 1) / 4 + 3;
+}
+
+void canfilter_load::estimate(const canfilter *filter, canfilter_hardware_t dev, canfilter_load_result &result) const {
+    result = canfilter_load_result();
+    uint32_t min_bits = 0;
+    double bits_per_sec = 0;
+    double packets_per_sec = 0;
+
+    for (const auto &msg : messages) {
+        if (filter && !filter->accepts(msg.id, msg.ext))
+            continue;
+
+        uint32_t bits = frame_bits(msg);
+        if (min_bits == 0 || bits < min_bits)
+            min_bits = bits;
+
+        result.messages++;
+        result.burst++;
+        if (msg.cycle_ms == 0)
+            continue;
+
+        uint32_t host_size = host_frame_size(msg.size);
+        double rate = 1000.0 / msg.cycle_ms;
+        result.periodic++;
+        result.frames_per_sec += rate;
+        result.bytes_per_sec += rate * host_size;
+        bits_per_sec += rate * bits;
+        packets_per_sec += rate * ((host_size + USB_FS_PACKET_SIZE - 1) / USB_FS_PACKET_SIZE);
+    }
+
+    if (bitrate)
+        result.bus_load = bits_per_sec / bitrate;
+    result.usb_load = packets_per_sec / USB_FS_PACKETS_PER_SEC;
+
+    // time until back-to-back frames fill the rx fifo
+    uint32_t depth = fifo_depth(dev);
+    if (bitrate && min_bits)
+        result.fifo_deadline_us = 1e6 * depth * min_bits / bitrate;
+
+    // a burst deeper than the fifo that fills it within the isr latency overruns
+    if (result.burst > depth && result.fifo_deadline_us < isr_latency_us)
+        result.fifo_risk = "high";
+    else if (result.burst > depth)
+        result.fifo_risk = "low";
+    else
+        result.fifo_risk = "none";
+
+    if (result.usb_load >= 1.0)
+        result.usb_risk = "high";
+    else if (result.usb_load >= 0.5)
+        result.usb_risk = "medium";
+    else
+        result.usb_risk = "none";
+}
+
+void canfilter_load::print_header() {
+    std::cout << std::left << std::setw(10) << "filter" << std::right << std::setw(10) << "messages" << std::setw(12)
+              << "frames/s" << std::setw(12) << "bytes/s" << std::setw(8) << "bus" << std::setw(8) << "usb"
+              << std::setw(8) << "burst" << std::setw(12) << "fifo(us)" << "  fifo risk  usb risk" << std::endl;
+}
+
+void canfilter_load::print(const std::string &label, const canfilter_load_result &result) {
+    std::cout << std::left << std::setw(10) << label << std::right << std::setw(10) << result.messages
+              << std::fixed << std::setprecision(1) << std::setw(12) << result.frames_per_sec << std::setw(12)
+              << result.bytes_per_sec << std::setw(7) << 100 * result.bus_load << "%" << std::setw(7)
+              << 100 * result.usb_load << "%" << std::setw(8) << result.burst << std::setw(12)
+              << result.fifo_deadline_us << "  " << std::left << std::setw(9) << result.fifo_risk << "  "
+              << result.usb_risk << std::right << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+}
@@ -0,0 +1,93 @@
+/*
+ * canfilter_meter.cpp
+ *
+ * Implements the bulk IN receive meter.
+ *
+ * Responsibilities:
+ * - Keep a fixed number of bulk transfers in flight, one per ring slot.
+ * - Decode received host frames where USB wrote them and count frames,
+ *   bytes and overflow flags.
+ * - Drain all transfers before returning, so the ring can be reused.
+ *
+ * Notes:
+ * - A transfer that times out is resubmitted; a failed one is counted and
+ *   its slot stays idle, so a lost device ends the measurement early.
+ * - The time measured ends when the last transfer is drained.
+ */
+
+#include "canfilter_meter.hpp"
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <libusb-1.0/libusb.h>
+
+static void decode(const unsigned char *data, int length, canfilter_meter_result &result) {
+    if (length < GS_HOST_FRAME_HEADER)
+        return;
+    const gs_host_frame *frame = (const gs_host_frame *)data;
+    if (frame->echo_id != GS_HOST_FRAME_RX)
+        return;
+    result.frames++;
+    result.bytes += length;
+    if (frame->flags & GS_CAN_FLAG_OVERFLOW)
+        result.overflows++;
+}
+
+bool canfilter_meter::run(usb_transport &usb, uint32_t duration_ms, canfilter_meter_result &result) {
+    result = canfilter_meter_result();
+    ring_.assign((size_t)transfers * slot_size, 0);
+
+    bool running = true;
+    unsigned int pending = 0;
+    std::function<void(unsigned int)> submit = [&](unsigned int slot) {
+        unsigned char *data = &ring_[(size_t)slot * slot_size];
+        bool submitted = usb.submit_bulk_transfer(endpoint, data, slot_size, timeout_ms, [&, slot, data](int ret) {
+            pending--;
+            if (ret > 0)
+                decode(data, ret, result);
+            else if (ret != LIBUSB_ERROR_TIMEOUT)
+                result.errors++;
+            if (running && (ret >= 0 || ret == LIBUSB_ERROR_TIMEOUT))
+                submit(slot);
+        });
+        if (submitted)
+            pending++;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto until = start + std::chrono::milliseconds(duration_ms);
+    for (unsigned int slot = 0; slot < transfers; slot++)
+        submit(slot);
+    if (pending == 0)
+        return false;
+
+    while (pending && std::chrono::steady_clock::now() < until)
+        usb.handle_events(10);
+    running = false;
+    while (pending)
+        usb.handle_events(timeout_ms);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.seconds = elapsed.count();
+    if (result.seconds > 0) {
+        result.frames_per_sec = result.frames / result.seconds;
+        result.bytes_per_sec = result.bytes / result.seconds;
+    }
+    return true;
+}
+
+void canfilter_meter::print_header() {
+    std::cout << std::left << std::setw(10) << "filter" << std::right << std::setw(10) << "seconds" << std::setw(10)
+              << "frames" << std::setw(12) << "frames/s" << std::setw(12) << "bytes/s" << std::setw(10)
+              << "overflow" << std::setw(8) << "errors" << std::endl;
+}
+
+void canfilter_meter::print(const std::string &label, const canfilter_meter_result &result) {
+    std::cout << std::left << std::setw(10) << label << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << result.seconds << std::setw(10) << result.frames << std::setprecision(1)
+              << std::setw(12) << result.frames_per_sec << std::setw(12) << result.bytes_per_sec << std::setw(10)
+              << result.overflows << std::setw(8) << result.errors << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+}
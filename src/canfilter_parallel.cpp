@@ -0,0 +1,133 @@
+/*
+ * canfilter_parallel.cpp
+ *
+ * Implements concurrent programming of many adapters.
+ *
+ * Responsibilities:
+ * - Start one worker thread per adapter.
+ * - Compile the image once per controller type, shared by all workers.
+ * - Collect and print per-adapter results.
+ *
+ * Notes:
+ * - libusb is thread safe; every worker uses its own device handle.
+ * - Each worker reattaches the kernel driver of its adapter when done.
+ */
+
+#include "canfilter_parallel.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+canfilter_parallel::canfilter_parallel(const canfilter_ranges &spec, canfilter_hardware_t dev)
+    : spec_(spec), dev_(dev) {}
+
+const canfilter_image &canfilter_parallel::image(canfilter_hardware_t dev) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = images_.find(dev);
+    if (it == images_.end()) {
+        it = images_.insert(std::make_pair((int)dev, canfilter_image())).first;
+        canfilter_compile(dev, spec_, it->second);
+    }
+    return it->second;
+}
+
+void canfilter_parallel::program_one(canfilter_usb &usb, canfilter_parallel_result &result) {
+    usb.timeout_ms = timeout_ms;
+    usb.retries = retries;
+    usb.skip_unchanged = skip_unchanged;
+
+    canfilter_error_t err;
+    result.dev = dev_;
+    if (result.dev == CANFILTER_DEV_NONE) {
+        // image lookup overlaps the capability query
+        uint32_t filter_type = CANFILTER_DEV_NONE;
+        err = usb.queryAndProgram(
+            [this](uint32_t type, canfilter_image &img) {
+                img = image((canfilter_hardware_t)type);
+                return img.error;
+            },
+            &filter_type);
+        result.dev = (canfilter_hardware_t)filter_type;
+    } else {
+        const canfilter_image &img = image(result.dev);
+        err = img.error;
+        if (err == CANFILTER_SUCCESS && !usb.programImage(img))
+            err = CANFILTER_ERROR_PLATFORM;
+    }
+
+    result.success = (err == CANFILTER_SUCCESS);
+    result.status = canfilter_program_status(err, result.dev, usb.unchanged);
+}
+
+bool canfilter_parallel::program(const std::vector<usb_device_info> &devices) {
+    results.assign(devices.size(), canfilter_parallel_result());
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < devices.size(); i++) {
+        workers.push_back(std::thread([this, &devices, i]() {
+            auto start = std::chrono::steady_clock::now();
+            canfilter_parallel_result &result = results[i];
+            result.name = devices[i].path;
+            result.serial = devices[i].serial;
+
+            canfilter_usb usb;
+            if (usb.open(devices[i]))
+                program_one(usb, result);
+            else
+                result.status = "open failed";
+            usb.close();
+
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            result.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        }));
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+        success = success && results[i].success;
+    }
+
+    return success;
+}
+
+bool canfilter_parallel::program(const std::vector<usb_transport *> &transports) {
+    results.assign(transports.size(), canfilter_parallel_result());
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < transports.size(); i++) {
+        workers.push_back(std::thread([this, &transports, i]() {
+            auto start = std::chrono::steady_clock::now();
+            canfilter_parallel_result &result = results[i];
+            result.name = "sim" + std::to_string(i);
+
+            canfilter_usb usb;
+            usb.set_transport(transports[i]);
+            program_one(usb, result);
+
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            result.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        }));
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+        success = success && results[i].success;
+    }
+
+    return success;
+}
+
+void canfilter_parallel::print_results() const {
+    std::cout << std::left << std::setw(12) << "device" << std::setw(20) << "serial" << std::setw(10) << "filter"
+              << std::setw(20) << "result" << std::right << std::setw(10) << "ms" << std::endl;
+    for (const auto &r : results) {
+        std::cout << std::left << std::setw(12) << r.name << std::setw(20) << (r.serial.empty() ? "-" : r.serial)
+                  << std::setw(10) << canfilter_device_name(r.dev) << std::setw(20) << r.status << std::right
+                  << std::fixed << std::setprecision(1) << std::setw(10) << r.duration_us / 1000.0 << std::endl;
+    }
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+}
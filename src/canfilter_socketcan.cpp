@@ -0,0 +1,227 @@
+/*
+ * canfilter_socketcan.cpp
+ *
+ * Implements SocketCAN CAN_RAW socket filters.
+ *
+ * Responsibilities:
+ * - Merge ranges and convert them to id/mask pairs with CIDR aggregation.
+ * - Decode the filters back into ranges and count usage.
+ * - Print the filters as candump arguments.
+ * - Apply the filters to a CAN_RAW socket on Linux.
+ *
+ * Notes:
+ * - A filter matches a frame if (frame.can_id & can_mask) == (can_id & can_mask).
+ *   CAN_EFF_FLAG is always in the mask, so standard and extended filters
+ *   only match their own frame format. CAN_RTR_FLAG is not in the mask.
+ * - Socket filters belong to the socket: they filter frames for the program
+ *   that owns it, not for the interface.
+ * - candump sets CAN_EFF_FLAG on ids written with 8 digits.
+ */
+
+#include "canfilter_socketcan.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static_assert(sizeof(struct can_filter) == sizeof(canfilter_socketcan_filter), "can_filter layout");
+static_assert(CAN_EFF_FLAG == CANFILTER_CAN_EFF_FLAG, "CAN_EFF_FLAG");
+#endif
+
+// hex formatting macro
+#define FORMAT_HEX(val, width)                                                                                         \
+    "0x" << std::hex << std::setw(width) << std::setfill('0') << (val) << std::dec << std::setfill(' ')
+
+canfilter_error_t canfilter_socketcan::begin() {
+    filters.clear();
+    blocks = 0;
+    return ranges_.begin();
+}
+
+canfilter_error_t canfilter_socketcan::add_std_id(uint32_t id) {
+    return ranges_.add_std_id(id);
+}
+
+canfilter_error_t canfilter_socketcan::add_ext_id(uint32_t id) {
+    return ranges_.add_ext_id(id);
+}
+
+canfilter_error_t canfilter_socketcan::add_std_range(uint32_t begin, uint32_t end) {
+    return ranges_.add_std_range(begin, end);
+}
+
+canfilter_error_t canfilter_socketcan::add_ext_range(uint32_t begin, uint32_t end) {
+    return ranges_.add_ext_range(begin, end);
+}
+
+canfilter_error_t canfilter_socketcan::end() {
+    // adjacent ranges make larger blocks: 0x100-0x17f and 0x180-0x1ff is one filter
+    ranges_.normalize(true);
+
+    /* CIDR aggregation: range to network algorithm */
+    filters.clear();
+    for (const auto &r : ranges_.ranges) {
+        uint32_t max_id = r.ext ? max_ext_id : max_std_id;
+        uint64_t begin = r.begin;
+        while (begin <= r.end) {
+            // largest aligned block starting at begin that fits in the range
+            uint64_t size = begin ? (begin & (~begin + 1)) : (uint64_t)max_id + 1;
+            while (begin + size - 1 > r.end)
+                size >>= 1;
+            uint32_t mask = ~(uint32_t)(size - 1) & max_id;
+            filters.push_back({(uint32_t)begin | (r.ext ? CANFILTER_CAN_EFF_FLAG : 0), mask | CANFILTER_CAN_EFF_FLAG});
+            blocks++;
+            if (verbose)
+                std::cout << "socketcan " << (r.ext ? "ext" : "std") << " id " << FORMAT_HEX(begin, r.ext ? 8 : 3)
+                          << " mask " << FORMAT_HEX(mask, r.ext ? 8 : 3) << std::endl;
+            begin += size;
+        }
+    }
+
+    if (filters.size() > max_filters) {
+        if (verbose)
+            std::cout << "socketcan filter fail: " << filters.size() << " filters" << std::endl;
+        return CANFILTER_ERROR_FULL;
+    }
+    return CANFILTER_SUCCESS;
+}
+
+void *canfilter_socketcan::get_hw_config() {
+    return filters.data();
+}
+
+size_t canfilter_socketcan::get_hw_size() {
+    return filters.size() * sizeof(canfilter_socketcan_filter);
+}
+
+void canfilter_socketcan::debug_print_reg() const {
+    for (size_t i = 0; i < filters.size(); i++)
+        std::cout << "filter " << i << " can_id " << FORMAT_HEX(filters[i].can_id, 8) << " can_mask "
+                  << FORMAT_HEX(filters[i].can_mask, 8) << std::endl;
+}
+
+void canfilter_socketcan::debug_print() const {
+    std::vector<canfilter_range> ranges;
+    get_ranges(ranges);
+    std::cout << std::endl << "socket filters:" << std::endl;
+    for (const auto &r : ranges) {
+        int width = r.ext ? 8 : 3;
+        std::cout << (r.ext ? "ext " : "std ") << FORMAT_HEX(r.begin, width);
+        if (r.end != r.begin)
+            std::cout << " - " << FORMAT_HEX(r.end, width);
+        std::cout << std::endl;
+    }
+}
+
+void canfilter_socketcan::get_ranges(std::vector<canfilter_range> &ranges) const {
+    ranges.clear();
+    for (const auto &f : filters) {
+        bool ext = f.can_id & CANFILTER_CAN_EFF_FLAG;
+        uint32_t max_id = ext ? max_ext_id : max_std_id;
+        uint32_t id = f.can_id & f.can_mask & max_id;
+        ranges.push_back({id, id | (~f.can_mask & max_id), ext});
+    }
+}
+
+void canfilter_socketcan::get_stats(canfilter_stats &stats) const {
+    stats = canfilter_stats();
+    stats.banks_used = filters.size();
+    stats.banks_total = max_filters;
+    for (const auto &f : filters) {
+        bool ext = f.can_id & CANFILTER_CAN_EFF_FLAG;
+        bool list = (f.can_mask & max_ext_id) == (ext ? max_ext_id : max_std_id);
+        if (ext)
+            (list ? stats.ext_list : stats.ext_mask)++;
+        else
+            (list ? stats.std_list : stats.std_mask)++;
+    }
+    count_ids(stats);
+}
+
+std::string canfilter_socketcan::to_candump() const {
+    std::string out;
+    char buf[32];
+    for (const auto &f : filters) {
+        if (f.can_id & CANFILTER_CAN_EFF_FLAG)
+            std::snprintf(buf, sizeof(buf), "%08X:%08X", f.can_id & max_ext_id, f.can_mask);
+        else
+            std::snprintf(buf, sizeof(buf), "%03X:%08X", f.can_id, f.can_mask);
+        if (!out.empty())
+            out += ",";
+        out += buf;
+    }
+    return out;
+}
+
+#ifdef __linux__
+int canfilter_socketcan::open_socket(const std::string &ifname) {
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (fd < 0)
+        return -1;
+
+    struct ifreq ifr;
+    std::memset(&ifr, 0, sizeof(ifr));
+    std::strncpy(ifr.ifr_name, ifname.c_str(), IFNAMSIZ - 1);
+    struct sockaddr_can addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+        close(fd);
+        return -1;
+    }
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool canfilter_socketcan::set_socket_filter(int fd) const {
+    return setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(),
+                      filters.size() * sizeof(canfilter_socketcan_filter)) == 0;
+}
+
+bool canfilter_socketcan::get_socket_filter(int fd, std::vector<canfilter_socketcan_filter> &filters) {
+    filters.resize(max_filters);
+    socklen_t len = filters.size() * sizeof(canfilter_socketcan_filter);
+    if (getsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(), &len) != 0)
+        return false;
+    filters.resize(len / sizeof(canfilter_socketcan_filter));
+    return true;
+}
+
+void canfilter_socketcan::close_socket(int fd) {
+    if (fd >= 0)
+        close(fd);
+}
+#else
+int canfilter_socketcan::open_socket(const std::string &ifname) {
+    (void)ifname;
+    return -1;
+}
+
+bool canfilter_socketcan::set_socket_filter(int fd) const {
+    (void)fd;
+    return false;
+}
+
+bool canfilter_socketcan::get_socket_filter(int fd, std::vector<canfilter_socketcan_filter> &filters) {
+    (void)fd;
+    filters.clear();
+    return false;
+}
+
+void canfilter_socketcan::close_socket(int fd) {
+    (void)fd;
+}
+#endif
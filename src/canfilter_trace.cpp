@@ -0,0 +1,54 @@
+/*
+ * canfilter_trace.cpp
+ *
+ * Implements stage timers and the stderr trace printer.
+ *
+ * Notes:
+ * - Timers use std::chrono::steady_clock.
+ * - A timer without a trace callback only reads the clock; it costs nothing else.
+ */
+
+#include "canfilter_trace.hpp"
+#include <iostream>
+
+const char *canfilter_stage_name(canfilter_stage_t stage) {
+    static const char *names[CANFILTER_STAGE_COUNT] = {"parse", "normalize", "decompose", "pack",
+                                                       "emit",  "open",      "query",     "transfer"};
+    if (stage < CANFILTER_STAGE_COUNT)
+        return names[stage];
+    return "unknown";
+}
+
+canfilter_trace_timer::canfilter_trace_timer(canfilter_trace *trace, canfilter_stage_t stage)
+    : trace_(trace), start_(std::chrono::steady_clock::now()) {
+    event.stage = stage;
+}
+
+canfilter_trace_timer::~canfilter_trace_timer() {
+    done();
+}
+
+void canfilter_trace_timer::done() {
+    if (done_)
+        return;
+    done_ = true;
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    event.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    if (trace_)
+        trace_->stage_done(event);
+}
+
+void canfilter_trace_print::stage_done(const canfilter_trace_event &event) {
+    std::cerr << "trace: " << canfilter_stage_name(event.stage) << " " << event.duration_us << " us";
+    if (event.ranges_in)
+        std::cerr << " ranges_in=" << event.ranges_in;
+    if (event.blocks_out)
+        std::cerr << " blocks_out=" << event.blocks_out;
+    if (event.banks_used)
+        std::cerr << " banks_used=" << event.banks_used;
+    if (event.bytes)
+        std::cerr << " bytes=" << event.bytes;
+    if (!event.success)
+        std::cerr << " failed";
+    std::cerr << std::endl;
+}
@@ -7,109 +7,327 @@
  * - Discover and open devices using VID:PID (with optional serial number).
  * - Query device capabilities and determine hardware filter availability.
  * - Program filter configuration to the device via USB control transfers.
+ * - Pipeline capability queries, compilation and upload (queryAndProgram).
+ * - Send compact images and deltas to firmware that supports them.
+ * - Skip the upload when the adapter already holds the image (GET_FILTER hash).
+ * - Address one CAN channel of a multi-channel adapter.
+ * - Retry failed requests.
+ * - Send all requests through a usb_transport, the libusb device by default.
+ * - Start and stop a channel, for reading its frames (canfilter_meter).
  *
  * Notes:
  * - Uses libusb-1.0 API for cross-platform USB communication.
  * - Supports vendor-specific CAN filter USB requests defined in gs_usb_breq.
  * - Dependent on device firmware supporting gs_usb SET_FILTER.
+ * - A stalled request (unsupported by the firmware) or a lost device is not
+ *   retried.
+ * - The channel goes in wValue of every request; DEVICE_CONFIG is answered
+ *   for the whole device.
+ * - GET_FILTER asks for gs_filter_state; firmware without hash support
+ *   answers the shorter gs_filter_info, and the image is always uploaded.
+ * - A request refused because the interface is not claimed (busy) is sent
+ *   again once after claiming the interface.
+ * - startChannel() picks the most time quanta per bit, 8 to 25, that divide
+ *   the CAN clock evenly and fit the limits from BT_CONST.
  */
 
 #include "canfilter_usb.hpp"
-#include <libusb-1.0/libusb.h>
-
-#define CANDLE_USB_CTRL_IN (LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_INTERFACE | LIBUSB_ENDPOINT_IN)
-#define CANDLE_USB_CTRL_OUT (LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_INTERFACE | LIBUSB_ENDPOINT_OUT)
-
-#define GS_CAN_FEATURE_FILTER (1 << 16)
-
-// structures and enums (same as in candlelight_fw)
-enum gs_usb_breq {
-    GS_USB_BREQ_HOST_FORMAT = 0,
-    GS_USB_BREQ_BITTIMING,
-    GS_USB_BREQ_MODE,
-    GS_USB_BREQ_BERR,
-    GS_USB_BREQ_BT_CONST,
-    GS_USB_BREQ_DEVICE_CONFIG,
-    GS_USB_BREQ_TIMESTAMP,
-    GS_USB_BREQ_IDENTIFY,
-    GS_USB_BREQ_GET_USER_ID, // not implemented
-    GS_USB_BREQ_SET_USER_ID, // not implemented
-    GS_USB_BREQ_DATA_BITTIMING,
-    GS_USB_BREQ_BT_CONST_EXT,
-    GS_USB_BREQ_SET_TERMINATION,
-    GS_USB_BREQ_GET_TERMINATION,
-    GS_USB_BREQ_GET_STATE,
-    GS_USB_BREQ_SET_FILTER,
-    GS_USB_BREQ_GET_FILTER,
-    __GS_USB_BREQ_PLACEHOLDER_17,
-    __GS_USB_BREQ_PLACEHOLDER_18,
-    __GS_USB_BREQ_PLACEHOLDER_19,
-    GS_USB_BREQ_ELM_GET_BOARDINFO = 20,
-    GS_USB_BREQ_ELM_SET_FILTER,
-    GS_USB_BREQ_ELM_GET_LASTERROR,
-    GS_USB_BREQ_ELM_SET_BUSLOADREPORT,
-    GS_USB_BREQ_ELM_SET_PINSTATUS,
-    GS_USB_BREQ_ELM_GET_PINSTATUS,
-};
+#include "gs_usb.hpp"
+#include <chrono>
+#include <iostream>
 
-struct gs_device_capability {
-    uint32_t feature;
-    uint32_t fclk_can;
-    uint32_t tseg1_min;
-    uint32_t tseg1_max;
-    uint32_t tseg2_min;
-    uint32_t tseg2_max;
-    uint32_t sjw_max;
-    uint32_t brp_min;
-    uint32_t brp_max;
-    uint32_t brp_inc;
-} __attribute__((packed));
-
-struct gs_filter_info {
-    uint8_t dev;
-    uint8_t reserved[3];
-} __attribute__((packed)) __attribute__((aligned(4)));
+const std::vector<std::pair<uint16_t, uint16_t>> canfilter_usb::default_vid_pid_list_ = {
+    {0x1D50, 0x606F},
+    {0x1209, 0xCA01},
+};
 
 bool canfilter_usb::open() {
+    claim_tried_ = transport_claimed_ = false;
+    state_known_ = false;
     USBDEVICE_LOG("Scanning CAN filter VIDs/PIDs");
-    return open_from_list(default_vid_pid_list_);
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_OPEN);
+    timer.event.success = open_from_list(default_vid_pid_list_);
+    return timer.event.success;
 }
 
 bool canfilter_usb::open(uint16_t vid, uint16_t pid, std::string serial) {
-    return open_vid_pid(vid, pid, serial);
+    claim_tried_ = transport_claimed_ = false;
+    state_known_ = false;
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_OPEN);
+    timer.event.success = open_vid_pid(vid, pid, serial);
+    return timer.event.success;
+}
+
+bool canfilter_usb::open(const usb_device_info &info) {
+    claim_tried_ = transport_claimed_ = false;
+    state_known_ = false;
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_OPEN);
+    timer.event.success = open_device(info);
+    return timer.event.success;
+}
+
+bool canfilter_usb::open(const std::string &path) {
+    claim_tried_ = transport_claimed_ = false;
+    state_known_ = false;
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_OPEN);
+    timer.event.success = open_path(path);
+    return timer.event.success;
+}
+
+void canfilter_usb::set_transport(usb_transport *transport) {
+    transport_ = transport ? transport : this;
+    state_known_ = false;
+    claim_tried_ = false;
+    transport_claimed_ = false;
+}
+
+bool canfilter_usb::ready() {
+    return transport_->is_open() || (transport_ == this && open());
+}
+
+static bool retryable(int result) {
+    return result < 0 && result != LIBUSB_ERROR_PIPE && result != LIBUSB_ERROR_NO_DEVICE &&
+           result != LIBUSB_ERROR_BUSY;
+}
+
+bool canfilter_usb::claim() {
+    if (!claim_tried_) {
+        claim_tried_ = true;
+        transport_claimed_ = transport_->claim_interface();
+        USBDEVICE_LOG("Request needs interface, claimed: " << transport_claimed_);
+        if (transport_claimed_ && transport_->kernel_driver_detached())
+            std::cerr << "warning: adapter busy, kernel driver detached, bring the CAN network interface up again"
+                      << std::endl;
+    }
+    return transport_claimed_;
+}
+
+int canfilter_usb::transfer(uint8_t request_type, uint8_t request, unsigned char *data, uint16_t length) {
+    int ret = LIBUSB_ERROR_IO;
+    unsigned int limit = (retries < max_retries) ? retries : max_retries;
+    for (unsigned int attempt = 0; attempt <= limit; attempt++) {
+        ret = transport_->control_transfer(request_type, request, channel, 0, data, length, timeout_ms);
+        if (ret == LIBUSB_ERROR_BUSY && claim())
+            ret = transport_->control_transfer(request_type, request, channel, 0, data, length, timeout_ms);
+        if (!retryable(ret))
+            break;
+    }
+    return ret;
+}
+
+void canfilter_usb::submit(uint8_t request_type, uint8_t request, unsigned char *data, uint16_t length,
+                           unsigned int attempt, const usb_transfer_done &done, bool resent) {
+    bool submitted = transport_->submit_control_transfer(
+        request_type, request, channel, 0, data, length, timeout_ms, [=](int result) {
+            if (result == LIBUSB_ERROR_BUSY && !resent && claim())
+                submit(request_type, request, data, length, attempt, done, true);
+            else if (retryable(result) && attempt < retries && attempt < max_retries)
+                submit(request_type, request, data, length, attempt + 1, done, resent);
+            else
+                done(result);
+        });
+    if (!submitted)
+        done(LIBUSB_ERROR_IO);
 }
 
 bool canfilter_usb::hasHardwareFilter() {
-    if (!handle_ && !open())
+    if (!ready())
         return false;
 
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_QUERY);
     gs_device_capability cap{};
-    int ret = libusb_control_transfer((libusb_device_handle *)handle_, CANDLE_USB_CTRL_IN, GS_USB_BREQ_BT_CONST, 0, 0,
-                                      (unsigned char *)&cap, sizeof(cap), 1000);
+    int ret = transfer(CANDLE_USB_CTRL_IN, GS_USB_BREQ_BT_CONST, (unsigned char *)&cap, sizeof(cap));
 
-    return ret == sizeof(cap) && (cap.feature & GS_CAN_FEATURE_FILTER);
+    timer.event.success = (ret == sizeof(cap));
+    features_known = (ret == sizeof(cap));
+    features = features_known ? cap.feature : 0;
+    return features & GS_CAN_FEATURE_FILTER;
+}
+
+uint32_t canfilter_usb::getChannelCount() {
+    if (!ready())
+        return 0;
+
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_QUERY);
+    gs_device_config config{};
+    int ret = transfer(CANDLE_USB_CTRL_IN, GS_USB_BREQ_DEVICE_CONFIG, (unsigned char *)&config, sizeof(config));
+
+    timer.event.success = (ret == sizeof(config));
+    if (ret != sizeof(config))
+        return 0;
+
+    return config.icount + 1;
 }
 
 uint32_t canfilter_usb::getFilterInfo() {
-    if (!handle_ && !open())
+    if (!ready())
         return 0;
 
-    gs_filter_info finfo{};
-    int ret = libusb_control_transfer((libusb_device_handle *)handle_, CANDLE_USB_CTRL_IN, GS_USB_BREQ_GET_FILTER, 0, 0,
-                                      (unsigned char *)&finfo, sizeof(finfo), 1000);
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_QUERY);
+    gs_filter_state state{};
+    int ret = transfer(CANDLE_USB_CTRL_IN, GS_USB_BREQ_GET_FILTER, (unsigned char *)&state, sizeof(state));
 
-    if (ret != sizeof(finfo))
+    set_state(ret, state);
+    timer.event.success = state_known_;
+    if (!state_known_)
         return 0;
 
-    return finfo.dev;
+    return state.dev;
+}
+
+void canfilter_usb::set_state(int ret, const gs_filter_state &state) {
+    state_known_ = (ret >= (int)sizeof(gs_filter_info));
+    state_channel_ = channel;
+    state_hash_valid_ = (ret == sizeof(state)) && (state.flags & GS_FILTER_STATE_HASH);
+    state_hash_ = state.hash;
 }
 
 bool canfilter_usb::programFilter(const void *config, uint32_t size) {
-    if (!handle_ && !open())
+    if (!ready())
         return false;
 
-    int ret = libusb_control_transfer((libusb_device_handle *)handle_, CANDLE_USB_CTRL_OUT, GS_USB_BREQ_SET_FILTER, 0,
-                                      0, (unsigned char *)config, size, 1000);
+    state_known_ = false;
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_TRANSFER);
+    int ret = transfer(CANDLE_USB_CTRL_OUT, GS_USB_BREQ_SET_FILTER, (unsigned char *)config, size);
 
+    timer.event.bytes = (ret > 0) ? ret : 0;
+    timer.event.success = (ret == (int)size);
     return ret == (int)size;
 }
+
+bool canfilter_usb::programImage(const canfilter_image &image) {
+    unchanged = false;
+    if (skip_unchanged) {
+        if (!state_known_ || state_channel_ != channel)
+            getFilterInfo();
+        if (state_known_ && state_hash_valid_ && state_hash_ == image.hash) {
+            unchanged = true;
+            return true;
+        }
+    }
+
+    bool success;
+    if ((features & GS_CAN_FEATURE_FILTER_COMPACT) && !image.compact.empty())
+        success = programFilter(image.compact.data(), image.compact.size());
+    else
+        success = programFilter(image.data.data(), image.data.size());
+
+    // the adapter now holds this image
+    state_known_ = state_hash_valid_ = success;
+    state_channel_ = channel;
+    state_hash_ = image.hash;
+    return success;
+}
+
+bool canfilter_usb::programDelta(const std::vector<uint8_t> &delta) {
+    if (!ready())
+        return false;
+
+    state_known_ = false;
+    canfilter_trace_timer timer(trace, CANFILTER_STAGE_TRANSFER);
+    int ret = transfer(CANDLE_USB_CTRL_OUT, GS_USB_BREQ_SET_FILTER_DELTA, (unsigned char *)delta.data(), delta.size());
+
+    timer.event.bytes = (ret > 0) ? ret : 0;
+    timer.event.success = (ret == (int)delta.size());
+    return ret == (int)delta.size();
+}
+
+canfilter_error_t canfilter_usb::queryAndProgram(const compile_fn &compile, uint32_t *filter_type) {
+    if (!ready())
+        return CANFILTER_ERROR_PLATFORM;
+
+    gs_device_capability cap{};
+    gs_filter_state finfo{};
+    bool cap_done = false, info_done = false;
+    int cap_ret = 0, info_ret = 0;
+    canfilter_error_t err = CANFILTER_ERROR_PLATFORM;
+    canfilter_image image;
+
+    auto start = std::chrono::steady_clock::now();
+    auto query_done = [this, start](bool success) {
+        if (!trace)
+            return;
+        canfilter_trace_event event;
+        event.stage = CANFILTER_STAGE_QUERY;
+        event.success = success;
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        event.duration_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        trace->stage_done(event);
+    };
+
+    // filter type first: the adapter answers in order, so compiling overlaps the capability query
+    submit(CANDLE_USB_CTRL_IN, GS_USB_BREQ_GET_FILTER, (unsigned char *)&finfo, sizeof(finfo), 0, [&](int ret) {
+        info_done = true;
+        info_ret = ret;
+        set_state(ret, finfo);
+        query_done(state_known_);
+        if (state_known_)
+            err = compile(finfo.dev, image);
+    });
+    submit(CANDLE_USB_CTRL_IN, GS_USB_BREQ_BT_CONST, (unsigned char *)&cap, sizeof(cap), 0, [&](int ret) {
+        cap_done = true;
+        cap_ret = ret;
+        query_done(ret == sizeof(cap));
+    });
+
+    while (!cap_done || !info_done)
+        transport_->handle_events(timeout_ms);
+
+    features_known = (cap_ret == sizeof(cap));
+    features = features_known ? cap.feature : 0;
+
+    if (cap_ret != sizeof(cap) || !(cap.feature & GS_CAN_FEATURE_FILTER) || info_ret < (int)sizeof(gs_filter_info))
+        return CANFILTER_ERROR_PLATFORM;
+    if (filter_type)
+        *filter_type = finfo.dev;
+    if (err != CANFILTER_SUCCESS)
+        return err;
+
+    return programImage(image) ? CANFILTER_SUCCESS : CANFILTER_ERROR_PLATFORM;
+}
+
+bool canfilter_usb::startChannel(uint32_t bitrate) {
+    if (!ready() || bitrate == 0)
+        return false;
+
+    gs_device_capability cap{};
+    int ret = transfer(CANDLE_USB_CTRL_IN, GS_USB_BREQ_BT_CONST, (unsigned char *)&cap, sizeof(cap));
+    features_known = (ret == sizeof(cap));
+    features = features_known ? cap.feature : 0;
+    if (!features_known)
+        return false;
+
+    gs_device_bittiming timing{};
+    for (uint32_t tq = 25; tq >= 8 && timing.brp == 0; tq--) {
+        if (cap.fclk_can % (bitrate * tq))
+            continue;
+        uint32_t brp = cap.fclk_can / (bitrate * tq);
+        uint32_t tseg1 = tq * 7 / 8 - 1; // after the sync segment
+        uint32_t tseg2 = tq - 1 - tseg1;
+        if (brp < cap.brp_min || brp > cap.brp_max || tseg1 < cap.tseg1_min || tseg1 > cap.tseg1_max ||
+            tseg2 < cap.tseg2_min || tseg2 > cap.tseg2_max)
+            continue;
+        timing.prop_seg = tseg1 / 2;
+        timing.phase_seg1 = tseg1 - timing.prop_seg;
+        timing.phase_seg2 = tseg2;
+        timing.sjw = 1;
+        timing.brp = brp;
+    }
+    if (timing.brp == 0)
+        return false;
+
+    ret = transfer(CANDLE_USB_CTRL_OUT, GS_USB_BREQ_BITTIMING, (unsigned char *)&timing, sizeof(timing));
+    if (ret != sizeof(timing))
+        return false;
+
+    gs_device_mode mode{GS_CAN_MODE_START, 0};
+    return transfer(CANDLE_USB_CTRL_OUT, GS_USB_BREQ_MODE, (unsigned char *)&mode, sizeof(mode)) == sizeof(mode);
+}
+
+bool canfilter_usb::stopChannel() {
+    if (!ready())
+        return false;
+
+    gs_device_mode mode{GS_CAN_MODE_RESET, 0};
+    return transfer(CANDLE_USB_CTRL_OUT, GS_USB_BREQ_MODE, (unsigned char *)&mode, sizeof(mode)) == sizeof(mode);
+}
@@ -0,0 +1,350 @@
+/*
+ * gs_usb_sim.cpp
+ *
+ * Implements the simulated candleLight adapter.
+ *
+ * Responsibilities:
+ * - Answer BT_CONST and GET_FILTER like patched candleLight firmware;
+ *   GET_FILTER includes the hash of the stored image.
+ * - Check SET_FILTER images (controller type and size) and store them.
+ * - Inject latency, errors and timeouts.
+ * - Start and stop channels; send the frames of a simulated bus that pass
+ *   the channel 0 filter on bulk IN.
+ *
+ * Notes:
+ * - A timed out request sleeps for its full timeout, as libusb would.
+ * - Submitted requests are answered at submission and completed in
+ *   handle_events() once their latency has passed.
+ * - Unsupported requests, and requests to a channel the adapter does not
+ *   have, stall (LIBUSB_ERROR_PIPE).
+ * - Bus frames are generated lazily when a bulk transfer is submitted: the
+ *   frames since the last one sent arrived while no transfer was pending
+ *   and go to the receive FIFO, otherwise the transfer completes when the
+ *   next passing frame is on the bus.
+ * - The filter is decoded (canfilter::get_ranges()) once per uploaded image
+ *   into a table of passing standard IDs; no image passes all frames.
+ */
+
+#include "gs_usb_sim.hpp"
+#include "canfilter_device.hpp"
+#include "gs_usb.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+gs_usb_sim::gs_usb_sim(canfilter_hardware_t dev) : dev(dev) {}
+
+bool gs_usb_sim::is_open() const {
+    return true;
+}
+
+bool gs_usb_sim::claim_interface() {
+    if (kernel_driver) {
+        kernel_driver = false;
+        link_resets++;
+    }
+    claimed = true;
+    return true;
+}
+
+bool gs_usb_sim::kernel_driver_detached() const {
+    return !kernel_driver;
+}
+
+int gs_usb_sim::control_transfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                                 unsigned char *data, uint16_t length, unsigned int timeout_ms) {
+    (void)index;
+
+    uint64_t delay_us;
+    int result = process(request_type, request, value, data, length, timeout_ms, delay_us);
+    if (delay_us)
+        std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+    return result;
+}
+
+bool gs_usb_sim::submit_control_transfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                                         unsigned char *data, uint16_t length, unsigned int timeout_ms,
+                                         usb_transfer_done done) {
+    (void)index;
+
+    uint64_t delay_us;
+    in_flight t;
+    t.result = process(request_type, request, value, data, length, timeout_ms, delay_us);
+    t.due = std::chrono::steady_clock::now() + std::chrono::microseconds(delay_us);
+    t.done = done;
+    in_flight_.push_back(t);
+    return true;
+}
+
+bool gs_usb_sim::submit_bulk_transfer(uint8_t endpoint, unsigned char *data, int length, unsigned int timeout_ms,
+                                      usb_transfer_done done) {
+    if (endpoint != GS_USB_ENDPOINT_IN || !claimed)
+        return false;
+
+    uint64_t delay_us;
+    in_flight t;
+    t.result = receive(data, length, timeout_ms, delay_us);
+    t.due = std::chrono::steady_clock::now() + std::chrono::microseconds(delay_us);
+    t.done = done;
+    in_flight_.push_back(t);
+    return true;
+}
+
+void gs_usb_sim::handle_events(unsigned int timeout_ms) {
+    if (dispatch())
+        return;
+
+    // wait for the first request to finish, at most timeout_ms
+    auto now = std::chrono::steady_clock::now();
+    auto until = now + std::chrono::milliseconds(timeout_ms);
+    for (auto &t : in_flight_)
+        if (t.due < until)
+            until = t.due;
+    if (until > now)
+        std::this_thread::sleep_until(until);
+
+    now = std::chrono::steady_clock::now();
+    std::vector<in_flight> waiting;
+    for (auto &t : in_flight_) {
+        if (t.due <= now)
+            complete(t.done, t.result);
+        else
+            waiting.push_back(t);
+    }
+    in_flight_.swap(waiting);
+
+    dispatch();
+}
+
+int gs_usb_sim::process(uint8_t request_type, uint8_t request, uint16_t channel, unsigned char *data, uint16_t length,
+                        unsigned int timeout_ms, uint64_t &delay_us) {
+    requests++;
+
+    // injected failures
+    bool fail = (requests <= fail_first) || (fail_every && requests % fail_every == 0);
+    delay_us = latency_us;
+    int error = fail ? fail_error : 0;
+    if (timeout_ms && delay_us > 1000ULL * timeout_ms) {
+        delay_us = 1000ULL * timeout_ms;
+        error = LIBUSB_ERROR_TIMEOUT;
+    } else if (error == LIBUSB_ERROR_TIMEOUT) {
+        delay_us = 1000ULL * timeout_ms;
+    }
+    if (!error && vendor_needs_claim && !claimed) {
+        delay_us = 0;
+        error = LIBUSB_ERROR_BUSY;
+    }
+    if (error) {
+        failures++;
+        return error;
+    }
+
+    if (request_type == CANDLE_USB_CTRL_IN && request == GS_USB_BREQ_DEVICE_CONFIG) {
+        gs_device_config config{};
+        config.icount = channels ? channels - 1 : 0;
+        config.sw_version = 2;
+        config.hw_version = 1;
+        uint16_t len = length < sizeof(config) ? length : sizeof(config);
+        std::memcpy(data, &config, len);
+        return len;
+    }
+
+    // channel requests
+    if (channel >= channels)
+        return LIBUSB_ERROR_PIPE;
+    if (images.size() < channels)
+        images.resize(channels);
+    std::vector<uint8_t> &image = images[channel];
+
+    if (request_type == CANDLE_USB_CTRL_IN && request == GS_USB_BREQ_BT_CONST) {
+        gs_device_capability cap{};
+        cap.feature = has_filter ? GS_CAN_FEATURE_FILTER : 0;
+        if (has_filter && compact)
+            cap.feature |= GS_CAN_FEATURE_FILTER_COMPACT;
+        if (has_filter && delta)
+            cap.feature |= GS_CAN_FEATURE_FILTER_DELTA;
+        cap.fclk_can = 48000000;
+        cap.tseg1_min = 1;
+        cap.tseg1_max = 16;
+        cap.tseg2_min = 1;
+        cap.tseg2_max = 8;
+        cap.sjw_max = 4;
+        cap.brp_min = 1;
+        cap.brp_max = 1024;
+        cap.brp_inc = 1;
+        uint16_t len = length < sizeof(cap) ? length : sizeof(cap);
+        std::memcpy(data, &cap, len);
+        return len;
+    }
+
+    if (request_type == CANDLE_USB_CTRL_IN && request == GS_USB_BREQ_GET_FILTER && has_filter) {
+        gs_filter_state state{};
+        state.dev = dev;
+        uint16_t size = sizeof(gs_filter_info);
+        if (hash) {
+            size = sizeof(state);
+            if (!image.empty()) {
+                state.flags = GS_FILTER_STATE_HASH;
+                state.hash = canfilter_image_hash(image.data(), image.size());
+            }
+        }
+        uint16_t len = length < size ? length : size;
+        std::memcpy(data, &state, len);
+        return len;
+    }
+
+    if (request_type == CANDLE_USB_CTRL_OUT && request == GS_USB_BREQ_BITTIMING) {
+        gs_device_bittiming timing;
+        if (length != sizeof(timing))
+            return LIBUSB_ERROR_PIPE;
+        std::memcpy(&timing, data, sizeof(timing));
+        if (timing.brp == 0)
+            return LIBUSB_ERROR_PIPE;
+        return length;
+    }
+
+    if (request_type == CANDLE_USB_CTRL_OUT && request == GS_USB_BREQ_MODE) {
+        gs_device_mode mode;
+        if (length != sizeof(mode))
+            return LIBUSB_ERROR_PIPE;
+        std::memcpy(&mode, data, sizeof(mode));
+        if (channel == 0) {
+            started = (mode.mode == GS_CAN_MODE_START);
+            rx_start_ = rx_next_ = std::chrono::steady_clock::now();
+            rx_id_ = 0;
+            rx_fifo_.clear();
+            rx_overflow_ = false;
+        }
+        return length;
+    }
+
+    if (request_type == CANDLE_USB_CTRL_OUT && request == GS_USB_BREQ_SET_FILTER && has_filter) {
+        std::unique_ptr<canfilter> filter(canfilter_create(dev));
+        if (!filter || length < 4 || data[0] != dev)
+            return LIBUSB_ERROR_PIPE;
+        if (data[3] & CANFILTER_IMAGE_COMPACT) {
+            if (!compact || !filter->set_hw_config_compact(data, length))
+                return LIBUSB_ERROR_PIPE;
+            const uint8_t *full = (const uint8_t *)filter->get_hw_config();
+            image.assign(full, full + filter->get_hw_size());
+        } else {
+            if (length != filter->get_hw_size())
+                return LIBUSB_ERROR_PIPE;
+            image.assign(data, data + length);
+        }
+        bytes_received += length;
+        filters_set++;
+        return length;
+    }
+
+    if (request_type == CANDLE_USB_CTRL_OUT && request == GS_USB_BREQ_SET_FILTER_DELTA && has_filter && delta) {
+        // applies to the image programmed before
+        std::unique_ptr<canfilter> filter(canfilter_create(dev));
+        if (!filter || image.size() != filter->get_hw_size())
+            return LIBUSB_ERROR_PIPE;
+        std::memcpy(filter->get_hw_config(), image.data(), image.size());
+        if (!filter->apply_hw_config_delta(data, length))
+            return LIBUSB_ERROR_PIPE;
+        const uint8_t *full = (const uint8_t *)filter->get_hw_config();
+        image.assign(full, full + filter->get_hw_size());
+        bytes_received += length;
+        deltas_set++;
+        return length;
+    }
+
+    return LIBUSB_ERROR_PIPE;
+}
+
+int gs_usb_sim::receive(unsigned char *data, int length, unsigned int timeout_ms, uint64_t &delay_us) {
+    auto now = std::chrono::steady_clock::now();
+    delay_us = 1000ULL * timeout_ms;
+    if (!started || bus_rate == 0 || length < (int)sizeof(gs_host_frame))
+        return LIBUSB_ERROR_TIMEOUT;
+
+    // standard IDs passing the channel 0 filter
+    if (rx_filters_ != filters_set + deltas_set || rx_pass_.empty()) {
+        rx_filters_ = filters_set + deltas_set;
+        rx_pass_.assign(canfilter::max_std_id + 1, true);
+        std::unique_ptr<canfilter> filter(canfilter_create(dev));
+        if (filter && !images.empty() && images[0].size() == filter->get_hw_size()) {
+            std::memcpy(filter->get_hw_config(), images[0].data(), images[0].size());
+            std::vector<canfilter_range> ranges;
+            filter->get_ranges(ranges);
+            rx_pass_.assign(canfilter::max_std_id + 1, false);
+            for (const auto &r : ranges)
+                for (uint32_t id = r.begin; !r.ext && id <= r.end; id++)
+                    rx_pass_[id] = true;
+        }
+    }
+
+    auto period = std::chrono::nanoseconds(1000000000ULL / bus_rate);
+    auto next = [&](uint32_t &id) {
+        id = rx_id_;
+        rx_id_ = (rx_id_ + 1) & canfilter::max_std_id;
+        rx_next_ += period;
+    };
+
+    // passed frames that arrived while no transfer was pending
+    uint32_t id;
+    while (rx_next_ <= now) {
+        next(id);
+        if (!rx_pass_[id])
+            continue;
+        if (rx_fifo_.size() < rx_fifo_depth) {
+            rx_fifo_.push_back(id);
+        } else {
+            rx_overflow_ = true;
+            frames_lost++;
+        }
+    }
+
+    auto due = now;
+    if (!rx_fifo_.empty()) {
+        id = rx_fifo_.front();
+        rx_fifo_.pop_front();
+    } else {
+        // the transfer waits for the next passing frame
+        auto deadline = now + std::chrono::milliseconds(timeout_ms);
+        bool found = false;
+        while (!found && rx_next_ <= deadline) {
+            due = rx_next_;
+            next(id);
+            found = rx_pass_[id];
+        }
+        if (!found)
+            return LIBUSB_ERROR_TIMEOUT;
+    }
+
+    gs_host_frame frame{};
+    frame.echo_id = GS_HOST_FRAME_RX;
+    frame.can_id = id;
+    frame.can_dlc = 8;
+    frame.flags = rx_overflow_ ? GS_CAN_FLAG_OVERFLOW : 0;
+    std::memcpy(frame.data, &frames_sent, sizeof(frames_sent));
+    frame.timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(due - rx_start_).count();
+    std::memcpy(data, &frame, sizeof(frame));
+    rx_overflow_ = false;
+    frames_sent++;
+
+    delay_us = std::chrono::duration_cast<std::chrono::microseconds>(due - now).count();
+    return sizeof(frame);
+}
+
+void gs_usb_sim::debug_print() const {
+    std::cout << "simulated " << canfilter_device_name(dev) << ": " << requests << " requests, " << failures
+              << " failed, " << filters_set << " filters set, " << deltas_set << " deltas set (" << bytes_received
+              << " bytes), " << link_resets << " link resets, kernel driver " << (kernel_driver ? "bound" : "detached");
+    if (frames_sent || frames_lost)
+        std::cout << ", " << frames_sent << " frames sent, " << frames_lost << " lost";
+    for (size_t c = 0; c < images.size(); c++) {
+        if (images[c].empty())
+            continue;
+        std::cout << ", ";
+        if (channels > 1)
+            std::cout << "channel " << c << " ";
+        std::cout << "image " << images[c].size() << " bytes";
+    }
+    std::cout << std::endl;
+}
@@ -10,6 +10,13 @@
 //   - Detects or selects the target hardware filter type (auto, bxcan_f0, bxcan_f4, fdcan_g0, fdcan_h7)
 //   - Optionally programs a connected USB device using canfilter_usb
 //   - Provides debug output of filter contents and hardware register layout
+//   - Predicts host load per controller type from DBC cycle times (--dbc)
+//   - Programs many adapters in parallel (--all, repeated -u)
+//   - Programs adapters on attach from precompiled profiles (--daemon)
+//   - Switches an adapter between precompiled profiles on command (--switch)
+//   - Keeps an adapter open for set/add/remove/program commands on stdin (--batch)
+//   - Changes a programmed filter by sending the changed banks only (--delta)
+//   - Emits software filter tables for the adapter firmware (-o firmware)
 //
 // Workflow:
 //   1. Parse command-line arguments and options
@@ -21,10 +28,31 @@
 // via canfilter_usb and does not affect the filter-building logic.
 
 #include "canfilter.hpp"
-#include "canfilter_bxcan.hpp"
-#include "canfilter_fdcan.hpp"
+#include "canfilter_adaptive.hpp"
+#include "canfilter_batch.hpp"
+#include "canfilter_bench.hpp"
+#include "canfilter_bpf.hpp"
+#include "canfilter_daemon.hpp"
+#include "canfilter_device.hpp"
+#include "canfilter_firmware.hpp"
+#include "canfilter_golden.hpp"
+#include "canfilter_hybrid.hpp"
+#include "canfilter_load.hpp"
+#include "canfilter_meter.hpp"
+#include "canfilter_parallel.hpp"
+#include "canfilter_ranges.hpp"
+#include "canfilter_socketcan.hpp"
+#include "canfilter_trace.hpp"
 #include "canfilter_usb.hpp"
+#include "gs_usb.hpp"
+#include "gs_usb_sim.hpp"
 #include <format>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -36,16 +64,58 @@ void print_help(const char *prog_name) {
               << "IDs: Single CAN IDs (0x100, 256, 0x1000)\n"
               << "RANGES: CAN ID ranges (0x100-0x1FF, 256-511, 0x1000-0x1FFF)\n\n"
               << "Options:\n"
-              << "  -o, --output MODE      Output mode: auto, bxcan_f0, bxcan_f4, fdcan_g0, fdcan_h7\n"
+              << "  -o, --output MODE      Output mode: auto, bxcan_f0, bxcan_f4, fdcan_g0, fdcan_h7, socketcan, bpf,\n"
+              << "                         firmware\n"
               << "  -a, --allow-all        Allow all packets\n"
+              << "  -c, --channel N        CAN channel of the IDs that follow (default 0)\n"
               << "  -v, --verbose          Enable verbose output\n"
               << "  -d, --dry-run          Do not program hardware; just print filter configuration\n"
-              << "  -u, --usb vid:pid      Device in format vid:pid[@serial]\n"
+              << "      --trace            Print time and counters of each pipeline stage\n"
+              << "      --timeout MS       USB request timeout in milliseconds (default 1000)\n"
+              << "      --retries N        Resend a failed USB request N times, 0 to 10 (default 0)\n"
+              << "      --detach           Detach the kernel driver while programming (resets can0)\n"
+              << "      --force            Program even if the adapter already holds the same filter\n"
+              << "      --socketcan IF     Set the SocketCAN socket filter on a CAN_RAW socket on IF and check it\n"
+              << "      --hybrid MODE      If the filter does not fit, program a superset and print the host filter\n"
+              << "                         for the rest: socketcan, bpf, firmware\n"
+              << "      --bpf IF           Attach the BPF socket filter to a CAN_RAW socket on IF\n"
+              << "      --bench-socket IF N  Send N frames on IF; CPU per frame without filter, can_filter and BPF\n"
+              << "      --fw-budget BYTES  Firmware filter: flash for the tables (default 4096)\n"
+              << "      --bench-fw N       Firmware filter: time N lookups on the host\n"
+              << "      --sim DEV          Program a simulated adapter: bxcan_f0, bxcan_f4, fdcan_g0, fdcan_h7\n"
+              << "      --sim-latency US   Simulated adapter: latency per request in microseconds\n"
+              << "      --sim-fail N       Simulated adapter: fail the first N requests\n"
+              << "      --sim-full         Simulated adapter: firmware without compact images\n"
+              << "      --sim-claim        Simulated adapter: requests need the interface claimed\n"
+              << "      --sim-count N      Program N simulated adapters in parallel\n"
+              << "      --sim-channels N   Simulated adapter: N CAN channels\n"
+              << "      --sim-traffic N    Simulated adapter: N frames/s on the bus, standard IDs in turn\n"
+              << "  -u, --usb vid:pid      Device in format vid:pid[@serial] or bus-port.port; repeat for more devices\n"
+              << "      --path-cache       Remember the topology path of each @serial for the next run\n"
+              << "      --all              Program all connected adapters in parallel\n"
+              << "      --daemon           Program adapters when plugged in, until interrupted\n"
+              << "      --profiles FILE    Daemon: filter per adapter serial number\n"
+              << "      --switch FILE      Compile the named profiles in FILE, then program the one named on each\n"
+              << "                         line of stdin\n"
+              << "      --batch            Keep the adapter open and execute filter commands from stdin\n"
+              << "      --adaptive IF      Watch IF and reprogram when unwanted IDs become chatty, until interrupted\n"
+              << "      --adaptive-rate N  Adaptive: frames/s of an unwanted ID that triggers a new filter (100)\n"
+              << "      --delta IDs        After programming, change the filter to IDs with a delta upload\n"
+              << "      --stats FORMAT     Filter usage format: text (default), json\n"
+              << "      --dbc FILE         Predict host load per controller from DBC cycle times\n"
+              << "      --bench-usb N      Time open, query and upload N times; p50/p99/max per stage\n"
+              << "      --measure S        Receive for S seconds before and after programming; frames/s, bytes/s\n"
+              << "      --golden FILE      Rebuild golden images in FILE and report changes\n"
+              << "      --golden-update FILE  Rewrite golden images in FILE\n"
+              << "      --bitrate N        CAN bitrate for --dbc and --measure (default 500000)\n"
               << "  -h, --help             Show this help\n"
               << "\nExamples:\n"
               << "  " << prog_name << " 0x100 0x200-0x2FF\n"
               << "  " << prog_name << " -a\n"
               << "  " << prog_name << " -o bxcan_f0 0x100,0x101,0x200-0x2FF --dry-run\n"
+              << "  " << prog_name << " --dbc vehicle.dbc 0x100-0x1FF\n"
+              << "  " << prog_name << " --all 0x100-0x1FF\n"
+              << "  " << prog_name << " --daemon --profiles /etc/canfilter.conf\n"
               << std::endl;
 }
 
@@ -69,8 +139,33 @@ void print_error(canfilter_error_t err) {
     }
 }
 
-bool parse_usb(const std::string &arg, uint16_t &vid, uint16_t &pid, std::string &serial) {
+// Whole argument as an unsigned number, decimal or 0x hex, up to max
+bool parse_uint(const char *arg, uint32_t &value, uint32_t max = UINT32_MAX) {
+    if (*arg < '0' || *arg > '9')
+        return false;
+    char *end;
+    errno = 0;
+    unsigned long number = strtoul(arg, &end, 0);
+    if (*end || errno == ERANGE || number > max)
+        return false;
+    value = number;
+    return true;
+}
+
+// VID:PID[@SERIAL], or topology path bus-port.port into path
+bool parse_usb(const std::string &arg, uint16_t &vid, uint16_t &pid, std::string &serial, std::string &path) {
     serial.clear();
+    path.clear();
+
+    // bus-port.port
+    if (arg.find(':') == std::string::npos) {
+        size_t dash = arg.find('-');
+        if (dash == 0 || dash == std::string::npos || dash + 1 == arg.size() ||
+            arg.find_first_not_of("0123456789-.") != std::string::npos)
+            return false;
+        path = arg;
+        return true;
+    }
 
     // find optional @serial
     size_t atPos = arg.find('@');
@@ -100,19 +195,557 @@ bool parse_usb(const std::string &arg, uint16_t &vid, uint16_t &pid, std::string
     return true;
 }
 
+// Program all matching adapters in parallel, or sim_count simulated adapters
+bool program_parallel(const canfilter_ranges &spec, canfilter_hardware_t dev, const std::vector<usb_device_info> &devices,
+                      const gs_usb_sim *sim, uint32_t sim_count, const canfilter_usb &settings) {
+    canfilter_parallel parallel(spec, dev);
+    parallel.timeout_ms = settings.timeout_ms;
+    parallel.retries = settings.retries;
+    parallel.skip_unchanged = settings.skip_unchanged;
+    bool success;
+
+    if (sim) {
+        std::vector<std::unique_ptr<gs_usb_sim>> sims;
+        std::vector<usb_transport *> transports;
+        for (uint32_t i = 0; i < sim_count; i++) {
+            sims.push_back(std::unique_ptr<gs_usb_sim>(new gs_usb_sim(*sim)));
+            transports.push_back(sims.back().get());
+        }
+        success = parallel.program(transports);
+    } else {
+        if (devices.empty()) {
+            std::cerr << "error: no devices found" << std::endl;
+            return false;
+        }
+        success = parallel.program(devices);
+    }
+
+    parallel.print_results();
+    return success;
+}
+
+// Change the programmed filter to a new specification, sending only the changed banks or elements
+bool program_delta(canfilter_usb &usb, canfilter &filter, const std::string &args, const gs_usb_sim *sim,
+                   canfilter_trace *trace) {
+    canfilter_ranges next;
+    next.begin();
+    if (!next.parse(args)) {
+        std::cerr << "error: failed to parse delta arguments: ";
+        print_error(next.error);
+        return false;
+    }
+    next.end();
+
+    // remember the programmed image, then compile the new one
+    std::vector<uint8_t> delta;
+    filter.get_hw_config_delta(delta);
+    canfilter_error_t err = next.compile(filter, trace);
+    if (err != CANFILTER_SUCCESS) {
+        std::cerr << "error: ";
+        print_error(err);
+        return false;
+    }
+    filter.get_hw_config_delta(delta);
+    filter.print_usage();
+
+    bool success;
+    if (usb.features & GS_CAN_FEATURE_FILTER_DELTA) {
+        std::cout << "Delta: " << delta.size() << " bytes" << std::endl;
+        success = usb.programDelta(delta);
+        if (success && filter.reordered)
+            std::cout << "Delta: " << canfilter_program_status(CANFILTER_SUCCESS, CANFILTER_DEV_NONE, false, true)
+                      << ", the next run uploads the full image" << std::endl;
+    } else {
+        std::cout << "Delta: not supported by adapter, full image" << std::endl;
+        success = usb.programFilter(filter.get_hw_config(), filter.get_hw_size());
+    }
+
+    // the simulated adapter must now hold the same image
+    const std::vector<uint8_t> &sim_image = sim ? sim->images[usb.channel] : std::vector<uint8_t>();
+    if (success && sim && (sim_image.size() != filter.get_hw_size() ||
+                           std::memcmp(sim_image.data(), filter.get_hw_config(), sim_image.size()) != 0)) {
+        std::cerr << "error: simulated adapter image differs" << std::endl;
+        return false;
+    }
+
+    return success;
+}
+
+static canfilter_daemon *running_daemon = nullptr;
+
+static void stop_daemon(int) {
+    if (running_daemon)
+        running_daemon->stop();
+}
+
+// Program adapters as they are plugged in; simulated adapters are attached once
+bool run_daemon(canfilter_daemon &daemon, const std::string &profiles_file, const canfilter_ranges *spec,
+                const gs_usb_sim *sim, uint32_t sim_count) {
+    if (!profiles_file.empty() && !daemon.load_profiles(profiles_file)) {
+        std::cerr << "error: could not read " << profiles_file << std::endl;
+        return false;
+    }
+    if (spec && !daemon.add_profile("*", *spec)) {
+        std::cerr << "error: filter does not fit any controller" << std::endl;
+        return false;
+    }
+    if (daemon.profile_count() == 0) {
+        std::cerr << "error: no filter specified" << std::endl;
+        return false;
+    }
+
+    if (sim) {
+        for (uint32_t i = 0; i < sim_count; i++) {
+            gs_usb_sim adapter(*sim);
+            canfilter_usb usb;
+            usb.set_transport(&adapter);
+            daemon.attach(usb, "sim" + std::to_string(i), "");
+        }
+        return daemon.failed == 0;
+    }
+
+    running_daemon = &daemon;
+    std::signal(SIGINT, stop_daemon);
+    std::signal(SIGTERM, stop_daemon);
+    bool success = daemon.run();
+    running_daemon = nullptr;
+
+    return success;
+}
+
+// Switch one adapter between the profiles in profiles_file, named one per line on stdin
+bool run_switch(canfilter_daemon &daemon, const std::string &profiles_file, canfilter_usb &usb) {
+    if (!daemon.load_profiles(profiles_file)) {
+        std::cerr << "error: could not read " << profiles_file << std::endl;
+        return false;
+    }
+    if (daemon.profile_count() == 0) {
+        std::cerr << "error: no profiles in " << profiles_file << std::endl;
+        return false;
+    }
+    return daemon.run_switch(usb, std::cin);
+}
+
+static canfilter_adaptive *running_adaptive = nullptr;
+
+static void stop_adaptive(int) {
+    if (running_adaptive)
+        running_adaptive->stop();
+}
+
+// Program a superset of the filter and adapt it to the traffic seen on ifname
+bool run_adaptive(const std::string &ifname, double chatty_rate, const canfilter_ranges &spec,
+                  canfilter_hardware_t dev, canfilter_usb &usb, int verbose) {
+    canfilter_adaptive adaptive(spec, dev, usb);
+    adaptive.verbose = verbose;
+    adaptive.chatty_rate = chatty_rate;
+    if (!adaptive.start())
+        return false;
+
+    running_adaptive = &adaptive;
+    std::signal(SIGINT, stop_adaptive);
+    std::signal(SIGTERM, stop_adaptive);
+    bool success = adaptive.run(ifname);
+    running_adaptive = nullptr;
+
+    if (!success)
+        std::cerr << "error: could not read CAN_RAW socket on " << ifname << std::endl;
+    else if (verbose)
+        std::cerr << "adaptive: " << adaptive.reprogrammed << " reprograms" << std::endl;
+    return success;
+}
+
+// Compile into SocketCAN socket filters for the host, print them as candump arguments
+// and, if ifname is given, set them on a CAN_RAW socket on ifname and read them back
+bool socket_filter(const canfilter_ranges &spec, int verbose, const std::string &stats_format,
+                   const std::string &ifname, canfilter_trace *trace) {
+    canfilter_socketcan filter;
+    filter.verbose = verbose;
+    canfilter_error_t err = spec.compile(filter, trace);
+    if (err != CANFILTER_SUCCESS) {
+        std::cerr << "error: ";
+        print_error(err);
+        return false;
+    }
+
+    if (verbose > 1) {
+        filter.debug_print();
+        if (verbose > 2)
+            filter.debug_print_reg();
+    }
+
+    if (stats_format == "json") {
+        canfilter_stats stats;
+        filter.get_stats(stats);
+        canfilter_print_stats_json(std::cout, stats);
+    } else {
+        if (verbose)
+            std::cout << "\n";
+        filter.print_usage();
+    }
+    std::cout << filter.to_candump() << std::endl;
+
+    if (ifname.empty())
+        return true;
+
+    int fd = canfilter_socketcan::open_socket(ifname);
+    if (fd < 0) {
+        std::cerr << "error: could not open CAN_RAW socket on " << ifname << std::endl;
+        return false;
+    }
+    std::vector<canfilter_socketcan_filter> readback;
+    bool success = filter.set_socket_filter(fd) && canfilter_socketcan::get_socket_filter(fd, readback) &&
+                   readback.size() == filter.filters.size() &&
+                   std::memcmp(readback.data(), filter.filters.data(), filter.get_hw_size()) == 0;
+    canfilter_socketcan::close_socket(fd);
+
+    if (!success)
+        std::cerr << "error: could not set socket filter on " << ifname << std::endl;
+    else if (verbose)
+        std::cerr << filter.filters.size() << " socket filters set on " << ifname << std::endl;
+    return success;
+}
+
+// Compile into a classic BPF program for CAN_RAW sockets, print it as tcpdump -ddd does
+// and, if ifname is given, attach it to a CAN_RAW socket on ifname
+bool bpf_filter(const canfilter_ranges &spec, int verbose, const std::string &stats_format,
+                const std::string &ifname, canfilter_trace *trace) {
+    canfilter_bpf filter;
+    filter.verbose = verbose;
+    canfilter_error_t err = spec.compile(filter, trace);
+    if (err != CANFILTER_SUCCESS) {
+        std::cerr << "error: ";
+        print_error(err);
+        return false;
+    }
+    if (!filter.verify()) {
+        std::cerr << "error: BPF program does not match the filter" << std::endl;
+        return false;
+    }
+
+    if (verbose > 1) {
+        filter.debug_print();
+        if (verbose > 2)
+            filter.debug_print_reg();
+    }
+
+    if (stats_format == "json") {
+        canfilter_stats stats;
+        filter.get_stats(stats);
+        canfilter_print_stats_json(std::cout, stats);
+    } else {
+        if (verbose)
+            std::cout << "\n";
+        filter.print_usage();
+        std::cout << "BPF: " << filter.program.size() << " instructions, at most " << filter.max_steps()
+                  << " per frame" << std::endl;
+    }
+    filter.print_program(std::cout);
+
+    if (ifname.empty())
+        return true;
+
+    int fd = canfilter_socketcan::open_socket(ifname);
+    if (fd < 0) {
+        std::cerr << "error: could not open CAN_RAW socket on " << ifname << std::endl;
+        return false;
+    }
+    bool success = filter.attach_socket_filter(fd);
+    canfilter_socketcan::close_socket(fd);
+
+    if (!success)
+        std::cerr << "error: could not attach BPF filter on " << ifname << std::endl;
+    else if (verbose)
+        std::cerr << filter.program.size() << " BPF instructions attached on " << ifname << std::endl;
+    return success;
+}
+
+// Compile into firmware software filter tables and print them as C source, or benchmark lookups
+bool firmware_filter(const canfilter_ranges &spec, int verbose, const std::string &stats_format,
+                     uint32_t flash_budget, uint32_t bench_lookups, canfilter_trace *trace) {
+    canfilter_firmware filter;
+    filter.verbose = verbose;
+    filter.flash_budget = flash_budget;
+    canfilter_error_t err = spec.compile(filter, trace);
+    if (err != CANFILTER_SUCCESS) {
+        std::cerr << "error: ";
+        print_error(err);
+        if (err == CANFILTER_ERROR_FULL)
+            std::cerr << "firmware tables need more than " << flash_budget << " bytes" << std::endl;
+        return false;
+    }
+    if (!filter.verify()) {
+        std::cerr << "error: firmware tables do not match the filter" << std::endl;
+        return false;
+    }
+
+    if (verbose > 1) {
+        filter.debug_print();
+        if (verbose > 2)
+            filter.debug_print_reg();
+    }
+
+    if (bench_lookups) {
+        canfilter_firmware_bench_result result;
+        bool success = canfilter_firmware_bench(filter, bench_lookups, result);
+        if (stats_format == "json") {
+            std::cout << "{\"lookups\": " << result.lookups << ", \"accepted\": " << result.accepted
+                      << ", \"mismatches\": " << result.mismatches << ", \"table_bytes\": " << filter.table_bytes()
+                      << ", \"firmware_ns\": " << result.firmware_ns << ", \"classifier_ns\": " << result.classifier_ns
+                      << "}" << std::endl;
+        } else {
+            std::cout << result.lookups << " lookups, " << result.accepted << " accepted, " << result.mismatches
+                      << " mismatches" << std::endl;
+            std::cout << "firmware tables " << filter.table_bytes() << " bytes: " << std::fixed << std::setprecision(1)
+                      << result.firmware_ns << " ns/lookup, classifier " << result.classifier_ns << " ns/lookup"
+                      << std::endl;
+        }
+        if (!success)
+            std::cerr << "error: firmware lookup does not match the classifier" << std::endl;
+        return success;
+    }
+
+    if (stats_format == "json") {
+        canfilter_stats stats;
+        filter.get_stats(stats);
+        canfilter_print_stats_json(std::cout, stats);
+    } else {
+        filter.print_source(std::cout);
+    }
+    return true;
+}
+
+// Compare CPU per frame without socket filter, with CAN_RAW_FILTER and with BPF
+bool bench_socket(const std::string &ifname, uint32_t frames, const canfilter_ranges &spec,
+                  const std::string &format) {
+    canfilter_socketcan list;
+    canfilter_bpf bpf;
+    canfilter_error_t err = spec.compile(list);
+    if (err == CANFILTER_SUCCESS)
+        err = spec.compile(bpf);
+    if (err != CANFILTER_SUCCESS) {
+        std::cerr << "error: ";
+        print_error(err);
+        return false;
+    }
+
+    std::vector<canfilter_socket_bench_result> results;
+    if (!canfilter_socket_bench(ifname, frames, list, bpf, results)) {
+        std::cerr << "error: could not send and receive on " << ifname << std::endl;
+        return false;
+    }
+
+    if (format == "json") {
+        std::cout << "{\"interface\": \"" << ifname << "\", \"filters\": [";
+        for (size_t n = 0; n < results.size(); n++) {
+            const canfilter_socket_bench_result &r = results[n];
+            std::cout << (n ? ", " : "") << "{\"filter\": \"" << r.filter << "\", \"entries\": " << r.entries
+                      << ", \"sent\": " << r.sent << ", \"received\": " << r.received
+                      << ", \"cpu_ns\": " << (uint64_t)r.cpu_ns << "}";
+        }
+        std::cout << "]}" << std::endl;
+    } else {
+        std::cout << std::left << std::setw(12) << "filter" << std::right << std::setw(8) << "entries"
+                  << std::setw(10) << "sent" << std::setw(10) << "received" << std::setw(12) << "cpu ns/frame"
+                  << std::endl;
+        for (const auto &r : results)
+            std::cout << std::left << std::setw(12) << r.filter << std::right << std::setw(8) << r.entries
+                      << std::setw(10) << r.sent << std::setw(10) << r.received << std::setw(12)
+                      << (uint64_t)r.cpu_ns << std::endl;
+    }
+    return true;
+}
+
+// Time open, query and upload of one adapter, rounds times
+bool bench_usb(uint32_t rounds, const canfilter_ranges &spec, canfilter_hardware_t dev, gs_usb_sim *sim,
+               bool usb_specified, uint16_t vid, uint16_t pid, const std::string &serial, const std::string &path,
+               const canfilter_usb &settings, const std::string &format) {
+    canfilter_bench bench;
+    bench.timeout_ms = settings.timeout_ms;
+    bench.retries = settings.retries;
+    bench.keep_kernel_driver = settings.keep_kernel_driver;
+
+    bool success = bench.run(
+        rounds,
+        [&](canfilter_usb &usb) {
+            if (sim) {
+                canfilter_trace_timer timer(&bench, CANFILTER_STAGE_OPEN);
+                usb.set_transport(sim);
+                return true;
+            }
+            if (!path.empty())
+                return usb.open(path);
+            return usb_specified ? usb.open(vid, pid, serial) : usb.open();
+        },
+        spec, dev);
+
+    if (format == "json")
+        bench.print_json(std::cout);
+    else
+        bench.print(std::cout);
+    return success;
+}
+
+// Receive on channel for seconds with the filter the adapter holds, program spec and receive again
+bool measure_filter(canfilter_usb &usb, const canfilter_ranges &spec, const std::string &output_mode,
+                    uint32_t seconds, uint32_t bitrate) {
+    if (!usb.hasHardwareFilter()) {
+        std::cerr << "error: no hardware filter" << std::endl;
+        return false;
+    }
+    canfilter_hardware_t dev = canfilter_device_from_name(output_mode);
+    if (output_mode == "auto")
+        dev = (canfilter_hardware_t)usb.getFilterInfo();
+    canfilter_image image;
+    canfilter_error_t err = canfilter_compile(dev, spec, image);
+    if (err != CANFILTER_SUCCESS) {
+        std::cerr << "error: ";
+        print_error(err);
+        return false;
+    }
+
+    // bulk transfers need the interface
+    if (!usb.transport()->claim_interface() || !usb.startChannel(bitrate)) {
+        std::cerr << "error: could not start channel " << usb.channel << std::endl;
+        return false;
+    }
+
+    canfilter_meter meter;
+    canfilter_meter_result before, after;
+    bool success = meter.run(*usb.transport(), seconds * 1000, before);
+    if (success) {
+        canfilter_meter::print_header();
+        canfilter_meter::print("before", before);
+        success = usb.programImage(image);
+        if (!success)
+            std::cerr << "error: programming failed" << std::endl;
+    } else {
+        std::cerr << "error: could not read bulk endpoint" << std::endl;
+    }
+    if (success) {
+        success = meter.run(*usb.transport(), seconds * 1000, after);
+        canfilter_meter::print("after", after);
+        if (before.frames_per_sec > 0)
+            std::cout << "filter drops " << std::fixed << std::setprecision(1)
+                      << 100 * (1 - after.frames_per_sec / before.frames_per_sec) << "% of received frames"
+                      << std::endl;
+    }
+    usb.stopChannel();
+    return success;
+}
+
+// Predict host load for each controller type
+bool plan_load(canfilter_load &load, const std::string &dbc_file, const std::string &output_mode,
+               const canfilter_ranges &spec, bool hybrid) {
+    if (!load.parse_dbc(dbc_file)) {
+        std::cerr << "error: could not read " << dbc_file << std::endl;
+        return false;
+    }
+
+    canfilter_load_result result;
+    canfilter_load::print_header();
+    load.estimate(nullptr, CANFILTER_DEV_BXCAN_F0, result);
+    canfilter_load::print("unfiltered", result);
+
+    for (canfilter_hardware_t dev : canfilter_device_list) {
+        if (output_mode != "auto" && output_mode != canfilter_device_name(dev))
+            continue;
+
+        std::unique_ptr<canfilter> filter(canfilter_create(dev));
+        canfilter_error_t err = spec.compile(*filter);
+        canfilter_hybrid split;
+        if (err == CANFILTER_ERROR_FULL && hybrid) {
+            err = split.split(spec, dev, &load);
+            if (err == CANFILTER_SUCCESS)
+                err = split.hardware.compile(*filter);
+        }
+        if (err != CANFILTER_SUCCESS) {
+            std::cout << canfilter_device_name(dev) << ": ";
+            print_error(err);
+            continue;
+        }
+
+        load.estimate(filter.get(), dev, result);
+        canfilter_load::print(canfilter_device_name(dev), result);
+
+        // residual: frames over USB that the host filter drops
+        if (!split.exact()) {
+            canfilter_load_result host;
+            load.estimate(&spec, dev, host);
+            canfilter_load::print("  host", host);
+            std::cout << "  residual " << result.frames_per_sec - host.frames_per_sec << " frames/s, "
+                      << result.messages - host.messages << " messages dropped by the host" << std::endl;
+        }
+    }
+
+    return true;
+}
+
+// Filter of one CAN channel: the IDs and ranges following -c N
+struct channel_filter {
+    uint16_t channel = 0;
+    bool given = false; // channel set by -c
+    std::vector<std::string> args;
+    bool allow_all = false;
+
+    bool empty() const {
+        return args.empty() && !allow_all;
+    }
+    canfilter_ranges spec;
+};
+
 bool canfilter_cli(int argc, char *argv[]) {
     std::unique_ptr<canfilter> filter;
-    std::vector<std::string> filter_args;
+    std::vector<channel_filter> channels(1);
+    std::string delta_args;
     std::string output_mode = "auto";
     int verbose = 0;
     bool dry_run = false;
-    bool allow_all = false;
+    std::string stats_format = "text";
+    canfilter_trace_print trace_print;
+    canfilter_trace *trace = nullptr;
 
     canfilter_usb usb_device;
     uint16_t usb_vid = 0;
     uint16_t usb_pid = 0;
     std::string usb_serial;
+    std::string usb_path;
     bool usb_specified = false;
+    std::vector<usb_device_info> usb_devices;
+    std::vector<std::string> usb_args; // -u arguments
+    bool usb_all = false;
+    uint32_t usb_count = 0;
+
+    canfilter_load load;
+    std::string dbc_file;
+    std::string hybrid_mode;
+    std::string adaptive_if;
+    double adaptive_rate = 100;
+    uint32_t measure_s = 0;
+    uint32_t fw_budget = 4096;
+    uint32_t bench_fw = 0;
+
+    std::string golden_file;
+    bool golden_update = false;
+
+    std::unique_ptr<gs_usb_sim> sim;
+    uint32_t sim_latency_us = 0;
+    uint32_t sim_fail = 0;
+    uint32_t sim_count = 1;
+    uint32_t bench_rounds = 0;
+    uint32_t sim_channels = 1;
+    bool sim_claim = false;
+    bool sim_full = false;
+    uint32_t sim_traffic = 0;
+
+    canfilter_daemon daemon;
+    bool daemon_mode = false;
+    std::string profiles_file;
+    std::string switch_file;
+    bool batch_mode = false;
+    std::string socketcan_if;
+    std::string bench_socket_if;
+    uint32_t bench_socket_frames = 0;
 
     /* parse options */
     for (int i = 1; i < argc; i++) {
@@ -126,139 +759,688 @@ bool canfilter_cli(int argc, char *argv[]) {
         } else if (arg == "-v" || arg == "--verbose") {
             verbose++;
         } else if (arg == "-a" || arg == "--allow-all") {
-            allow_all = true;
+            channels.back().allow_all = true;
+        } else if (arg == "-c" || arg == "--channel") {
+            if (++i >= argc) {
+                std::cerr << "error: missing channel" << std::endl;
+                return false;
+            }
+            char *end;
+            unsigned long channel = strtoul(argv[i], &end, 0);
+            if (*end || end == argv[i] || channel > 255) {
+                std::cerr << "error: invalid channel " << argv[i] << std::endl;
+                return false;
+            }
+            if (channels.back().given && channels.back().empty()) {
+                std::cerr << "error: no IDs for channel " << channels.back().channel << std::endl;
+                return false;
+            }
+            if (!channels.back().empty())
+                channels.push_back(channel_filter());
+            for (size_t c = 0; c + 1 < channels.size(); c++) {
+                if (channels[c].channel == channel) {
+                    std::cerr << "error: channel " << channel << " given twice" << std::endl;
+                    return false;
+                }
+            }
+            channels.back().channel = channel;
+            channels.back().given = true;
         } else if (arg == "-d" || arg == "--dry-run") {
             dry_run = true;
+        } else if (arg == "--trace") {
+            trace = &trace_print;
         } else if (arg == "-u" || arg == "--usb") {
             if (++i >= argc) {
                 std::cerr << "error: missing usb vid:pid" << std::endl;
                 return false;
             }
-            if (!parse_usb(argv[i], usb_vid, usb_pid, usb_serial)) {
-                std::cerr << "error: not vid:pid[@serial]" << std::endl;
+            if (!parse_usb(argv[i], usb_vid, usb_pid, usb_serial, usb_path)) {
+                std::cerr << "error: not vid:pid[@serial] or bus-port.port" << std::endl;
                 return false;
             }
             usb_specified = true;
+            usb_count++;
+            usb_args.push_back(argv[i]);
+        } else if (arg == "--all") {
+            usb_all = true;
+        } else if (arg == "--daemon") {
+            daemon_mode = true;
+        } else if (arg == "--profiles") {
+            if (++i >= argc) {
+                std::cerr << "error: missing profiles file" << std::endl;
+                return false;
+            }
+            profiles_file = argv[i];
+        } else if (arg == "--switch") {
+            if (++i >= argc) {
+                std::cerr << "error: missing profiles file" << std::endl;
+                return false;
+            }
+            switch_file = argv[i];
+        } else if (arg == "--batch") {
+            batch_mode = true;
+        } else if (arg == "--adaptive" || arg == "--adaptive-rate") {
+            if (++i >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            if (arg == "--adaptive") {
+                adaptive_if = argv[i];
+            } else {
+                char *end;
+                adaptive_rate = strtod(argv[i], &end);
+                if (*end || end == argv[i] || !std::isfinite(adaptive_rate) || adaptive_rate <= 0) {
+                    std::cerr << "error: invalid rate " << argv[i] << std::endl;
+                    return false;
+                }
+            }
+        } else if (arg == "--hybrid") {
+            if (++i >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            hybrid_mode = argv[i];
+            if (hybrid_mode != "socketcan" && hybrid_mode != "bpf" && hybrid_mode != "firmware") {
+                std::cerr << "error: invalid host filter " << hybrid_mode << std::endl;
+                return false;
+            }
+        } else if (arg == "--delta") {
+            if (++i >= argc) {
+                std::cerr << "error: missing delta filter" << std::endl;
+                return false;
+            }
+            delta_args = argv[i];
+        } else if (arg == "--stats") {
+            if (++i >= argc) {
+                std::cerr << "error: missing stats format" << std::endl;
+                return false;
+            }
+            stats_format = argv[i];
+            if (stats_format != "text" && stats_format != "json") {
+                std::cerr << "error: invalid stats format " << stats_format << std::endl;
+                return false;
+            }
+        } else if (arg == "--dbc") {
+            if (++i >= argc) {
+                std::cerr << "error: missing dbc file" << std::endl;
+                return false;
+            }
+            dbc_file = argv[i];
+        } else if (arg == "--golden" || arg == "--golden-update") {
+            if (++i >= argc) {
+                std::cerr << "error: missing golden file" << std::endl;
+                return false;
+            }
+            golden_file = argv[i];
+            golden_update = (arg == "--golden-update");
+        } else if (arg == "--sim") {
+            if (++i >= argc) {
+                std::cerr << "error: missing simulated device" << std::endl;
+                return false;
+            }
+            canfilter_hardware_t sim_dev = canfilter_device_from_name(argv[i]);
+            if (sim_dev == CANFILTER_DEV_NONE && std::string(argv[i]) != "none") {
+                std::cerr << "error: invalid simulated device " << argv[i] << std::endl;
+                return false;
+            }
+            sim.reset(new gs_usb_sim(sim_dev));
+            sim->has_filter = (sim_dev != CANFILTER_DEV_NONE);
+        } else if (arg == "--sim-latency" || arg == "--sim-fail" || arg == "--sim-count") {
+            if (++i >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            uint32_t &value = (arg == "--sim-latency") ? sim_latency_us : (arg == "--sim-fail") ? sim_fail : sim_count;
+            if (!parse_uint(argv[i], value) || (arg == "--sim-count" && value == 0)) {
+                std::cerr << "error: invalid value for " << arg << ": " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--bench-usb") {
+            if (++i >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            if (!parse_uint(argv[i], bench_rounds) || bench_rounds == 0) {
+                std::cerr << "error: invalid round count " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--detach") {
+            usb_device.keep_kernel_driver = false;
+        } else if (arg == "--path-cache") {
+            usb_device::path_cache = true;
+        } else if (arg == "--force") {
+            usb_device.skip_unchanged = false;
+        } else if (arg == "--sim-claim") {
+            sim_claim = true;
+        } else if (arg == "--socketcan") {
+            if (++i >= argc) {
+                std::cerr << "error: missing interface" << std::endl;
+                return false;
+            }
+            socketcan_if = argv[i];
+            output_mode = "socketcan";
+        } else if (arg == "--bpf") {
+            if (++i >= argc) {
+                std::cerr << "error: missing interface" << std::endl;
+                return false;
+            }
+            socketcan_if = argv[i];
+            output_mode = "bpf";
+        } else if (arg == "--fw-budget" || arg == "--bench-fw") {
+            if (++i >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            uint32_t value;
+            if (!parse_uint(argv[i], value) || value == 0) {
+                std::cerr << "error: invalid value " << argv[i] << std::endl;
+                return false;
+            }
+            if (arg == "--fw-budget") {
+                fw_budget = value;
+            } else {
+                bench_fw = value;
+                output_mode = "firmware";
+            }
+        } else if (arg == "--bench-socket") {
+            if (i + 2 >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            bench_socket_if = argv[++i];
+            if (!parse_uint(argv[++i], bench_socket_frames) || bench_socket_frames == 0) {
+                std::cerr << "error: invalid frame count " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--sim-full") {
+            sim_full = true;
+        } else if (arg == "--sim-traffic") {
+            if (++i >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            if (!parse_uint(argv[i], sim_traffic)) {
+                std::cerr << "error: invalid frame rate " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--measure") {
+            if (++i >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            if (!parse_uint(argv[i], measure_s) || measure_s == 0) {
+                std::cerr << "error: invalid duration " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--sim-channels") {
+            if (++i >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            if (!parse_uint(argv[i], sim_channels) || sim_channels == 0) {
+                std::cerr << "error: invalid channel count " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--timeout" || arg == "--retries") {
+            if (++i >= argc) {
+                std::cerr << "error: missing value for " << arg << std::endl;
+                return false;
+            }
+            uint32_t value;
+            if (arg == "--timeout") {
+                if (!parse_uint(argv[i], value) || value == 0) {
+                    std::cerr << "error: invalid timeout " << argv[i] << std::endl;
+                    return false;
+                }
+                usb_device.timeout_ms = value;
+            } else {
+                if (!parse_uint(argv[i], value, canfilter_usb::max_retries)) {
+                    std::cerr << "error: invalid retry count " << argv[i] << " (0 to " << canfilter_usb::max_retries
+                              << ")" << std::endl;
+                    return false;
+                }
+                usb_device.retries = value;
+            }
+        } else if (arg == "--bitrate") {
+            if (++i >= argc) {
+                std::cerr << "error: missing bitrate" << std::endl;
+                return false;
+            }
+            if (!parse_uint(argv[i], load.bitrate) || load.bitrate == 0) {
+                std::cerr << "error: invalid bitrate " << argv[i] << std::endl;
+                return false;
+            }
         } else if (arg == "-h" || arg == "--help") {
             print_help(argv[0]);
         } else if (arg[0] == '-') {
             std::cerr << "error: invalid argument: " << arg << std::endl;
             return false;
         } else {
-            filter_args.push_back(arg); // filter argument
+            channels.back().args.push_back(arg); // filter argument of the current channel
         }
     }
 
-    // open usb device if vid:pid given
-    if (usb_specified) {
-        if (!usb_device.open(usb_vid, usb_pid, usb_serial)) {
-            std::cerr << "error: could not open device" << std::endl;
+    if (channels.back().given && channels.back().empty()) {
+        std::cerr << "error: no IDs for channel " << channels.back().channel << std::endl;
+        return false;
+    }
+
+    // golden image regression check
+    if (!golden_file.empty()) {
+        canfilter_golden golden;
+        golden.verbose = verbose;
+        if (!golden.load(golden_file)) {
+            std::cerr << "error: could not read " << golden_file << std::endl;
             return false;
-        } else if (verbose)
-            std::cerr << "usb device open success" << std::endl;
+        }
+        if (golden_update)
+            return golden.save(golden_file);
+        return golden.check();
     }
 
-    // create canbus filter
-    canfilter_hardware_t hw_filter = CANFILTER_DEV_NONE;
-    if (output_mode == "auto") {
-        if (usb_device.hasHardwareFilter()) {
-            hw_filter = (canfilter_hardware_t)usb_device.getFilterInfo();
-        } else {
-            std::cerr << "error: no hardware filter\n";
+    // parse filter arguments into a controller-independent specification per channel
+    for (auto &ch : channels) {
+        bool parse_ok;
+        {
+            canfilter_trace_timer timer(trace, CANFILTER_STAGE_PARSE);
+            ch.spec.verbose = verbose;
+            ch.spec.begin();
+            if (ch.allow_all)
+                ch.spec.allow_all();
+            parse_ok = ch.args.empty() || ch.spec.parse(ch.args);
+            timer.event.blocks_out = ch.spec.ranges.size();
+            timer.event.success = parse_ok;
+        }
+
+        if (!parse_ok) {
+            std::cerr << "error: failed to parse filter arguments: ";
+            print_error(ch.spec.error);
             return false;
         }
-    } else if (output_mode == "bxcan_f0") {
-        hw_filter = CANFILTER_DEV_BXCAN_F0;
-    } else if (output_mode == "bxcan_f4") {
-        hw_filter = CANFILTER_DEV_BXCAN_F4;
-    } else if (output_mode == "fdcan_g0") {
-        hw_filter = CANFILTER_DEV_FDCAN_G0;
-    } else if (output_mode == "fdcan_h7") {
-        hw_filter = CANFILTER_DEV_FDCAN_H7;
-    } else {
-        std::cerr << "error: invalid output mode " << output_mode << std::endl;
+    }
+
+    // channel 0, or the only channel given
+    canfilter_ranges &spec = channels[0].spec;
+    bool have_spec = !channels.back().empty();
+    bool multi_channel = channels.size() > 1 || channels[0].channel != 0;
+    if (multi_channel && (daemon_mode || !switch_file.empty() || batch_mode || !adaptive_if.empty() || measure_s ||
+                          bench_rounds || usb_all || usb_count > 1 || sim_count > 1)) {
+        std::cerr << "error: -c needs a single adapter" << std::endl;
+        return false;
+    }
+    if (channels.size() > 1 && !delta_args.empty()) {
+        std::cerr << "error: --delta needs a single channel" << std::endl;
         return false;
     }
 
-    switch (hw_filter) {
-        case CANFILTER_DEV_BXCAN_F0:
-            filter.reset(new canfilter_bxcan_f0());
-            if (verbose)
-                std::cerr << "Using bxCAN (F0/F1/F3) with 14 filter banks" << std::endl;
-            break;
-        case CANFILTER_DEV_BXCAN_F4:
-            filter.reset(new canfilter_bxcan_f4());
-            if (verbose)
-                std::cerr << "Using bxCAN (F4/F7) with 28 filter banks" << std::endl;
-            break;
-        case CANFILTER_DEV_FDCAN_G0:
-            filter.reset(new canfilter_fdcan_g0());
-            if (verbose)
-                std::cerr << "Using FDCAN (G0) with 28 standard, 8 extended filters" << std::endl;
-            break;
-        case CANFILTER_DEV_FDCAN_H7:
-            filter.reset(new canfilter_fdcan_h7());
-            if (verbose)
-                std::cerr << "Using FDCAN (H7) with 128 standard, 64 extended filters" << std::endl;
-            break;
-        case CANFILTER_DEV_NONE:
-        default:
-            std::cerr << "error: invalid output mode " << output_mode << std::endl;
+    // daemon: command line filter is the default profile
+    if (daemon_mode || !switch_file.empty()) {
+        spec.end();
+        daemon.verbose = verbose;
+        daemon.timeout_ms = usb_device.timeout_ms;
+        daemon.retries = usb_device.retries;
+        daemon.skip_unchanged = usb_device.skip_unchanged;
+        if (output_mode != "auto") {
+            daemon.dev = canfilter_device_from_name(output_mode);
+            if (daemon.dev == CANFILTER_DEV_NONE) {
+                std::cerr << "error: invalid output mode " << output_mode << std::endl;
+                return false;
+            }
+        }
+        if (sim) {
+            sim->latency_us = sim_latency_us;
+            sim->fail_first = sim_fail;
+            sim->vendor_needs_claim = sim_claim;
+            sim->compact = !sim_full;
+        }
+        if (!switch_file.empty()) {
+            if (sim)
+                usb_device.set_transport(sim.get());
+            else if (usb_specified &&
+                     !(usb_path.empty() ? usb_device.open(usb_vid, usb_pid, usb_serial) : usb_device.open(usb_path))) {
+                std::cerr << "error: could not open device" << std::endl;
+                return false;
+            }
+            return run_switch(daemon, switch_file, usb_device);
+        }
+        return run_daemon(daemon, profiles_file, have_spec ? &spec : nullptr, sim.get(), sim_count);
+    }
+
+    // batch: command line filter is the initial specification
+    if (batch_mode) {
+        canfilter_batch batch(usb_device);
+        batch.verbose = verbose;
+        batch.dry_run = dry_run;
+        if (output_mode != "auto") {
+            batch.dev = canfilter_device_from_name(output_mode);
+            if (batch.dev == CANFILTER_DEV_NONE) {
+                std::cerr << "error: invalid output mode " << output_mode << std::endl;
+                return false;
+            }
+        } else if (dry_run) {
+            std::cerr << "error: --batch with -d needs -o" << std::endl;
             return false;
-            break;
+        }
+        if (sim) {
+            sim->latency_us = sim_latency_us;
+            sim->fail_first = sim_fail;
+            sim->vendor_needs_claim = sim_claim;
+            sim->compact = !sim_full;
+            usb_device.set_transport(sim.get());
+        } else if (!dry_run && usb_specified &&
+                   !(usb_path.empty() ? usb_device.open(usb_vid, usb_pid, usb_serial) : usb_device.open(usb_path))) {
+            std::cerr << "error: could not open device" << std::endl;
+            return false;
+        }
+        return batch.start(spec) && batch.run(std::cin, std::cout);
     }
 
-    filter->verbose = verbose;
+    if (!have_spec) {
+        if (verbose)
+            std::cerr << "no filter specified" << std::endl;
+        return false;
+    }
 
-    // parse filter arguments
-    filter->begin();
+    for (auto &ch : channels) {
+        canfilter_trace_timer timer(trace, CANFILTER_STAGE_NORMALIZE);
+        timer.event.ranges_in = ch.spec.ranges.size();
+        ch.spec.end();
+        timer.event.blocks_out = ch.spec.ranges.size();
+    }
 
-    if (allow_all)
-        filter->allow_all();
+    // host load planning does not need hardware
+    if (!dbc_file.empty())
+        return plan_load(load, dbc_file, output_mode, spec, !hybrid_mode.empty());
 
-    if (!filter_args.empty() && !filter->parse(filter_args)) {
-        std::cerr << "error: failed to parse filter arguments\n";
-        return false;
+    // host and firmware software filters instead of an adapter
+    if (output_mode == "socketcan" || output_mode == "bpf" || output_mode == "firmware" || !bench_socket_if.empty()) {
+        if (multi_channel) {
+            std::cerr << "error: -c needs a USB adapter" << std::endl;
+            return false;
+        }
+        if (!bench_socket_if.empty())
+            return bench_socket(bench_socket_if, bench_socket_frames, spec, stats_format);
+        if (output_mode == "bpf")
+            return bpf_filter(spec, verbose, stats_format, dry_run ? "" : socketcan_if, trace);
+        if (output_mode == "firmware")
+            return firmware_filter(spec, verbose, stats_format, fw_budget, bench_fw, trace);
+        return socket_filter(spec, verbose, stats_format, dry_run ? "" : socketcan_if, trace);
     }
 
-    filter->end();
+    usb_device.trace = trace;
 
-    if (!allow_all && filter_args.empty()) {
-        if (verbose)
-            std::cerr << "no filter specified" << std::endl;
-        return false;
+    // simulated adapter instead of usb
+    if (sim) {
+        sim->latency_us = sim_latency_us;
+        sim->fail_first = sim_fail;
+        sim->vendor_needs_claim = sim_claim;
+        sim->compact = !sim_full;
+        sim->channels = sim_channels;
+        sim->bus_rate = sim_traffic;
+        if (!usb_device.keep_kernel_driver)
+            sim->claim_interface();
+        usb_device.set_transport(sim.get());
     }
 
-    // debugging
-    if (verbose > 1) {
-        // print registers as ranges and ids
-        filter->debug_print();
+    // adapt the filter to the traffic on the interface
+    if (!adaptive_if.empty()) {
+        canfilter_hardware_t dev = canfilter_device_from_name(output_mode);
+        if (output_mode == "auto" && usb_device.hasHardwareFilter())
+            dev = (canfilter_hardware_t)usb_device.getFilterInfo();
+        if (dev == CANFILTER_DEV_NONE) {
+            std::cerr << "error: no hardware filter" << std::endl;
+            return false;
+        }
+        return run_adaptive(adaptive_if, adaptive_rate, spec, dev, usb_device, verbose);
+    }
 
-        if (verbose > 2)
-            // dump registers in hex
-            filter->debug_print_reg();
+    // latency benchmark
+    if (bench_rounds) {
+        canfilter_hardware_t dev = CANFILTER_DEV_NONE;
+        if (output_mode != "auto") {
+            dev = canfilter_device_from_name(output_mode);
+            if (dev == CANFILTER_DEV_NONE) {
+                std::cerr << "error: invalid output mode " << output_mode << std::endl;
+                return false;
+            }
+        }
+        return bench_usb(bench_rounds, spec, dev, sim.get(), usb_specified, usb_vid, usb_pid, usb_serial, usb_path,
+                         usb_device, stats_format);
     }
 
-    // usage
-    if (verbose)
-        std::cout << "\n";
-    filter->print_usage();
+    // many adapters: program in parallel
+    if (usb_all || usb_count > 1 || (sim && sim_count > 1)) {
+        if (usb_all)
+            usb_device::enumerate(canfilter_usb::default_vid_pid_list_, "", usb_devices);
+        for (const auto &arg : usb_args) {
+            std::vector<usb_device_info> found;
+            usb_device_info info;
+            parse_usb(arg, usb_vid, usb_pid, usb_serial, usb_path);
+            if (!usb_path.empty()) {
+                if (usb_device::find_path(usb_path, info))
+                    usb_devices.push_back(info);
+            } else if (usb_device::resolve(usb_vid, usb_pid, usb_serial, found)) {
+                usb_devices.insert(usb_devices.end(), found.begin(), found.end());
+            }
+        }
+
+        // same adapter matched by more than one -u
+        std::vector<usb_device_info> unique;
+        for (const auto &info : usb_devices) {
+            bool seen = false;
+            for (const auto &u : unique)
+                seen = seen || (u.path == info.path);
+            if (!seen)
+                unique.push_back(info);
+        }
 
-    // no programming if dry run.
-    if (dry_run) {
+        canfilter_hardware_t dev = CANFILTER_DEV_NONE;
+        if (output_mode != "auto") {
+            dev = canfilter_device_from_name(output_mode);
+            if (dev == CANFILTER_DEV_NONE) {
+                std::cerr << "error: invalid output mode " << output_mode << std::endl;
+                return false;
+            }
+        }
+
+        if (dry_run) {
+            for (const auto &info : unique)
+                std::cout << info.path << " " << (info.serial.empty() ? "-" : info.serial) << std::endl;
+            return true;
+        }
+
+        return program_parallel(spec, dev, unique, sim.get(), sim_count, usb_device);
+    }
+
+    // open usb device if vid:pid or path given
+    if (usb_specified) {
+        bool opened = usb_path.empty() ? usb_device.open(usb_vid, usb_pid, usb_serial) : usb_device.open(usb_path);
+        if (!opened) {
+            std::cerr << "error: could not open device" << std::endl;
+            return false;
+        } else if (verbose)
+            std::cerr << "usb device open success" << std::endl;
+    }
+
+    // receive meter
+    if (measure_s)
+        return measure_filter(usb_device, spec, output_mode, measure_s, load.bitrate);
+
+    // adapter must have the channels
+    if (multi_channel && !(dry_run && output_mode != "auto")) {
+        uint32_t count = usb_device.getChannelCount();
+        for (const auto &ch : channels) {
+            if (count && ch.channel >= count) {
+                std::cerr << "error: adapter has no channel " << ch.channel << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // compile specification into hardware filter, print usage and emit the image
+    canfilter_hardware_t hw_filter = CANFILTER_DEV_NONE;
+    bool compiled = false;
+    const canfilter_ranges *spec_ch = &spec;
+    canfilter_hybrid hybrid;
+    auto build = [&](uint32_t filter_type, canfilter_image &image) -> canfilter_error_t {
+        hw_filter = (canfilter_hardware_t)filter_type;
+        filter.reset(canfilter_create(hw_filter));
+        if (!filter) {
+            std::cerr << "error: invalid output mode " << output_mode << std::endl;
+            return CANFILTER_ERROR_PARAM;
+        }
         if (verbose)
-            std::cerr << "not programming hardware" << std::endl;
-        return true;
+            std::cerr << "Using " << canfilter_device_description(hw_filter) << std::endl;
+
+        filter->verbose = verbose;
+
+        canfilter_error_t err = spec_ch->compile(*filter, trace);
+        hybrid = canfilter_hybrid();
+        if (err == CANFILTER_ERROR_FULL && !hybrid_mode.empty()) {
+            // superset in hardware, the rest in the host
+            err = hybrid.split(*spec_ch, hw_filter);
+            if (err == CANFILTER_SUCCESS)
+                err = hybrid.hardware.compile(*filter, trace);
+        }
+        if (err != CANFILTER_SUCCESS) {
+            std::cerr << "error: ";
+            print_error(err);
+            return err;
+        }
+        compiled = true;
+
+        // debugging
+        if (verbose > 1) {
+            // print registers as ranges and ids
+            filter->debug_print();
+
+            if (verbose > 2)
+                // dump registers in hex
+                filter->debug_print_reg();
+        }
+
+        // usage
+        if (stats_format == "json") {
+            canfilter_stats stats;
+            filter->get_stats(stats);
+            canfilter_print_stats_json(std::cout, stats);
+        } else {
+            if (verbose)
+                std::cout << "\n";
+            filter->print_usage();
+        }
+
+        // hardware image
+        canfilter_trace_timer timer(trace, CANFILTER_STAGE_EMIT);
+        const uint8_t *p = (const uint8_t *)filter->get_hw_config();
+        image.dev = hw_filter;
+        image.data.assign(p, p + filter->get_hw_size());
+        filter->get_hw_config_compact(image.compact);
+        image.hash = canfilter_image_hash(image.data.data(), image.data.size());
+        timer.event.bytes = image.data.size();
+        return CANFILTER_SUCCESS;
+    };
+
+    // host filter for the IDs a hybrid hardware filter lets through
+    auto host_filter = [&]() {
+        if (hybrid.exact())
+            return true;
+        hybrid.print(std::cout);
+        std::cout << "Host filter:" << std::endl;
+        if (hybrid_mode == "bpf")
+            return bpf_filter(*spec_ch, verbose, stats_format, "", trace);
+        if (hybrid_mode == "firmware")
+            return firmware_filter(*spec_ch, verbose, stats_format, fw_budget, 0, trace);
+        return socket_filter(*spec_ch, verbose, stats_format, "", trace);
+    };
+
+    // program all channels in one session
+    bool all_success = true;
+
+    // the adapter filters nothing: fail, but print the socket filters to apply instead
+    auto no_hw_filter = [&]() {
+        std::cerr << "error: no hardware filter, filter in the host with SocketCAN:\n";
+        socket_filter(*spec_ch, verbose, stats_format, "", trace);
+        all_success = false;
+    };
+    for (const auto &ch : channels) {
+        usb_device.channel = ch.channel;
+        spec_ch = &ch.spec;
+        compiled = false;
+        if (multi_channel && stats_format != "json")
+            std::cout << "Channel " << ch.channel << ":" << std::endl;
+
+        canfilter_image image;
+        bool success;
+        if (output_mode == "auto" && !dry_run) {
+            // query, compile and program in one pipeline
+            canfilter_error_t err = usb_device.queryAndProgram(build);
+            success = (err == CANFILTER_SUCCESS);
+            if (!success && !compiled && usb_device.features_known &&
+                !(usb_device.features & GS_CAN_FEATURE_FILTER)) {
+                no_hw_filter();
+                continue;
+            } else if (!success && !compiled && err == CANFILTER_ERROR_PLATFORM) {
+                std::cerr << "error: no hardware filter\n";
+                return false;
+            } else if (!success && !compiled) {
+                return false;
+            }
+            if (compiled && !host_filter())
+                return false;
+        } else {
+            // create canbus filter
+            if (output_mode == "auto") {
+                if (usb_device.hasHardwareFilter()) {
+                    hw_filter = (canfilter_hardware_t)usb_device.getFilterInfo();
+                } else if (usb_device.features_known) {
+                    no_hw_filter();
+                    continue;
+                } else {
+                    std::cerr << "error: no hardware filter\n";
+                    return false;
+                }
+            } else {
+                hw_filter = canfilter_device_from_name(output_mode);
+            }
+
+            if (build(hw_filter, image) != CANFILTER_SUCCESS || !host_filter())
+                return false;
+
+            // no programming if dry run.
+            if (dry_run) {
+                if (verbose)
+                    std::cerr << "not programming hardware" << std::endl;
+                continue;
+            }
+
+            // program hardware filter
+            success = usb_device.programImage(image);
+        }
+
+        if (!success)
+            std::cerr << "usb programming fail\n";
+        else if (usb_device.unchanged)
+            std::cout << "Filter unchanged\n";
+        else if (verbose)
+            std::cerr << "usb programming success\n";
+
+        if (success && !delta_args.empty()) {
+            success = program_delta(usb_device, *filter, delta_args, sim.get(), trace);
+            if (!success)
+                std::cerr << "usb delta programming fail\n";
+        }
+
+        all_success = all_success && success;
     }
 
-    // program hardware filter
-    bool success = usb_device.programFilter(filter->get_hw_config(), filter->get_hw_size());
-    if (!success)
-        std::cerr << "usb programming fail\n";
-    else if (verbose)
-        std::cerr << "usb programming success\n";
+    if (dry_run)
+        return true;
 
-    return success;
+    if (sim && verbose)
+        sim->debug_print();
+
+    return all_success;
 }
 
 int main(int argc, char *argv[]) {
@@ -0,0 +1,178 @@
+/*
+ * canfilter_classifier_test.cpp
+ *
+ * Checks canfilter_classifier against canfilter::accepts().
+ *
+ * Responsibilities:
+ * - Compile fixed and pseudo-random specifications into a classifier.
+ * - Compare match() and classify() with accepts() of the specification at
+ *   every range boundary, at extended leaf boundaries and at random IDs.
+ *
+ * Notes:
+ * - Built twice by "make test", with and without -mavx2, so both the
+ *   AVX2 gather path and the scalar loop of classify() are checked.
+ * - classify() gets arrays whose length is not a multiple of 8, so the
+ *   scalar tail runs after the vector loop.
+ */
+
+#include "canfilter_classifier.hpp"
+#include "canfilter_ranges.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// copies, so that std::min and push_back do not need definitions of the class constants
+static const uint32_t eff_flag = canfilter_classifier::eff_flag;
+static const uint32_t leaf_bits = canfilter_classifier::leaf_bits;
+static const uint32_t max_std_id = canfilter::max_std_id;
+static const uint32_t max_ext_id = canfilter::max_ext_id;
+
+static uint32_t checks = 0;
+static uint32_t failures = 0;
+
+// can_ids at and next to the boundaries of every range, of both formats
+static void boundary_ids(const canfilter_ranges &spec, std::vector<uint32_t> &can_ids) {
+    for (const auto &r : spec.ranges) {
+        uint32_t max_id = r.ext ? max_ext_id : max_std_id;
+        uint32_t flag = r.ext ? eff_flag : 0;
+        const uint32_t ids[4] = {r.begin - 1, r.begin, r.end, r.end + 1};
+        for (uint32_t id : ids) {
+            if (id > max_id)
+                continue;
+            can_ids.push_back(flag | id);
+            can_ids.push_back((flag ^ eff_flag) | (id & max_std_id));
+        }
+    }
+    for (uint32_t leaf = 1; leaf < 64; leaf++) {
+        uint32_t id = (leaf * 0x7919U << leaf_bits) & max_ext_id;
+        can_ids.push_back(eff_flag | id);
+        can_ids.push_back(eff_flag | ((id - 1) & max_ext_id));
+    }
+    can_ids.push_back(0);
+    can_ids.push_back(max_std_id);
+    can_ids.push_back(eff_flag);
+    can_ids.push_back(eff_flag | max_ext_id);
+}
+
+static bool expected(const canfilter_ranges &spec, uint32_t can_id) {
+    bool ext = can_id & eff_flag;
+    return spec.accepts(can_id & (ext ? max_ext_id : max_std_id), ext);
+}
+
+static void check(const std::string &name, const canfilter_ranges &spec, std::mt19937 &rng) {
+    canfilter_classifier classifier;
+    if (spec.compile(classifier) != CANFILTER_SUCCESS) {
+        std::cout << "FAIL  " << name << ": does not compile" << std::endl;
+        failures++;
+        return;
+    }
+
+    std::vector<uint32_t> can_ids;
+    boundary_ids(spec, can_ids);
+    for (int n = 0; n < 1000; n++) {
+        uint32_t can_id = rng();
+        can_ids.push_back(can_id & (eff_flag | max_ext_id));
+    }
+    // RTR and error flags do not change the result
+    size_t plain = can_ids.size();
+    for (size_t n = 0; n < plain; n += 7)
+        can_ids.push_back(can_ids[n] | 0x40000000U);
+
+    uint32_t mismatches = 0;
+    for (uint32_t can_id : can_ids) {
+        checks++;
+        if (classifier.match(can_id) != expected(spec, can_id & ~0x60000000U))
+            mismatches++;
+    }
+
+    // every length from 0 to 17 and the whole array, from every offset up to 8
+    for (size_t offset = 0; offset < 8 && offset < can_ids.size(); offset++) {
+        for (size_t n = 0; offset + n <= can_ids.size(); n = (n < 17) ? n + 1 : can_ids.size() - offset) {
+            std::vector<uint8_t> accept(n + 1, 0xAA);
+            size_t accepted = classifier.classify(can_ids.data() + offset, n, accept.data());
+            size_t count = 0;
+            for (size_t i = 0; i < n; i++) {
+                checks++;
+                bool want = expected(spec, can_ids[offset + i] & ~0x60000000U);
+                if (accept[i] != (want ? 1 : 0))
+                    mismatches++;
+                count += want;
+            }
+            if (accepted != count || accept[n] != 0xAA)
+                mismatches++;
+            if (n == can_ids.size() - offset)
+                break;
+        }
+    }
+
+    if (mismatches) {
+        std::cout << "FAIL  " << name << ": " << mismatches << " mismatches" << std::endl;
+        failures++;
+    }
+}
+
+int main() {
+#ifdef __AVX2__
+    if (!__builtin_cpu_supports("avx2")) {
+        std::cout << "classifier: CPU without AVX2, skipped" << std::endl;
+        return 0;
+    }
+    const char *path = "avx2";
+#else
+    const char *path = "scalar";
+#endif
+
+    static const char *const fixed[] = {
+        "0x100",
+        "0x100-0x1ff 0x7df 0x7e8-0x7ef",
+        "0-0x7ff",
+        "0-0x7ff 0-0x1fffffff",
+        "0x18fef100 0x0cf00400 0x18fee000-0x18fee0ff",
+        "0x1fff-0x2000 0x3fffff-0x400000 0x1ffffffe-0x1fffffff",
+        "0x100-0x17f 0x150-0x1ff 0x120 0x100-0x17f",
+        "0x800-0x1fffffff",
+    };
+
+    std::mt19937 rng(1);
+    uint32_t specs = 0;
+    for (const char *text : fixed) {
+        canfilter_ranges spec;
+        std::istringstream words(text);
+        std::vector<std::string> args;
+        std::string word;
+        while (words >> word)
+            args.push_back(word);
+        spec.begin();
+        spec.parse(args);
+        spec.end();
+        check(text, spec, rng);
+        specs++;
+    }
+
+    for (int n = 0; n < 200; n++) {
+        canfilter_ranges spec;
+        spec.begin();
+        int count = rng() % 40;
+        for (int k = 0; k < count; k++) {
+            if (rng() % 2) {
+                uint32_t begin = rng() % (max_std_id + 1);
+                spec.add_std_range(begin, std::min<uint32_t>(max_std_id, begin + rng() % 64));
+            } else {
+                uint32_t begin = rng() & max_ext_id;
+                uint32_t width = (rng() % 4 == 0) ? rng() % 100000 : rng() % 4;
+                spec.add_ext_range(begin, std::min<uint32_t>(max_ext_id, begin + width));
+            }
+        }
+        spec.end();
+        check("random " + std::to_string(n), spec, rng);
+        specs++;
+    }
+
+    std::cout << "classifier (" << path << "): " << specs << " specifications, " << checks << " checks, "
+              << failures << " failed" << std::endl;
+    return failures ? 1 : 0;
+}
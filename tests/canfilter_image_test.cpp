@@ -0,0 +1,196 @@
+/*
+ * canfilter_image_test.cpp
+ *
+ * Checks the hardware image encodings of the bxCAN and FDCAN builders.
+ *
+ * Responsibilities:
+ * - Compile fixed and pseudo-random specifications for every controller type.
+ * - Load the compact image into a fresh builder, as firmware would, and
+ *   compare the result with the full image.
+ * - Check that malformed compact images are refused.
+ * - Program a sequence of edited specifications through one builder, as
+ *   --batch does, and apply every delta to a copy of the previous image:
+ *   the copy must equal the builder's image.
+ *
+ * Notes:
+ * - Specifications that do not fit a controller are skipped for it; the
+ *   random ones are small enough that most fit every controller.
+ * - A delta may renumber banks or elements (canfilter::reordered); the
+ *   copy is compared with the renumbered image, not with a fresh compile.
+ */
+
+#include "canfilter_device.hpp"
+#include "canfilter_ranges.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// copies, so that std::min does not need definitions of the class constants
+static const uint32_t max_std_id = canfilter::max_std_id;
+static const uint32_t max_ext_id = canfilter::max_ext_id;
+
+static uint32_t checks = 0;
+static uint32_t failures = 0;
+static uint32_t deltas = 0;
+static uint32_t reordered = 0; // deltas that renumbered banks or elements
+
+static void fail(const std::string &name, canfilter_hardware_t dev, const std::string &what) {
+    std::cout << "FAIL  " << name << " on " << canfilter_device_name(dev) << ": " << what << std::endl;
+    failures++;
+}
+
+static bool same_image(canfilter &filter, const std::vector<uint8_t> &data) {
+    return filter.get_hw_size() == data.size() && std::memcmp(filter.get_hw_config(), data.data(), data.size()) == 0;
+}
+
+// Pseudo-random specification of up to count IDs and ranges
+static void random_spec(std::mt19937 &rng, int count, canfilter_ranges &spec) {
+    spec.begin();
+    for (int k = 0; k < count; k++) {
+        bool ext = rng() % 3 == 0;
+        uint32_t max_id = ext ? max_ext_id : max_std_id;
+        uint32_t begin = rng() & max_id;
+        uint32_t end = (rng() % 2) ? begin : std::min<uint32_t>(max_id, begin + rng() % 300);
+        if (ext)
+            spec.add_ext_range(begin, end);
+        else
+            spec.add_std_range(begin, end);
+    }
+    spec.end();
+}
+
+// Compact image of spec, loaded into a fresh builder, gives the full image
+static void check_compact(const std::string &name, const canfilter_ranges &spec, canfilter_hardware_t dev) {
+    canfilter_image image;
+    if (canfilter_compile(dev, spec, image) != CANFILTER_SUCCESS)
+        return;
+
+    checks++;
+    std::unique_ptr<canfilter> loaded(canfilter_create(dev));
+    if (!loaded->set_hw_config_compact(image.compact.data(), image.compact.size())) {
+        fail(name, dev, "compact image refused");
+        return;
+    }
+    if (!same_image(*loaded, image.data))
+        fail(name, dev, "compact image differs from full image");
+
+    // one byte short, one byte long, another controller type
+    std::vector<uint8_t> bad(image.compact.begin(), image.compact.end() - 1);
+    checks++;
+    if (loaded->set_hw_config_compact(bad.data(), bad.size()))
+        fail(name, dev, "short compact image accepted");
+    bad = image.compact;
+    bad.push_back(0);
+    checks++;
+    if (loaded->set_hw_config_compact(bad.data(), bad.size()))
+        fail(name, dev, "long compact image accepted");
+    bad = image.compact;
+    bad[0] ^= 0x80;
+    checks++;
+    if (loaded->set_hw_config_compact(bad.data(), bad.size()))
+        fail(name, dev, "compact image of other controller accepted");
+}
+
+// Edit spec: add or remove one random ID or range
+static void edit_spec(std::mt19937 &rng, canfilter_ranges &spec) {
+    if (!spec.ranges.empty() && rng() % 3 == 0) {
+        spec.ranges.erase(spec.ranges.begin() + rng() % spec.ranges.size());
+        spec.clear_replay();
+        spec.end();
+        return;
+    }
+    canfilter_ranges one;
+    random_spec(rng, 1, one);
+    spec.ranges.insert(spec.ranges.end(), one.ranges.begin(), one.ranges.end());
+    spec.clear_replay();
+    spec.end();
+}
+
+// Deltas of a sequence of edits, applied to a copy of the image, reproduce the builder's image
+static void check_delta(const std::string &name, canfilter_hardware_t dev, std::mt19937 &rng) {
+    std::unique_ptr<canfilter> filter(canfilter_create(dev));
+    std::unique_ptr<canfilter> adapter(canfilter_create(dev));
+    canfilter_ranges spec;
+    random_spec(rng, 4, spec);
+
+    bool first = true;
+    for (int step = 0; step < 40; step++, edit_spec(rng, spec)) {
+        if (spec.compile(*filter) != CANFILTER_SUCCESS)
+            continue;
+
+        std::vector<uint8_t> delta;
+        checks++;
+        if (!filter->get_hw_config_delta(delta)) {
+            if (!first)
+                fail(name, dev, "no delta at step " + std::to_string(step));
+            std::memcpy(adapter->get_hw_config(), filter->get_hw_config(), filter->get_hw_size());
+            first = false;
+            continue;
+        }
+        if (first) {
+            fail(name, dev, "delta without previous image");
+            return;
+        }
+        deltas++;
+        reordered += filter->reordered;
+        if (!adapter->apply_hw_config_delta(delta.data(), delta.size())) {
+            fail(name, dev, "delta refused at step " + std::to_string(step));
+            return;
+        }
+        std::vector<uint8_t> image((const uint8_t *)filter->get_hw_config(),
+                                   (const uint8_t *)filter->get_hw_config() + filter->get_hw_size());
+        if (!same_image(*adapter, image)) {
+            fail(name, dev, "delta result differs at step " + std::to_string(step));
+            return;
+        }
+    }
+}
+
+int main() {
+    static const char *const fixed[] = {
+        "0x100",
+        "0x100-0x1ff 0x7df 0x7e8-0x7ef",
+        "0-0x7ff",
+        "0x18fef100 0x0cf00400 0x18fee000-0x18fee0ff",
+        "0x100 0x200 0x300 0x400 0x500 0x12345678 0x1abcdef0",
+    };
+
+    std::mt19937 rng(1);
+    uint32_t specs = 0;
+    for (const char *text : fixed) {
+        canfilter_ranges spec;
+        std::istringstream words(text);
+        std::vector<std::string> args;
+        std::string word;
+        while (words >> word)
+            args.push_back(word);
+        spec.begin();
+        spec.parse(args);
+        spec.end();
+        for (canfilter_hardware_t dev : canfilter_device_list)
+            check_compact(text, spec, dev);
+        specs++;
+    }
+
+    for (int n = 0; n < 200; n++) {
+        canfilter_ranges spec;
+        random_spec(rng, rng() % 12, spec);
+        for (canfilter_hardware_t dev : canfilter_device_list)
+            check_compact("random " + std::to_string(n), spec, dev);
+        specs++;
+    }
+
+    for (int n = 0; n < 50; n++)
+        for (canfilter_hardware_t dev : canfilter_device_list)
+            check_delta("delta " + std::to_string(n), dev, rng);
+
+    std::cout << "image: " << specs << " specifications, " << deltas << " deltas (" << reordered << " reordered), "
+              << checks << " checks, " << failures << " failed" << std::endl;
+    return failures ? 1 : 0;
+}
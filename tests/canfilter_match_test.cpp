@@ -0,0 +1,185 @@
+/*
+ * canfilter_match_test.cpp
+ *
+ * Checks the host filter backends against canfilter::accepts().
+ *
+ * Responsibilities:
+ * - Compile fixed and pseudo-random specifications into a BPF program and
+ *   into firmware lookup tables.
+ * - Compare canfilter_bpf::match() and canfilter_firmware::match() with
+ *   accepts() of the specification at every range boundary and at random IDs.
+ *
+ * Notes:
+ * - canfilter_bpf::match() runs the program in the interpreter of
+ *   canfilter_bpf, so no kernel or CAN interface is needed.
+ * - The firmware tables get a flash budget large enough for the random
+ *   specifications, so the perfect hash of many single extended IDs is
+ *   exercised.
+ * - Specifications a backend cannot hold (CANFILTER_ERROR_FULL) are skipped
+ *   for it and counted.
+ */
+
+#include "canfilter_bpf.hpp"
+#include "canfilter_firmware.hpp"
+#include "canfilter_ranges.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// copies, so that std::min and push_back do not need definitions of the class constants
+static const uint32_t eff_flag = CANFILTER_CAN_EFF_FLAG;
+static const uint32_t rtr_flag = CANFILTER_CAN_RTR_FLAG;
+static const uint32_t max_std_id = canfilter::max_std_id;
+static const uint32_t max_ext_id = canfilter::max_ext_id;
+
+static uint32_t checks = 0;
+static uint32_t failures = 0;
+static uint32_t skipped = 0;
+
+// can_ids at and next to the boundaries of every range, of both formats, and random can_ids
+static void test_ids(const canfilter_ranges &spec, std::mt19937 &rng, std::vector<uint32_t> &can_ids) {
+    for (const auto &r : spec.ranges) {
+        uint32_t max_id = r.ext ? max_ext_id : max_std_id;
+        uint32_t flag = r.ext ? eff_flag : 0;
+        const uint32_t ids[4] = {r.begin - 1, r.begin, r.end, r.end + 1};
+        for (uint32_t id : ids) {
+            if (id > max_id)
+                continue;
+            can_ids.push_back(flag | id);
+            can_ids.push_back((flag ^ eff_flag) | (id & max_std_id));
+        }
+    }
+    for (int n = 0; n < 1000; n++) {
+        uint32_t can_id = rng();
+        can_ids.push_back(can_id & (eff_flag | max_ext_id));
+    }
+    can_ids.push_back(0);
+    can_ids.push_back(max_std_id);
+    can_ids.push_back(eff_flag);
+    can_ids.push_back(eff_flag | max_ext_id);
+
+    // remote frames are filtered like data frames
+    size_t plain = can_ids.size();
+    for (size_t n = 0; n < plain; n += 7)
+        can_ids.push_back(can_ids[n] | rtr_flag);
+}
+
+static bool expected(const canfilter_ranges &spec, uint32_t can_id) {
+    bool ext = can_id & eff_flag;
+    return spec.accepts(can_id & (ext ? max_ext_id : max_std_id), ext);
+}
+
+static void check_bpf(const std::string &name, const canfilter_ranges &spec, const std::vector<uint32_t> &can_ids) {
+    canfilter_bpf bpf;
+    canfilter_error_t err = spec.compile(bpf);
+    if (err == CANFILTER_ERROR_FULL) {
+        skipped++;
+        return;
+    }
+    if (err != CANFILTER_SUCCESS) {
+        std::cout << "FAIL  " << name << ": BPF does not compile" << std::endl;
+        failures++;
+        return;
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t can_id : can_ids) {
+        checks++;
+        if (bpf.match(can_id) != expected(spec, can_id & ~rtr_flag))
+            mismatches++;
+    }
+    if (mismatches) {
+        std::cout << "FAIL  " << name << ": BPF " << mismatches << " mismatches" << std::endl;
+        failures++;
+    }
+}
+
+static void check_firmware(const std::string &name, const canfilter_ranges &spec,
+                           const std::vector<uint32_t> &can_ids) {
+    canfilter_firmware firmware;
+    firmware.flash_budget = 65536;
+    canfilter_error_t err = spec.compile(firmware);
+    if (err == CANFILTER_ERROR_FULL) {
+        skipped++;
+        return;
+    }
+    if (err != CANFILTER_SUCCESS) {
+        std::cout << "FAIL  " << name << ": firmware tables do not compile" << std::endl;
+        failures++;
+        return;
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t can_id : can_ids) {
+        checks++;
+        if (firmware.match(can_id) != expected(spec, can_id & ~rtr_flag))
+            mismatches++;
+    }
+    if (mismatches) {
+        std::cout << "FAIL  " << name << ": firmware " << mismatches << " mismatches" << std::endl;
+        failures++;
+    }
+}
+
+static void check(const std::string &name, const canfilter_ranges &spec, std::mt19937 &rng) {
+    std::vector<uint32_t> can_ids;
+    test_ids(spec, rng, can_ids);
+    check_bpf(name, spec, can_ids);
+    check_firmware(name, spec, can_ids);
+}
+
+int main() {
+    static const char *const fixed[] = {
+        "0x100",
+        "0x100-0x1ff 0x7df 0x7e8-0x7ef",
+        "0-0x7ff",
+        "0-0x7ff 0-0x1fffffff",
+        "0x18fef100 0x0cf00400 0x18fee000-0x18fee0ff",
+        "0x1fff-0x2000 0x3fffff-0x400000 0x1ffffffe-0x1fffffff",
+        "0x100-0x17f 0x150-0x1ff 0x120 0x100-0x17f",
+        "0x800-0x1fffffff",
+    };
+
+    std::mt19937 rng(1);
+    uint32_t specs = 0;
+    for (const char *text : fixed) {
+        canfilter_ranges spec;
+        std::istringstream words(text);
+        std::vector<std::string> args;
+        std::string word;
+        while (words >> word)
+            args.push_back(word);
+        spec.begin();
+        spec.parse(args);
+        spec.end();
+        check(text, spec, rng);
+        specs++;
+    }
+
+    for (int n = 0; n < 200; n++) {
+        canfilter_ranges spec;
+        spec.begin();
+        int count = (n % 10 == 0) ? rng() % 400 : rng() % 40;
+        for (int k = 0; k < count; k++) {
+            if (rng() % 2) {
+                uint32_t begin = rng() % (max_std_id + 1);
+                spec.add_std_range(begin, std::min<uint32_t>(max_std_id, begin + rng() % 64));
+            } else {
+                uint32_t begin = rng() & max_ext_id;
+                uint32_t width = (rng() % 4 == 0) ? rng() % 100000 : rng() % 4;
+                spec.add_ext_range(begin, std::min<uint32_t>(max_ext_id, begin + width));
+            }
+        }
+        spec.end();
+        check("random " + std::to_string(n), spec, rng);
+        specs++;
+    }
+
+    std::cout << "match: " << specs << " specifications, " << checks << " checks, " << skipped << " skipped, "
+              << failures << " failed" << std::endl;
+    return failures ? 1 : 0;
+}
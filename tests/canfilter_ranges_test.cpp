@@ -0,0 +1,217 @@
+/*
+ * canfilter_ranges_test.cpp
+ *
+ * Checks the controller-independent specification, canfilter_ranges.
+ *
+ * Responsibilities:
+ * - Normalize pseudo-random lists of overlapping ranges and check that the
+ *   result is sorted, merged and accepts the same IDs as the input.
+ * - Subtract random specifications and check the IDs that remain.
+ * - Check that parsed specifications replay in command line order and
+ *   others compile from the normalized ranges.
+ *
+ * Notes:
+ * - IDs are drawn from a narrow window of each format, so that ranges
+ *   overlap and touch often; every ID of the window is checked.
+ */
+
+#include "canfilter_ranges.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// copies, so that std::min does not need definitions of the class constants
+static const uint32_t max_std_id = canfilter::max_std_id;
+static const uint32_t max_ext_id = canfilter::max_ext_id;
+
+// ID windows: all standard IDs, and extended IDs at the start and the end of the range
+static const uint32_t window = 0x200;
+static const uint32_t ext_base[2] = {0, max_ext_id - window + 1};
+
+static uint32_t checks = 0;
+static uint32_t failures = 0;
+
+static void fail(const std::string &name, const std::string &what) {
+    std::cout << "FAIL  " << name << ": " << what << std::endl;
+    failures++;
+}
+
+// Any range of list holds id
+static bool listed(const std::vector<canfilter_range> &list, uint32_t id, bool ext) {
+    for (const auto &r : list)
+        if (r.ext == ext && id >= r.begin && id <= r.end)
+            return true;
+    return false;
+}
+
+// Random ranges inside the windows, added through the canfilter interface
+static void random_ranges(std::mt19937 &rng, int count, canfilter &spec) {
+    for (int k = 0; k < count; k++) {
+        bool ext = rng() % 2;
+        uint32_t begin = ext ? ext_base[rng() % 2] + rng() % window : rng() % (max_std_id + 1);
+        uint32_t max_id = ext ? max_ext_id : max_std_id;
+        uint32_t end = (rng() % 3 == 0) ? begin : std::min<uint32_t>(max_id, begin + rng() % 40);
+        if (ext)
+            spec.add_ext_range(begin, end);
+        else
+            spec.add_std_range(begin, end);
+    }
+}
+
+// spec holds the IDs of list, sorted, with gaps between ranges (and between adjacent ones if merge_adjacent)
+static void check_normalized(const std::string &name, const canfilter_ranges &spec,
+                             const std::vector<canfilter_range> &list, bool merge_adjacent) {
+    checks++;
+    for (size_t i = 1; i < spec.ranges.size(); i++) {
+        const canfilter_range &a = spec.ranges[i - 1];
+        const canfilter_range &b = spec.ranges[i];
+        if (a.ext != b.ext) {
+            if (a.ext)
+                fail(name, "extended before standard range");
+            continue;
+        }
+        if ((uint64_t)b.begin <= (uint64_t)a.end + (merge_adjacent ? 1 : 0)) {
+            fail(name, merge_adjacent ? "ranges overlap or touch" : "ranges overlap or are not sorted");
+            return;
+        }
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t id = 0; id <= max_std_id; id++) {
+        checks++;
+        if (spec.accepts(id, false) != listed(list, id, false))
+            mismatches++;
+    }
+    for (uint32_t base : ext_base) {
+        for (uint32_t id = base; id - base < window; id++) {
+            checks++;
+            if (spec.accepts(id, true) != listed(list, id, true))
+                mismatches++;
+        }
+    }
+    if (mismatches)
+        fail(name, std::to_string(mismatches) + " mismatches");
+}
+
+// spec minus removed holds the IDs of spec that removed does not, normalized
+static void check_subtract(const std::string &name, const canfilter_ranges &spec, const canfilter_ranges &removed) {
+    canfilter_ranges rest = spec;
+    rest.subtract(removed);
+    checks++;
+    if (rest.replay_order())
+        fail(name, "subtract() left replay order set");
+
+    std::vector<canfilter_range> list;
+    for (const auto &r : spec.ranges) {
+        bool ext = r.ext;
+        for (uint64_t id = r.begin; id <= r.end; id++) {
+            if (removed.accepts((uint32_t)id, ext))
+                continue;
+            if (!list.empty() && list.back().ext == ext && list.back().end + 1 == id)
+                list.back().end = (uint32_t)id;
+            else
+                list.push_back({(uint32_t)id, (uint32_t)id, ext});
+        }
+    }
+    check_normalized(name, rest, list, false);
+}
+
+// Builder that records the add_*() calls it gets
+class recorder : public canfilter_ranges {
+  public:
+    std::vector<std::string> calls;
+
+    canfilter_error_t add_std_id(uint32_t id) override {
+        calls.push_back("std " + std::to_string(id));
+        return canfilter_ranges::add_std_range(id, id); // not through the recording override
+    }
+    canfilter_error_t add_ext_id(uint32_t id) override {
+        calls.push_back("ext " + std::to_string(id));
+        return canfilter_ranges::add_ext_range(id, id); // not through the recording override
+    }
+    canfilter_error_t add_std_range(uint32_t begin, uint32_t end) override {
+        calls.push_back("std " + std::to_string(begin) + "-" + std::to_string(end));
+        return canfilter_ranges::add_std_range(begin, end);
+    }
+    canfilter_error_t add_ext_range(uint32_t begin, uint32_t end) override {
+        calls.push_back("ext " + std::to_string(begin) + "-" + std::to_string(end));
+        return canfilter_ranges::add_ext_range(begin, end);
+    }
+};
+
+static std::string joined(const std::vector<std::string> &calls) {
+    std::string text;
+    for (const auto &call : calls)
+        text += (text.empty() ? "" : ", ") + call;
+    return text;
+}
+
+// Parsed: add_*() calls in command line order; after clear_replay(): the normalized ranges
+static void check_replay() {
+    canfilter_ranges spec;
+    spec.begin();
+    spec.parse(std::vector<std::string>{"0x300", "0x100-0x1ff", "0x150", "0x12345678"});
+    spec.end();
+
+    recorder target;
+    checks++;
+    if (!spec.replay_order())
+        fail("replay", "parse() did not set replay order");
+    spec.compile(target);
+    std::string want = "std 768, std 256-511, std 336, ext 305419896";
+    if (joined(target.calls) != want)
+        fail("replay", "replayed " + joined(target.calls) + ", want " + want);
+
+    spec.clear_replay();
+    target.calls.clear();
+    checks++;
+    if (spec.replay_order())
+        fail("replay", "clear_replay() left replay order set");
+    spec.compile(target);
+    want = "std 256-511, std 768, ext 305419896";
+    if (joined(target.calls) != want)
+        fail("replay", "normalized " + joined(target.calls) + ", want " + want);
+
+    spec.begin();
+    checks++;
+    if (spec.replay_order())
+        fail("replay", "begin() left replay order set");
+}
+
+int main() {
+    std::mt19937 rng(1);
+    uint32_t specs = 0;
+
+    for (int n = 0; n < 300; n++) {
+        std::string name = "random " + std::to_string(n);
+        canfilter_ranges spec;
+        spec.begin();
+        random_ranges(rng, rng() % 60, spec);
+        std::vector<canfilter_range> list = spec.ranges;
+        std::shuffle(spec.ranges.begin(), spec.ranges.end(), rng);
+        spec.clear_replay();
+
+        spec.normalize();
+        check_normalized(name, spec, list, false);
+        spec.normalize(true);
+        check_normalized(name + " adjacent", spec, list, true);
+
+        canfilter_ranges removed;
+        removed.begin();
+        random_ranges(rng, rng() % 20, removed);
+        removed.end();
+        check_subtract(name + " subtract", spec, removed);
+        check_subtract(name + " subtract itself", spec, spec);
+        specs++;
+    }
+
+    check_replay();
+
+    std::cout << "ranges: " << specs << " specifications, " << checks << " checks, " << failures << " failed"
+              << std::endl;
+    return failures ? 1 : 0;
+}